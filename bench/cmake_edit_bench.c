@@ -0,0 +1,168 @@
+#include "cli.h"
+
+// Times one install/uninstall command against generated CMakeLists.txt
+// files of growing size. "legacy" replays what every edit used to do
+// (read the file, rebuild it with strcat, squeeze "\n\n\n" with memmove,
+// write it back); "engine" is the block model with one write per command.
+// The us/line column should stay flat for the engine as the file grows.
+
+#define BENCH_EDITS 8
+#define BENCH_ROUNDS 5
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void generate(const char *path, int lines)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return;
+
+    fprintf(file, "cmake_minimum_required(VERSION 3.14)\nproject(app)\n\n");
+    fprintf(file, "add_executable(app\n    src/main.c\n)\n");
+
+    for (int i = 0; i < lines / 3; i++)
+        fprintf(file, "\n# module%d\ntarget_sources(app PRIVATE src/module%d.c)\n", i, i);
+
+    fclose(file);
+}
+
+// The old strcat based builder
+static void legacy_append(char **data, size_t *capacity, const char *str)
+{
+    size_t size = strlen(*data);
+    size_t len = strlen(str);
+    while (size + len + 1 > *capacity)
+    {
+        *capacity *= 2;
+        *data = realloc(*data, *capacity);
+    }
+    strcat(*data, str);
+}
+
+static void legacy_install(const char *path, const char *name)
+{
+    char *content = read_file(path);
+    char *exec_name = cmake_find_exec_name(content);
+    size_t capacity = 256;
+    char *data = calloc(1, capacity);
+
+    legacy_append(&data, &capacity, content);
+    legacy_append(&data, &capacity, "\n# ");
+    legacy_append(&data, &capacity, name);
+    legacy_append(&data, &capacity, "\n");
+    legacy_append(&data, &capacity, "target_sources(");
+    legacy_append(&data, &capacity, exec_name);
+    legacy_append(&data, &capacity, " PRIVATE vendors/");
+    legacy_append(&data, &capacity, name);
+    legacy_append(&data, &capacity, ".c)\n");
+
+    write_file(path, data);
+    free(data);
+    free(exec_name);
+    free(content);
+}
+
+static void legacy_uninstall(const char *path, const char *name)
+{
+    char *result = read_file(path);
+    char comment[128];
+    snprintf(comment, sizeof(comment), "# %s\n", name);
+
+    char *block_start = strstr(result, comment);
+    if (block_start)
+    {
+        char *block_end = strstr(block_start + strlen(comment), "\n# ");
+        if (!block_end)
+            block_end = result + strlen(result);
+        memmove(block_start, block_end, strlen(block_end) + 1);
+    }
+
+    char *triple_newline;
+    while ((triple_newline = strstr(result, "\n\n\n")) != NULL)
+        memmove(triple_newline, triple_newline + 1, strlen(triple_newline));
+
+    write_file(path, result);
+    free(result);
+}
+
+static void run_legacy(const char *path)
+{
+    char name[32];
+    for (int i = 0; i < BENCH_EDITS; i++)
+    {
+        snprintf(name, sizeof(name), "vendor%d", i);
+        legacy_install(path, name);
+    }
+    for (int i = 0; i < BENCH_EDITS; i++)
+    {
+        snprintf(name, sizeof(name), "module%d", i * 7);
+        legacy_uninstall(path, name);
+    }
+}
+
+static void run_engine(const char *path)
+{
+    char name[32];
+    CMakeFile *cmake = cmake_open(path);
+    if (!cmake)
+        return;
+
+    for (int i = 0; i < BENCH_EDITS; i++)
+    {
+        snprintf(name, sizeof(name), "vendor%d", i);
+        cmake_append_block(cmake, name, "target_sources(app PRIVATE vendors/vendor.c)\n");
+    }
+    for (int i = 0; i < BENCH_EDITS; i++)
+    {
+        snprintf(name, sizeof(name), "module%d", i * 7);
+        cmake_remove_block(cmake, name, NULL);
+    }
+
+    cmake_commit(cmake);
+    cmake_close(cmake);
+}
+
+static double best_of(void (*run)(const char *), const char *path, int lines)
+{
+    double best = -1;
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        generate(path, lines);
+        double start = now_ms();
+        run(path);
+        double elapsed = now_ms() - start;
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(void)
+{
+    const char *tmp = getenv("TMPDIR");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/ecewo-bench-%ld.txt", tmp ? tmp : "/tmp", (long)getpid());
+
+    printf("CMakeLists.txt edit, %d installs + %d uninstalls, best of %d\n\n",
+           BENCH_EDITS, BENCH_EDITS, BENCH_ROUNDS);
+    printf("%8s  %12s  %12s  %10s  %8s\n", "lines", "legacy ms", "engine ms", "us/line", "speedup");
+
+    int sizes[] = {1000, 2000, 4000, 8000, 16000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        double legacy = best_of(run_legacy, path, sizes[i]);
+        double engine = best_of(run_engine, path, sizes[i]);
+
+        printf("%8d  %12.3f  %12.3f  %10.4f  %7.1fx\n",
+               sizes[i], legacy, engine, engine * 1000.0 / sizes[i],
+               engine > 0 ? legacy / engine : 0.0);
+    }
+
+    remove(path);
+    return 0;
+}
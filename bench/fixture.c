@@ -0,0 +1,234 @@
+#include "cli.h"
+#include "fixture.h"
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// Stand-ins for the network while the workflow benchmarks run. The HTTP
+// server serves a directory the way raw.githubusercontent.com serves
+// repository files: keep-alive connections, an ETag per file and 304 for
+// a matching If-None-Match. Git dependencies come from local repositories
+// with a main branch, which git ls-remote and FetchContent take as well
+// as a URL.
+
+#define FIXTURE_REQUEST_MAX 8192
+
+static char fixture_root[512];
+static int fixture_listen_fd = -1;
+static long fixture_request_count = 0;
+static pthread_mutex_t fixture_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t sent = send(fd, data, len, 0);
+        if (sent <= 0)
+            return -1;
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+static char *load_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *data = len >= 0 ? malloc((size_t)len + 1) : NULL;
+    if (data && fread(data, 1, (size_t)len, file) != (size_t)len)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    if (data)
+        *size = (size_t)len;
+    return data;
+}
+
+// Answer one request, head holds its request line and headers
+static int respond(int fd, char *head)
+{
+    char method[16], target[1024];
+    if (sscanf(head, "%15s %1023s", method, target) != 2)
+        return -1;
+
+    pthread_mutex_lock(&fixture_lock);
+    fixture_request_count++;
+    pthread_mutex_unlock(&fixture_lock);
+
+    char *query = strchr(target, '?');
+    if (query)
+        *query = '\0';
+
+    char path[2048];
+    size_t size = 0;
+    char *body = NULL;
+    if (strcmp(method, "GET") == 0 && !strstr(target, ".."))
+    {
+        snprintf(path, sizeof(path), "%s%s", fixture_root, target);
+        body = load_file(path, &size);
+    }
+
+    char header[512];
+    if (!body)
+    {
+        const char *missing = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        return send_all(fd, missing, strlen(missing));
+    }
+
+    Sha256 ctx;
+    char hash[SHA256_HEX_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, body, size);
+    sha256_final_hex(&ctx, hash);
+    hash[16] = '\0';
+
+    char etag[SHA256_HEX_SIZE + 2];
+    snprintf(etag, sizeof(etag), "\"%s\"", hash);
+
+    char *match = strstr(head, "\r\nIf-None-Match: ");
+    if (match && strncmp(match + strlen("\r\nIf-None-Match: "), etag, strlen(etag)) == 0)
+    {
+        free(body);
+        int len = snprintf(header, sizeof(header), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", etag);
+        return send_all(fd, header, (size_t)len);
+    }
+
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\nContent-Type: text/plain; charset=utf-8\r\n"
+                       "Content-Length: %zu\r\nETag: %s\r\n\r\n",
+                       size, etag);
+    int result = send_all(fd, header, (size_t)len) == 0 ? send_all(fd, body, size) : -1;
+    free(body);
+    return result;
+}
+
+static void *serve_connection(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    char *buffer = malloc(FIXTURE_REQUEST_MAX + 1);
+    size_t used = 0;
+
+    while (buffer)
+    {
+        buffer[used] = '\0';
+        char *end = strstr(buffer, "\r\n\r\n");
+        if (!end)
+        {
+            if (used == FIXTURE_REQUEST_MAX)
+                break;
+            ssize_t n = recv(fd, buffer + used, FIXTURE_REQUEST_MAX - used, 0);
+            if (n <= 0)
+                break;
+            used += (size_t)n;
+            continue;
+        }
+
+        end[2] = '\0';
+        if (respond(fd, buffer) != 0)
+            break;
+
+        // Requests carry no body, the next one starts right after
+        size_t consumed = (size_t)(end + 4 - buffer);
+        memmove(buffer, buffer + consumed, used - consumed);
+        used -= consumed;
+    }
+
+    free(buffer);
+    close(fd);
+    return NULL;
+}
+
+static void *accept_connections(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        int fd = accept(fixture_listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_connection, (void *)(intptr_t)fd) == 0)
+            pthread_detach(thread);
+        else
+            close(fd);
+    }
+    return NULL;
+}
+
+// Serve the files under root on a free loopback port, for the lifetime
+// of the process. Returns the port, or -1.
+int fixture_serve(const char *root)
+{
+    snprintf(fixture_root, sizeof(fixture_root), "%s", root);
+
+    fixture_listen_fd = open_listen_socket(0, 0);
+    if (fixture_listen_fd < 0)
+        return -1;
+
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(fixture_listen_fd, (struct sockaddr *)&addr, &addr_len) != 0)
+        return -1;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, accept_connections, NULL) != 0)
+        return -1;
+    pthread_detach(thread);
+
+    return ntohs(addr.sin_port);
+}
+
+// Requests answered so far
+long fixture_requests(void)
+{
+    pthread_mutex_lock(&fixture_lock);
+    long count = fixture_request_count;
+    pthread_mutex_unlock(&fixture_lock);
+    return count;
+}
+
+// Write files (pairs of relative path and content, NULL terminated)
+// under dir, creating directories on the way
+int fixture_write(const char *dir, const char *const *files)
+{
+    for (int i = 0; files[i]; i += 2)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+
+        char *slash = strrchr(path, '/');
+        *slash = '\0';
+        if (create_directory(path) != 0)
+            return -1;
+        *slash = '/';
+
+        if (write_file(path, files[i + 1]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// A git repository at dir holding files, committed on branch main
+int fixture_git_repository(const char *dir, const char *const *files)
+{
+    if (fixture_write(dir, files) != 0)
+        return -1;
+
+    char command[2048];
+    snprintf(command, sizeof(command),
+             "cd \"%s\" && git -c init.defaultBranch=main init -q && git add -A && "
+             "git -c user.name=bench -c user.email=bench@localhost commit -q -m fixture",
+             dir);
+    return system(command) == 0 ? 0 : -1;
+}
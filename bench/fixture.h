@@ -0,0 +1,10 @@
+#ifndef ECEWO_BENCH_FIXTURE_H
+#define ECEWO_BENCH_FIXTURE_H
+
+// Local HTTP server and git repositories for the workflow benchmarks
+int fixture_serve(const char *root);
+long fixture_requests(void);
+int fixture_write(const char *dir, const char *const *files);
+int fixture_git_repository(const char *dir, const char *const *files);
+
+#endif
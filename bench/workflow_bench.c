@@ -0,0 +1,602 @@
+// realpath
+#define _XOPEN_SOURCE 700
+
+#include "cli.h"
+#include "fixture.h"
+
+// Times the CLI's own workflows end to end without the network: create
+// with every library, install/uninstall cycles, edits of a large
+// CMakeLists.txt, and cold and warm builds. Each step runs the ecewo
+// binary the way a user would. Vendored files come from the fixture
+// server instead of raw.githubusercontent.com and git dependencies from
+// local repositories, through an ECEWO_REGISTRY rewritten to point there
+// and ECEWO_REPOSITORY for ecewo itself. Fixture files are as large as
+// the registry says the real ones are.
+//
+// Results go to a JSON file. Given a baseline from an earlier run, steps
+// whose median got slower by more than the threshold fail the run.
+
+#define WORKFLOW_REGISTRY "src/lib/plugins.ini"
+#define WORKFLOW_DEFAULT_OUTPUT "bench/workflows.json"
+#define WORKFLOW_DEFAULT_RUNS 3
+#define WORKFLOW_MAX_RUNS 20
+#define WORKFLOW_DEFAULT_THRESHOLD 10.0
+#define WORKFLOW_LARGE_LINES 30000
+#define WORKFLOW_PROJECT_NAME "bench"
+
+#define RAW_URL_PREFIX "https://raw.githubusercontent.com"
+
+typedef struct
+{
+    const char *name;
+    double ms[WORKFLOW_MAX_RUNS];
+    int runs;
+    long requests; // Fixture requests during the timed runs
+} Step;
+
+static char work_dir[512];
+static char cli_path[1024];
+static char log_path[1024];
+static int fixture_port;
+
+// Run the CLI with args inside dir, feeding it input when given. Returns
+// the time it took in ms, or -1 if it failed.
+static double run_cli(const char *dir, const char *args, const char *input)
+{
+    char command[4096];
+    snprintf(command, sizeof(command), "cd \"%s\" && \"%s\" %s >>\"%s\" 2>&1", dir, cli_path, args, log_path);
+
+    long long start = monotonic_us();
+    int status;
+    if (input)
+    {
+        FILE *pipe = popen(command, "w");
+        if (!pipe)
+            return -1;
+        fputs(input, pipe);
+        status = pclose(pipe);
+    }
+    else
+    {
+        status = system(command);
+    }
+    long long elapsed = monotonic_us() - start;
+
+    if (status != 0)
+    {
+        printf("Failed: ecewo %s in %s, output in %s\n", args, dir, log_path);
+        return -1;
+    }
+    return elapsed / 1000.0;
+}
+
+static void set_cache(const char *name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", work_dir, name);
+    setenv("ECEWO_CACHE_DIR", path, 1);
+}
+
+static int record(Step *step, double ms, long requests_before)
+{
+    if (ms < 0)
+        return -1;
+    step->ms[step->runs++] = ms;
+    step->requests += fixture_requests() - requests_before;
+    return 0;
+}
+
+static int compare_ms(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(const Step *step)
+{
+    double sorted[WORKFLOW_MAX_RUNS];
+    memcpy(sorted, step->ms, sizeof(double) * step->runs);
+    qsort(sorted, step->runs, sizeof(double), compare_ms);
+    return step->runs % 2 ? sorted[step->runs / 2] : (sorted[step->runs / 2 - 1] + sorted[step->runs / 2]) / 2;
+}
+
+static void spread(const Step *step, double *min, double *max)
+{
+    *min = *max = step->ms[0];
+    for (int r = 1; r < step->runs; r++)
+    {
+        *min = step->ms[r] < *min ? step->ms[r] : *min;
+        *max = step->ms[r] > *max ? step->ms[r] : *max;
+    }
+}
+
+// Path a raw URL is served under by the fixture server
+static const char *fixture_path(const char *url)
+{
+    return strncmp(url, RAW_URL_PREFIX, strlen(RAW_URL_PREFIX)) == 0 ? url + strlen(RAW_URL_PREFIX) : NULL;
+}
+
+static char *padded(const char *code, size_t size)
+{
+    size_t len = strlen(code);
+    size_t total = size > len ? size : len;
+    char *content = malloc(total + 1);
+    if (!content)
+        return NULL;
+
+    memcpy(content, code, len);
+    const char *filler = "// Fixture padding, the size of the real file matters for the download\n";
+    size_t filler_len = strlen(filler);
+    while (len + filler_len <= total)
+    {
+        memcpy(content + len, filler, filler_len);
+        len += filler_len;
+    }
+    content[len] = '\0';
+    return content;
+}
+
+// Base name of a git URL without .git, also the CMake target a fixture
+// repository provides
+static void repository_name(const char *url, char *name, size_t name_size)
+{
+    const char *base = strrchr(url, '/');
+    base = base ? base + 1 : url;
+    size_t len = strlen(base);
+    if (len > 4 && strcmp(base + len - 4, ".git") == 0)
+        len -= 4;
+    snprintf(name, name_size, "%.*s", (int)len, base);
+}
+
+// Copy of text with every from replaced by to
+static char *replace(const char *text, const char *from, const char *to)
+{
+    StringBuilder *sb = sb_create();
+    if (!sb)
+        return NULL;
+
+    const char *p = text;
+    const char *found;
+    while ((found = strstr(p, from)) != NULL)
+    {
+        char *part = malloc(found - p + 1);
+        if (!part)
+            break;
+        memcpy(part, p, found - p);
+        part[found - p] = '\0';
+        sb_append(sb, part);
+        sb_append(sb, to);
+        free(part);
+        p = found + strlen(from);
+    }
+    sb_append(sb, p);
+
+    char *result = malloc(sb->size + 1);
+    if (result)
+        memcpy(result, sb->data, sb->size + 1);
+    sb_free(sb);
+    return result;
+}
+
+// The files of every vendored library under files/, a git repository for
+// every git dependency and for ecewo, and the registry pointing at them
+static int prepare_fixtures(void)
+{
+    char root[1024], path[1024];
+    snprintf(root, sizeof(root), "%s/files", work_dir);
+
+    fixture_port = fixture_serve(root);
+    if (fixture_port < 0)
+    {
+        printf("Could not start the fixture server\n");
+        return -1;
+    }
+
+    char *registry = read_file(WORKFLOW_REGISTRY);
+    if (!registry)
+    {
+        printf("Could not read %s\n", WORKFLOW_REGISTRY);
+        return -1;
+    }
+
+    char base[64];
+    snprintf(base, sizeof(base), "http://127.0.0.1:%d", fixture_port);
+    char *rewritten = replace(registry, RAW_URL_PREFIX, base);
+    free(registry);
+
+    for (int i = 0; rewritten && i < plugin_count; i++)
+    {
+        const Plugin *plugin = &plugins[i];
+
+        if (plugin->c_url)
+        {
+            const char *c_path = fixture_path(plugin->c_url);
+            const char *h_path = fixture_path(plugin->h_url);
+            if (!c_path || !h_path)
+            {
+                printf("%s is not on raw.githubusercontent.com, no fixture for it\n", plugin->id);
+                continue;
+            }
+
+            char code[256], header[256];
+            snprintf(code, sizeof(code), "#include \"%s.h\"\n\nint bench_vendor_%d(void)\n{\n    return %d;\n}\n\n", plugin->name, i, i);
+            snprintf(header, sizeof(header), "int bench_vendor_%d(void);\n\n", i);
+
+            char *c_content = padded(code, plugin->c_size);
+            char *h_content = padded(header, plugin->h_size);
+            const char *files[] = {c_path + 1, c_content, h_path + 1, h_content, NULL};
+            int written = c_content && h_content && fixture_write(root, files) == 0;
+            free(c_content);
+            free(h_content);
+            if (!written)
+                return -1;
+        }
+
+        if (plugin->git_url)
+        {
+            char name[128], cmake[1024], source[256];
+            repository_name(plugin->git_url, name, sizeof(name));
+            snprintf(path, sizeof(path), "%s/git/%s", work_dir, name);
+            snprintf(cmake, sizeof(cmake),
+                     "cmake_minimum_required(VERSION 3.14)\nproject(%s C)\n"
+                     "add_library(%s STATIC src/%s.c)\n"
+                     "target_include_directories(%s PUBLIC src)\n",
+                     name, name, name, name);
+            snprintf(source, sizeof(source), "int bench_%s(void)\n{\n    return 0;\n}\n", name);
+
+            char source_path[160];
+            snprintf(source_path, sizeof(source_path), "src/%s.c", name);
+            const char *files[] = {"CMakeLists.txt", cmake, source_path, source, NULL};
+            if (fixture_git_repository(path, files) != 0)
+                return -1;
+
+            char *pointed = replace(rewritten, plugin->git_url, path);
+            free(rewritten);
+            rewritten = pointed;
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/registry.ini", work_dir);
+    int result = rewritten ? write_file(path, rewritten) : -1;
+    free(rewritten);
+    if (result != 0)
+        return -1;
+    setenv("ECEWO_REGISTRY", path, 1);
+
+    // ecewo itself: just what the generated main.c calls
+    const char *ecewo_files[] = {
+        "CMakeLists.txt",
+        "cmake_minimum_required(VERSION 3.14)\nproject(ecewo C)\n"
+        "add_library(ecewo STATIC src/ecewo.c)\n"
+        "target_include_directories(ecewo PUBLIC include)\n",
+        "include/ecewo.h",
+        "#ifndef ECEWO_H\n#define ECEWO_H\n\nvoid init_router(void);\nvoid reset_router(void);\n"
+        "void shutdown_hook(void (*hook)(void));\nint ecewo(unsigned short port);\n\n#endif\n",
+        "include/server.h",
+        "#include \"ecewo.h\"\n",
+        "src/ecewo.c",
+        "#include \"ecewo.h\"\n\nvoid init_router(void) {}\nvoid reset_router(void) {}\n"
+        "void shutdown_hook(void (*hook)(void)) { (void)hook; }\n"
+        "int ecewo(unsigned short port) { return port ? 0 : 1; }\n",
+        NULL,
+    };
+    snprintf(path, sizeof(path), "%s/git/ecewo", work_dir);
+    if (fixture_git_repository(path, ecewo_files) != 0)
+        return -1;
+    setenv("ECEWO_REPOSITORY", path, 1);
+
+    return 0;
+}
+
+// Answers to the prompts of ecewo create: the project name, then every
+// library toggled on when all is set
+static void create_input(char *input, size_t size, int all)
+{
+    int len = snprintf(input, size, WORKFLOW_PROJECT_NAME "\n");
+    for (int i = 0; all && i < plugin_count && (size_t)len + 3 < size; i++)
+        len += snprintf(input + len, size - len, " s");
+    snprintf(input + len, size - len, "\n");
+}
+
+static int create_project_in(const char *dir, int all, double *ms)
+{
+    char input[512];
+    create_input(input, sizeof(input), all);
+
+    if (create_directory(dir) != 0)
+        return -1;
+
+    *ms = run_cli(dir, "create", input);
+    return *ms < 0 ? -1 : 0;
+}
+
+static int run_create(Step *step, int runs)
+{
+    for (int run = 0; run < runs; run++)
+    {
+        char dir[1024], cache[64];
+        snprintf(dir, sizeof(dir), "%s/create-%d", work_dir, run);
+        snprintf(cache, sizeof(cache), "cache-create-%d", run);
+
+        // Every run starts with an empty vendor cache
+        set_cache(cache);
+
+        long before = fixture_requests();
+        double ms;
+        if (create_project_in(dir, 1, &ms) != 0 || record(step, ms, before) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int run_cycles(Step *step, const char *dir, const char *libraries, int runs)
+{
+    char install[1024], uninstall[1024];
+    snprintf(install, sizeof(install), "install %s", libraries);
+    snprintf(uninstall, sizeof(uninstall), "uninstall %s", libraries);
+
+    set_cache("cache");
+
+    // Untimed, fills the vendor cache
+    if (run_cli(dir, install, NULL) < 0 || run_cli(dir, uninstall, NULL) < 0)
+        return -1;
+
+    for (int run = 0; run < runs; run++)
+    {
+        long before = fixture_requests();
+        double install_ms = run_cli(dir, install, NULL);
+        double uninstall_ms = install_ms < 0 ? -1 : run_cli(dir, uninstall, NULL);
+        if (record(step, uninstall_ms < 0 ? -1 : install_ms + uninstall_ms, before) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Blocks of unrelated modules after the generated CMakeLists.txt
+static int grow_cmakelists(const char *dir, int lines)
+{
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/CMakeLists.txt", dir);
+
+    FILE *file = fopen(path, "a");
+    if (!file)
+        return -1;
+
+    for (int i = 0; i < lines / 3; i++)
+        fprintf(file, "\n# module%d\ntarget_sources(" WORKFLOW_PROJECT_NAME " PRIVATE src/module%d.c)\n", i, i);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+static int run_builds(Step *cold, Step *warm, Step *rebuild, const char *dir, int runs)
+{
+    char build_dir[1100];
+    snprintf(build_dir, sizeof(build_dir), "%s/build", dir);
+
+    for (int run = 0; run < runs; run++)
+    {
+        remove_directory(build_dir);
+
+        long before = fixture_requests();
+        if (record(cold, run_cli(dir, "build", NULL), before) != 0)
+            return -1;
+
+        before = fixture_requests();
+        if (record(warm, run_cli(dir, "build", NULL), before) != 0)
+            return -1;
+
+        before = fixture_requests();
+        if (record(rebuild, run_cli(dir, "rebuild", NULL), before) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int save_results(const char *path, const Step *steps, int count)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"suite\": \"workflows\",\n");
+    fprintf(file, "  \"steps\": [\n");
+    for (int i = 0; i < count; i++)
+    {
+        const Step *step = &steps[i];
+        double min, max;
+        spread(step, &min, &max);
+
+        fprintf(file, "    {\"name\": \"%s\", \"runs\": %d, \"median_ms\": %.1f, \"min_ms\": %.1f, "
+                      "\"max_ms\": %.1f, \"http_requests\": %ld}%s\n",
+                step->name, step->runs, median(step), min, max, step->requests, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Median of the step called name in a results file, -1 if it isn't there
+static double baseline_median(const char *json, const char *name)
+{
+    char key[128];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+
+    const char *found = strstr(json, key);
+    if (!found)
+        return -1;
+
+    found = strstr(found, "\"median_ms\":");
+    double value;
+    if (!found || sscanf(found + strlen("\"median_ms\":"), "%lf", &value) != 1)
+        return -1;
+    return value;
+}
+
+static int compare_results(const char *path, const Step *steps, int count, double threshold)
+{
+    char *json = read_file(path);
+    if (!json)
+    {
+        printf("Could not read baseline %s\n", path);
+        return -1;
+    }
+
+    printf("\nAgainst %s (threshold %.0f%%):\n", path, threshold);
+
+    int regressions = 0;
+    for (int i = 0; i < count; i++)
+    {
+        double before = baseline_median(json, steps[i].name);
+        if (before <= 0)
+        {
+            printf("  %-28s not in the baseline\n", steps[i].name);
+            continue;
+        }
+
+        double now = median(&steps[i]);
+        double change = (now - before) * 100.0 / before;
+        int regressed = change > threshold;
+        regressions += regressed;
+        printf("  %-28s %10.1f -> %10.1f ms  %+6.1f%%%s\n", steps[i].name, before, now, change,
+               regressed ? "  REGRESSION" : "");
+    }
+
+    free(json);
+    return regressions ? -1 : 0;
+}
+
+static void usage(void)
+{
+    printf("Usage: workflow_bench --cli PATH [--output FILE] [--compare FILE]\n");
+    printf("                      [--threshold PCT] [--runs N]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *cli = NULL;
+    const char *output = WORKFLOW_DEFAULT_OUTPUT;
+    const char *compare = NULL;
+    double threshold = WORKFLOW_DEFAULT_THRESHOLD;
+    int runs = WORKFLOW_DEFAULT_RUNS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--cli") == 0 && i + 1 < argc)
+            cli = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+            compare = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!cli || runs < 1 || runs > WORKFLOW_MAX_RUNS || !realpath(cli, cli_path))
+    {
+        usage();
+        return 1;
+    }
+
+    // The real registry, without anything the environment adds to it
+    unsetenv("ECEWO_REGISTRY");
+    if (registry_load() != 0)
+        return 1;
+
+    const char *tmp = getenv("TMPDIR");
+    snprintf(work_dir, sizeof(work_dir), "%s/ecewo-workflows-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(work_dir))
+    {
+        printf("Could not create a work directory\n");
+        return 1;
+    }
+    snprintf(log_path, sizeof(log_path), "%s/ecewo.log", work_dir);
+
+    if (prepare_fixtures() != 0)
+    {
+        printf("Could not set up the fixtures in %s\n", work_dir);
+        return 1;
+    }
+
+    // Every library for the install cycles; for builds only those served
+    // by the fixtures, requirements like PostgreSQL are system libraries
+    char all[1024] = "", buildable[1024] = "";
+    for (int i = 0; i < plugin_count; i++)
+    {
+        snprintf(all + strlen(all), sizeof(all) - strlen(all), " %s", plugins[i].id);
+        if ((plugins[i].c_url || plugins[i].git_url) && plugins[i].require_count == 0)
+            snprintf(buildable + strlen(buildable), sizeof(buildable) - strlen(buildable), " %s", plugins[i].id);
+    }
+
+    Step steps[] = {
+        {"create_all_plugins", {0}, 0, 0},
+        {"install_uninstall_all", {0}, 0, 0},
+        {"install_uninstall_large_cmake", {0}, 0, 0},
+        {"build_cold", {0}, 0, 0},
+        {"build_warm", {0}, 0, 0},
+        {"rebuild", {0}, 0, 0},
+    };
+    int step_count = sizeof(steps) / sizeof(steps[0]);
+
+    printf("Workflow benchmarks in %s, %d runs each, fixtures on port %d\n", work_dir, runs, fixture_port);
+    fflush(stdout);
+
+    char project[1024], large[1024];
+    snprintf(project, sizeof(project), "%s/project", work_dir);
+    snprintf(large, sizeof(large), "%s/large", work_dir);
+
+    double ms;
+    int failed = run_create(&steps[0], runs) != 0 ||
+                 create_project_in(project, 0, &ms) != 0 ||
+                 run_cycles(&steps[1], project, all, runs) != 0 ||
+                 create_project_in(large, 0, &ms) != 0 ||
+                 grow_cmakelists(large, WORKFLOW_LARGE_LINES) != 0 ||
+                 run_cycles(&steps[2], large, "cjson", runs) != 0;
+
+    if (!failed)
+    {
+        char install[1024];
+        snprintf(install, sizeof(install), "install%s", buildable);
+        failed = run_cli(project, install, NULL) < 0 ||
+                 run_builds(&steps[3], &steps[4], &steps[5], project, runs) != 0;
+    }
+
+    if (failed)
+    {
+        printf("Workflow benchmarks failed, work directory kept: %s\n", work_dir);
+        return 1;
+    }
+
+    printf("\n%-30s %10s %10s %10s %9s\n", "step", "median ms", "min ms", "max ms", "requests");
+    for (int i = 0; i < step_count; i++)
+    {
+        double min, max;
+        spread(&steps[i], &min, &max);
+        printf("%-30s %10.1f %10.1f %10.1f %9ld\n", steps[i].name, median(&steps[i]), min, max, steps[i].requests);
+    }
+
+    int result = 0;
+    if (save_results(output, steps, step_count) != 0)
+    {
+        printf("Could not write %s\n", output);
+        result = 1;
+    }
+    else
+    {
+        printf("\nResults saved to %s\n", output);
+    }
+
+    if (compare && compare_results(compare, steps, step_count, threshold) != 0)
+        result = 1;
+
+    remove_directory(work_dir);
+    return result;
+}
@@ -1,15 +1,5 @@
 #include "cli.h"
-
-Plugin plugins[] = {
-    {"cJSON", CJSON_C_URL, CJSON_H_URL, 0},
-    {"dotenv", DOTENV_C_URL, DOTENV_H_URL, 0},
-    {"session", SESSION_C_URL, SESSION_H_URL, 0},
-    {"pquv", PQUV_C_URL, PQUV_H_URL, 0},
-    {"slugify", SLUGIFY_C_URL, SLUGIFY_H_URL, 0},
-    {"SQLite3", SQLITE_C_URL, SQLITE_H_URL, 0},
-    {"Postgres", NULL, NULL, 0},
-    {"CBOR", NULL, NULL, 0},
-};
+#include <signal.h>
 
 typedef enum
 {
@@ -17,16 +7,543 @@ typedef enum
     BUILD_TYPE_PROD // Production build
 } build_type_t;
 
-const int plugin_count = sizeof(plugins) / sizeof(Plugin);
+// Each build type gets its own tree under build/, so dev and prod stay
+// configured side by side and switching between them is incremental
+#define BUILD_DEV_DIR "build" PATH_SEPARATOR "dev"
+#define BUILD_PROD_DIR "build" PATH_SEPARATOR "prod"
+#define PROJECT_FROM_BUILD_DIR ".." PATH_SEPARATOR ".."
+
+// Quiet time after the last change before `run --watch` rebuilds, so a
+// burst of saves turns into one build
+#define WATCH_DEBOUNCE_MS 150
+#define WATCH_STOP_TIMEOUT_MS 5000
+#define WATCH_HANDOFF_GRACE_MS 500 // New server must live this long before the old one stops
+
+// Waits before run --restart starts a crashed server again: doubling with
+// every crash in a row, back to the minimum once it stays up for a while
+#define RESTART_BACKOFF_MIN_MS 100
+#define RESTART_BACKOFF_MAX_MS 30000
+#define RESTART_STABLE_MS 10000
+
+// run --workers: usage is sampled every second, and shown every five
+// while the workers are busy
+#define WORKERS_MAX 256
+#define WORKERS_INVALID -2 // --workers got something that isn't a count
+#define WORKERS_SAMPLE_MS 1000
+#define WORKERS_REPORT_MS 5000
+#define WORKERS_STARTUP_MS 500 // All workers gone by then means none can serve
+
+// Port of the listening socket handed to the server, matches the port
+// in the generated main.c
+#define DEFAULT_SERVER_PORT 3000
+
+// Training run of build pgo. The server has this long to open its port
+// and, once asked to stop, to exit normally: profile counters are only
+// written by a clean exit.
+#define SERVER_START_TIMEOUT_MS 30000
+#define PGO_STOP_TIMEOUT_MS 10000
+#define PGO_DEFAULT_REQUESTS 5000
+
+// Share of src/ that may change before PGO data is considered stale
+#define PGO_MAX_DRIFT_PERCENT 25
+
+// Functions counted as hot code in the layout report
+#define LAYOUT_HOT_FUNCTIONS 64
+
+// Startup times of run --ready-check, kept in the build tree
+#define READY_HISTORY_FILE "ecewo-ready"
+#define READY_POLL_MS 1
+#define WARMUP_DEFAULT_REQUESTS 200
+
+// Rows in each table of the timings report
+#define TIMINGS_REPORT_ROWS 10
+
+// Defaults of ecewo bench
+#define BENCH_DEFAULT_CONNECTIONS 64
+#define BENCH_DEFAULT_DURATION 10
+#define BENCH_DEFAULT_THRESHOLD 10.0
+#define BENCH_DEFAULT_OUTPUT "build" PATH_SEPARATOR "bench.json"
+
+// Vendored sources build into a static library of their own, set up in
+// vendors/CMakeLists.txt and built in a directory rebuild keeps
+#define VENDORS_TARGET "vendors"
+#define VENDORS_CMAKE_FILE "vendors" PATH_SEPARATOR "CMakeLists.txt"
+#define VENDORS_BINARY_DIR "vendors-build"
+#define VENDORS_LIBRARY_BLOCK "Vendors library"
+#define VENDORS_INCLUDE_BLOCK "Vendors include directory"
+#define UNITY_BLOCK "Unity build"
+
+// Options shared by build, rebuild and run
+typedef struct
+{
+    build_type_t type;
+    int jobs; // 0 picks a count from CPUs and memory
+    int full; // rebuild wipes the whole tree, _deps included
+    int profile_set; // profile was given on the command line
+    BuildProfile profile;
+    const char *pgo; // Replaces the recorded PGO mode, NULL keeps it
+    const char *layout; // Replaces the recorded layout mode, NULL keeps it
+    int timings; // Report where configure and build spent their time
+    int unity;       // 1 turns unity builds on, -1 off, 0 keeps the tree's setting
+    int unity_batch; // Batch size of --unity=N, 0 keeps the recorded one
+} build_options_t;
+
+// Options of run
+typedef struct
+{
+    int handoff; // Own the listening socket and pass it to the server
+    int port;
+    const char *path;   // Requested by --ready-check until it answers 200
+    const char *warmup; // Requests to replay before the server counts as ready
+    int warmup_requests;
+    int restart; // Start the server again after it crashes
+    int workers; // Servers sharing the port, -1 for one per CPU, 0 for a single one
+} run_options_t;
+
+// Options of the training runs of build pgo and build prod --layout
+typedef struct
+{
+    int port;             // Where the server listens during training
+    int requests;         // Length of the built-in request replay
+    const char *workload; // Script that drives the server instead
+} train_options_t;
+
+static void free_paths(char **paths, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (paths[i])
+            free(paths[i]);
+    }
+    free(paths);
+}
+
+// Lock entries always use forward slashes so ecewo.lock is portable
+static void lock_key(const char *path, char *key, size_t key_size)
+{
+    snprintf(key, key_size, "%s", path);
+    for (char *c = key; *c; c++)
+    {
+        if (*c == '\\')
+            *c = '/';
+    }
+}
+
+// Bring the files described by jobs up to date and record them in
+// ecewo.lock. Each job's url is the upstream (tracking) URL; it is pinned
+// to the resolved commit before fetching. Files whose revision and
+// content match the lock are skipped, the rest are revalidated with
+// If-None-Match, served from the shared cache or downloaded in one batch.
+// With frozen set, the locked revisions are used as-is and every file
+// must match its recorded SHA-256. Returns the number of failures.
+static int fetch_vendor_files(DownloadJob *jobs, int count, int use_cache, int frozen)
+{
+    Lockfile lock;
+    lock_load(&lock, LOCK_FILE);
+
+    const char **tracking = malloc(sizeof(char *) * count);
+    char (*revisions)[REVISION_SIZE] = malloc(REVISION_SIZE * count);
+    char (*pinned)[1024] = malloc(1024 * count);
+    char (*local)[SHA256_HEX_SIZE] = malloc(SHA256_HEX_SIZE * count);
+    char (*keys)[512] = malloc(512 * (size_t)count);
+    DownloadJob *pending = malloc(sizeof(DownloadJob) * count);
+    int *pending_index = malloc(sizeof(int) * count);
+
+    if (!tracking || !revisions || !pinned || !local || !keys || !pending || !pending_index)
+    {
+        free(tracking);
+        free(revisions);
+        free(pinned);
+        free(local);
+        free(keys);
+        free(pending);
+        free(pending_index);
+        lock_free(&lock);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+        tracking[i] = jobs[i].url;
+
+    if (!frozen)
+        resolve_url_revisions(tracking, count, revisions);
+
+    int pending_count = 0;
+    int hits = 0;
+    int unchanged = 0;
+    int failed = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        lock_key(jobs[i].output_path, keys[i], sizeof(keys[i]));
+        LockEntry *entry = lock_find(&lock, keys[i]);
+
+        jobs[i].result = -1;
+        jobs[i].error = HTTP_OK;
+        jobs[i].status = 0;
+        jobs[i].etag = NULL;
+        jobs[i].sha256[0] = '\0';
+        jobs[i].response_etag[0] = '\0';
+
+        if (frozen)
+        {
+            if (!entry || !entry->sha256[0])
+            {
+                printf("%s is not in %s\n", keys[i], LOCK_FILE);
+                failed++;
+                continue;
+            }
+            snprintf(revisions[i], REVISION_SIZE, "%s", entry->revision);
+        }
+        else if (!revisions[i][0] && entry)
+        {
+            // Offline or not a GitHub URL: stay on the locked revision
+            snprintf(revisions[i], REVISION_SIZE, "%s", entry->revision);
+        }
+
+        pin_url(tracking[i], revisions[i], pinned[i], sizeof(pinned[i]));
+        jobs[i].url = pinned[i];
+
+        if (sha256_file_hex(jobs[i].output_path, local[i]) != 0)
+            local[i][0] = '\0';
+
+        int intact = entry && local[i][0] && strcmp(local[i], entry->sha256) == 0;
+
+        // A pinned revision that hasn't moved can't have changed content
+        if (intact && (frozen || (revisions[i][0] && strcmp(revisions[i], entry->revision) == 0)))
+        {
+            jobs[i].result = 0;
+            jobs[i].status = 304;
+            unchanged++;
+            continue;
+        }
+
+        // The local copy is what the lock describes, so the server only
+        // needs to send a body if the content actually changed
+        if (intact && entry->etag[0])
+            jobs[i].etag = entry->etag;
+
+        if (!jobs[i].etag && use_cache && cache_fetch(jobs[i].url, jobs[i].output_path, jobs[i].sha256) == 0)
+        {
+            jobs[i].result = 0;
+            jobs[i].status = 200;
+            if (entry && strcmp(jobs[i].sha256, entry->sha256) == 0)
+                snprintf(jobs[i].response_etag, sizeof(jobs[i].response_etag), "%s", entry->etag);
+            hits++;
+            continue;
+        }
+
+        pending[pending_count] = jobs[i];
+        pending_index[pending_count++] = i;
+    }
+
+    if (unchanged > 0)
+        printf("%d of %d files unchanged\n", unchanged, count);
+
+    if (hits > 0)
+        printf("%d of %d files served from the local cache\n", hits, count);
+
+    int batch_failed = download_batch(pending, pending_count, DOWNLOAD_MAX_PARALLEL);
+    for (int i = 0; i < pending_count; i++)
+    {
+        DownloadJob *job = &jobs[pending_index[i]];
+        job->result = batch_failed < 0 ? -1 : pending[i].result;
+        job->status = pending[i].status;
+        job->error = pending[i].error;
+        memcpy(job->response_etag, pending[i].response_etag, sizeof(job->response_etag));
+        memcpy(job->sha256, pending[i].sha256, sizeof(job->sha256));
+
+        if (job->result == 0 && job->status == 304)
+        {
+            // Same content under a new revision
+            memcpy(job->sha256, local[pending_index[i]], SHA256_HEX_SIZE);
+            snprintf(job->response_etag, sizeof(job->response_etag), "%s", pending[i].etag);
+        }
+        else if (job->result == 0)
+        {
+            cache_store(job->url, job->output_path);
+        }
+    }
+
+    // Only bodies downloaded for want of a cached copy are misses, not
+    // revalidations answered with 304
+    int misses = 0;
+    for (int i = 0; use_cache && i < pending_count; i++)
+    {
+        if (jobs[pending_index[i]].result == 0 && jobs[pending_index[i]].status == 200)
+            misses++;
+    }
+    cache_record(hits, misses);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (jobs[i].result != 0)
+            continue;
+
+        LockEntry *entry = lock_find(&lock, keys[i]);
+
+        if (frozen)
+        {
+            if (jobs[i].status != 304 && strcmp(jobs[i].sha256, entry->sha256) != 0)
+            {
+                printf("Checksum mismatch for %s, expected %s\n", keys[i], entry->sha256);
+                remove(jobs[i].output_path);
+                jobs[i].result = -1;
+            }
+            continue;
+        }
+
+        if (jobs[i].status == 304 && entry)
+        {
+            lock_set(&lock, keys[i], tracking[i], revisions[i], NULL, NULL);
+            continue;
+        }
+
+        lock_set(&lock, keys[i], tracking[i], revisions[i], jobs[i].response_etag, jobs[i].sha256);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (jobs[i].result != 0)
+            failed++;
+
+        // Hand the upstream URL back to the caller
+        jobs[i].url = tracking[i];
+        jobs[i].etag = NULL;
+    }
+
+    if (!frozen && lock_save(&lock, LOCK_FILE) != 0)
+        printf("Warning: Could not write %s\n", LOCK_FILE);
+
+    free(tracking);
+    free(revisions);
+    free(pinned);
+    free(local);
+    free(keys);
+    free(pending);
+    free(pending_index);
+    lock_free(&lock);
+    return failed;
+}
+
+// Whether plugin is a vendored source, as opposed to a CMake-only
+// integration
+static int is_vendor_plugin(const Plugin *plugin)
+{
+    return plugin->c_url != NULL;
+}
+
+static void vendor_sources_line(StringBuilder *sb, const char *name)
+{
+    sb->size = 0;
+    sb->data[0] = '\0';
+    sb_append(sb, "target_sources(" VENDORS_TARGET " PRIVATE vendors/");
+    sb_append(sb, name);
+    sb_append(sb, ".c)\n");
+}
+
+// Compile options of the SQLite amalgamation per `install sqlite
+// --profile`, from SQLite's recommended options. THREADSAFE=2 drops the
+// per-connection mutexes but keeps the global ones: the event loop uses
+// a connection from one thread at a time, which is all it requires,
+// while 0 would break handlers that hand work to other threads.
+typedef struct
+{
+    const char *name;
+    const char *definitions; // NULL for SQLite's own defaults
+} SqliteProfile;
+
+#define SQLITE_FAST_DEFINITIONS            \
+    "    SQLITE_DEFAULT_MEMSTATUS=0\n"      \
+    "    SQLITE_THREADSAFE=2\n"             \
+    "    SQLITE_DEFAULT_WAL_SYNCHRONOUS=1\n" \
+    "    SQLITE_DQS=0\n"                    \
+    "    SQLITE_LIKE_DOESNT_MATCH_BLOBS\n"  \
+    "    SQLITE_MAX_EXPR_DEPTH=0\n"         \
+    "    SQLITE_OMIT_DEPRECATED\n"          \
+    "    SQLITE_OMIT_SHARED_CACHE\n"        \
+    "    SQLITE_USE_ALLOCA\n"
+
+static const SqliteProfile sqlite_profiles[] = {
+    {"default", NULL},
+    {"fast", SQLITE_FAST_DEFINITIONS},
+    {"minimal", SQLITE_FAST_DEFINITIONS
+     "    SQLITE_OMIT_DECLTYPE\n"
+     "    SQLITE_OMIT_PROGRESS_CALLBACK\n"
+     "    SQLITE_OMIT_LOAD_EXTENSION\n"},
+};
+
+static const SqliteProfile *find_sqlite_profile(const char *name)
+{
+    for (size_t i = 0; i < sizeof(sqlite_profiles) / sizeof(sqlite_profiles[0]); i++)
+    {
+        if (strcmp(sqlite_profiles[i].name, name) == 0)
+            return &sqlite_profiles[i];
+    }
+    return NULL;
+}
+
+// Block of a vendor: its source, the registry's CMake lines for it, and
+// for SQLite the options of profile. The profile name is kept in an
+// indented comment, a "# " line in the first column would start a block
+// of its own.
+static void vendor_block(StringBuilder *sb, const Plugin *plugin, const char *exec_name, const SqliteProfile *profile)
+{
+    vendor_sources_line(sb, plugin->name);
+    registry_cmake_lines(plugin, exec_name, plugin->version, sb);
+
+    if (strcmp(plugin->name, "SQLite3") != 0 || !profile || !profile->definitions)
+        return;
+
+    // Only the amalgamation gets the options, the vendors library is
+    // created in vendors/ and CMake 3.18 is needed to reach its sources
+    // from here. Older versions apply them to the whole library.
+    sb_append(sb, "set(ECEWO_SQLITE_DEFINITIONS\n");
+    sb_append(sb, "    # ecewo install sqlite --profile ");
+    sb_append(sb, profile->name);
+    sb_append(sb, "\n");
+    sb_append(sb, profile->definitions);
+    sb_append(sb, ")\n");
+    sb_append(sb, "if(CMAKE_VERSION VERSION_LESS 3.18)\n");
+    sb_append(sb, "    target_compile_definitions(" VENDORS_TARGET " PRIVATE ${ECEWO_SQLITE_DEFINITIONS})\n");
+    sb_append(sb, "else()\n");
+    sb_append(sb, "    set_property(SOURCE vendors/");
+    sb_append(sb, plugin->name);
+    sb_append(sb, ".c TARGET_DIRECTORY " VENDORS_TARGET "\n");
+    sb_append(sb, "                 APPEND PROPERTY COMPILE_DEFINITIONS ${ECEWO_SQLITE_DEFINITIONS})\n");
+    sb_append(sb, "endif()\n");
+}
+
+// CMake side of build --unity, inert until configured with ECEWO_UNITY=ON.
+// It has to come after the vendors library block to see the target;
+// setting properties of sources in another directory needs CMake 3.18.
+static int append_unity_block(CMakeFile *cmake, const char *exec_name, StringBuilder *sb)
+{
+    sb->size = 0;
+    sb->data[0] = '\0';
+    sb_append(sb, "if(ECEWO_UNITY)\n");
+    sb_append(sb, "    file(STRINGS ${CMAKE_CURRENT_SOURCE_DIR}/" UNITY_EXCLUDE_FILE " ECEWO_UNITY_EXCLUDE REGEX \"^[^# ]\")\n");
+    sb_append(sb, "    set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS " UNITY_EXCLUDE_FILE ")\n");
+    sb_append(sb, "    set_target_properties(");
+    sb_append(sb, exec_name);
+    sb_append(sb, " PROPERTIES UNITY_BUILD ON UNITY_BUILD_BATCH_SIZE ${ECEWO_UNITY_BATCH_SIZE})\n");
+    sb_append(sb, "    if(ECEWO_UNITY_EXCLUDE)\n");
+    sb_append(sb, "        set_source_files_properties(${ECEWO_UNITY_EXCLUDE} PROPERTIES SKIP_UNITY_BUILD_INCLUSION ON)\n");
+    sb_append(sb, "    endif()\n");
+    sb_append(sb, "    if(TARGET " VENDORS_TARGET " AND NOT CMAKE_VERSION VERSION_LESS 3.18)\n");
+    sb_append(sb, "        set_target_properties(" VENDORS_TARGET " PROPERTIES UNITY_BUILD ON UNITY_BUILD_BATCH_SIZE ${ECEWO_UNITY_BATCH_SIZE})\n");
+    sb_append(sb, "        if(ECEWO_UNITY_EXCLUDE)\n");
+    sb_append(sb, "            set_source_files_properties(${ECEWO_UNITY_EXCLUDE} TARGET_DIRECTORY " VENDORS_TARGET "\n");
+    sb_append(sb, "                                        PROPERTIES SKIP_UNITY_BUILD_INCLUSION ON)\n");
+    sb_append(sb, "        endif()\n");
+    sb_append(sb, "    endif()\n");
+    sb_append(sb, "endif()\n");
+    return cmake_append_block(cmake, UNITY_BLOCK, sb->data);
+}
 
-static int install_vendor(const char *plugin_name, const char *c_url, const char *h_url)
+// Set up the vendors library: vendors/CMakeLists.txt and the block that
+// adds it and links it into the executable. A project whose vendors were
+// compiled as part of the executable is moved over, its vendor blocks
+// rewritten after the library block.
+static int ensure_vendors_library(CMakeFile *cmake, const char *exec_name, StringBuilder *sb)
 {
-    if (!plugin_name || !c_url || !h_url)
+    if (!file_exists(VENDORS_CMAKE_FILE))
+    {
+        const char *content =
+            "# Written by ecewo. Vendored sources build into this library with\n"
+            "# options of their own, so edits to the application and changes to\n"
+            "# its target options never recompile them. ecewo install adds the\n"
+            "# sources from the project's CMakeLists.txt.\n"
+            "add_library(" VENDORS_TARGET " STATIC)\n"
+            "target_include_directories(" VENDORS_TARGET " PUBLIC ${CMAKE_CURRENT_SOURCE_DIR})\n"
+            "set_target_properties(" VENDORS_TARGET " PROPERTIES C_STANDARD 99 C_EXTENSIONS ON)\n"
+            "\n"
+            "# Third-party code, its warnings are not ours to fix\n"
+            "if(MSVC)\n"
+            "    target_compile_options(" VENDORS_TARGET " PRIVATE /w)\n"
+            "else()\n"
+            "    target_compile_options(" VENDORS_TARGET " PRIVATE -w)\n"
+            "endif()\n"
+            "\n"
+            "# Some vendors build against ecewo's headers\n"
+            "if(TARGET ecewo)\n"
+            "    target_link_libraries(" VENDORS_TARGET " PUBLIC ecewo)\n"
+            "endif()\n";
+
+        if (write_file(VENDORS_CMAKE_FILE, content) != 0)
+        {
+            printf("Error: Could not write %s\n", VENDORS_CMAKE_FILE);
+            return -1;
+        }
+    }
+
+    if (cmake_has_block(cmake, VENDORS_LIBRARY_BLOCK))
+        return 0;
+
+    cmake_remove_block(cmake, VENDORS_INCLUDE_BLOCK, NULL);
+
+    // Include directories the application gets elsewhere, PostgreSQL's
+    // for pquv, apply to the vendors too
+    sb->size = 0;
+    sb->data[0] = '\0';
+    sb_append(sb, "add_subdirectory(vendors ${CMAKE_BINARY_DIR}/" VENDORS_BINARY_DIR ")\n");
+    sb_append(sb, "target_include_directories(" VENDORS_TARGET " PRIVATE $<TARGET_PROPERTY:");
+    sb_append(sb, exec_name);
+    sb_append(sb, ",INCLUDE_DIRECTORIES>)\n");
+    sb_append(sb, "target_link_libraries(");
+    sb_append(sb, exec_name);
+    sb_append(sb, " PRIVATE " VENDORS_TARGET ")\n");
+    if (cmake_append_block(cmake, VENDORS_LIBRARY_BLOCK, sb->data) != 0)
+        return -1;
+
+    if (cmake_remove_block(cmake, UNITY_BLOCK, NULL) && append_unity_block(cmake, exec_name, sb) != 0)
         return -1;
 
+    for (int i = 0; i < plugin_count; i++)
+    {
+        if (!is_vendor_plugin(&plugins[i]) || !cmake_has_block(cmake, plugins[i].name))
+            continue;
+
+        printf("Moving %s into the vendors library\n", plugins[i].name);
+        cmake_remove_block(cmake, plugins[i].name, NULL);
+        vendor_block(sb, &plugins[i], exec_name, NULL);
+        if (cmake_append_block(cmake, plugins[i].name, sb->data) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// Name a git dependency is locked under: the repository's, so
+// https://github.com/intel/tinycbor.git becomes git:tinycbor
+static void git_lock_name(const char *git_url, char *name, size_t name_size)
+{
+    const char *base = strrchr(git_url, '/');
+    base = base ? base + 1 : git_url;
+
+    size_t len = strlen(base);
+    if (len > 4 && strcmp(base + len - 4, ".git") == 0)
+        len -= 4;
+
+    snprintf(name, name_size, "%.*s", (int)len, base);
+}
+
+// Fetch the files of every library in plan that is to be vendored
+// (state 1) in one batch. A library with a file that failed or doesn't
+// match the registry's hash gets state -1.
+static int fetch_plan_files(Plugin **plan, int *state, int count, int use_cache)
+{
     const char *target_dir = "vendors";
 
-    printf("Installing %s...\n", plugin_name);
+    int job_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (state[i] == 1 && is_vendor_plugin(plan[i]))
+            job_count += 2;
+    }
+
+    if (job_count == 0)
+        return 0;
 
     if (create_directory(target_dir) != 0)
     {
@@ -35,134 +552,314 @@ static int install_vendor(const char *plugin_name, const char *c_url, const char
         return -1;
     }
 
-    // Calculate path sizes
-    size_t path_size = strlen("vendors") + strlen(PATH_SEPARATOR) + strlen(plugin_name) + strlen(".c") + 1;
-    char *c_path = malloc(path_size);
-    char *h_path = malloc(path_size);
+    char **paths = calloc(job_count, sizeof(char *));
+    DownloadJob *jobs = calloc(job_count, sizeof(DownloadJob));
+    int *owner = calloc(job_count, sizeof(int));
 
-    if (!c_path || !h_path)
+    if (!paths || !jobs || !owner)
     {
-
-        if (c_path)
-            free(c_path);
-        if (h_path)
-            free(h_path);
+        free(paths);
+        free(jobs);
+        free(owner);
         return -1;
     }
 
-    build_vendor_path(c_path, path_size, plugin_name, "c");
-    build_vendor_path(h_path, path_size, plugin_name, "h");
-
-    if (download_file(c_url, c_path) != 0)
+    int j = 0;
+    for (int i = 0; i < count; i++)
     {
-        printf("Failed to download %s.c\n", plugin_name);
+        if (state[i] != 1 || !is_vendor_plugin(plan[i]))
+            continue;
+
+        // Calculate path sizes
+        size_t path_size = strlen("vendors") + strlen(PATH_SEPARATOR) + strlen(plan[i]->name) + strlen(".c") + 1;
+        paths[j] = malloc(path_size);
+        paths[j + 1] = malloc(path_size);
+
+        if (!paths[j] || !paths[j + 1])
+        {
+            free_paths(paths, job_count);
+            free(jobs);
+            free(owner);
+            return -1;
+        }
+
+        build_vendor_path(paths[j], path_size, plan[i]->name, "c");
+        build_vendor_path(paths[j + 1], path_size, plan[i]->name, "h");
+
+        jobs[j].url = plan[i]->c_url;
+        jobs[j].output_path = paths[j];
+        jobs[j].size_hint = plan[i]->c_size;
+        jobs[j + 1].url = plan[i]->h_url;
+        jobs[j + 1].output_path = paths[j + 1];
+        jobs[j + 1].size_hint = plan[i]->h_size;
 
-        free(c_path);
-        free(h_path);
+        owner[j] = owner[j + 1] = i;
+        j += 2;
+    }
+
+    if (fetch_vendor_files(jobs, job_count, use_cache, 0) < 0)
+    {
+        free_paths(paths, job_count);
+        free(jobs);
+        free(owner);
         return -1;
     }
 
-    if (download_file(h_url, h_path) != 0)
+    int downloaded = 0;
+    for (j = 0; j < job_count; j++)
     {
-        printf("Failed to download %s.h\n", plugin_name);
+        const Plugin *plugin = plan[owner[j]];
+        const char *expected = j % 2 ? plugin->h_sha256 : plugin->c_sha256;
 
-        free(c_path);
-        free(h_path);
-        return -1;
+        if (jobs[j].result == 0 && expected[0])
+        {
+            char actual[SHA256_HEX_SIZE];
+            if (sha256_file_hex(jobs[j].output_path, actual) != 0 || strcmp(actual, expected) != 0)
+            {
+                printf("Checksum mismatch for %s, expected %s\n", jobs[j].output_path, expected);
+                remove(jobs[j].output_path);
+
+                char key[512];
+                lock_key(jobs[j].output_path, key, sizeof(key));
+                lock_forget(key);
+
+                state[owner[j]] = -1;
+                continue;
+            }
+        }
+
+        if (jobs[j].result == 0)
+        {
+            downloaded++;
+            continue;
+        }
+
+        if (jobs[j].error == HTTP_ERR_STATUS)
+            printf("Failed to download %s: HTTP %d\n", jobs[j].output_path, jobs[j].status);
+        else if (jobs[j].error != HTTP_OK)
+            printf("Failed to download %s: %s\n", jobs[j].output_path, http_strerror(jobs[j].error));
+        else
+            printf("Failed to download %s\n", jobs[j].output_path);
+
+        state[owner[j]] = -1;
     }
 
-    printf("Files downloaded to %s\n", target_dir);
+    if (downloaded > 0)
+        printf("Files downloaded to %s\n", target_dir);
 
-    // Update CMakeLists.txt
-    char *cmake_content = read_file("CMakeLists.txt");
-    if (!cmake_content)
+    free_paths(paths, job_count);
+    free(jobs);
+    free(owner);
+    return 0;
+}
+
+// The first requirement of plugin that failed to install, or NULL
+static const char *failed_requirement(Plugin **plan, const int *state, int count, const Plugin *plugin)
+{
+    for (int r = 0; r < plugin->require_count; r++)
     {
-        printf("Warning: CMakeLists.txt not found, skipping CMake update.\n");
+        const Plugin *required = registry_find(plugin->requires[r]);
+        for (int i = 0; i < count; i++)
+        {
+            if (plan[i] == required && state[i] < 0)
+                return required->name;
+        }
+    }
+    return NULL;
+}
 
-        free(c_path);
-        free(h_path);
+// Install the libraries of plan, which lists every library after the
+// ones it requires. Files to vendor are fetched in one batch and git
+// dependencies pinned up front, then the CMakeLists.txt edits are made
+// in plan order and written once. A SQLite already in CMakeLists.txt
+// gets its options replaced when a profile is given. CMakeLists.txt is
+// only locked around its edits, not while files download.
+static int install_plugins(Plugin **plan, int count, int use_cache, const SqliteProfile *sqlite_profile)
+{
+    if (count <= 0)
         return 0;
+
+    CMakeFile *cmake = cmake_open("CMakeLists.txt");
+    if (!cmake && file_exists("CMakeLists.txt"))
+        return -1;
+
+    // Per library: 1 to install, 0 already installed, -1 failed
+    int *state = calloc(count, sizeof(int));
+    char (*revisions)[REVISION_SIZE] = calloc(count, REVISION_SIZE);
+    StringBuilder *sb = sb_create();
+
+    if (!state || !revisions || !sb)
+    {
+        free(state);
+        free(revisions);
+        if (sb)
+            sb_free(sb);
+        cmake_close(cmake);
+        return -1;
     }
 
-    // Check if this vendor is already in CMake
-    if (contains_string(cmake_content, plugin_name))
+    for (int i = 0; i < count; i++)
     {
-        printf("%s is already in CMakeLists.txt\n", plugin_name);
-        free(cmake_content);
+        const Plugin *plugin = plan[i];
+        int reprofile = sqlite_profile && strcmp(plugin->name, "SQLite3") == 0;
 
-        free(c_path);
-        free(h_path);
-        return 0;
+        if (cmake_has_block(cmake, plugin->name) && !reprofile)
+        {
+            printf("%s is already in CMakeLists.txt\n", plugin->name);
+            continue;
+        }
+
+        if (!cmake && !is_vendor_plugin(plugin))
+        {
+            printf("Error: CMakeLists.txt not found, %s can't be installed\n", plugin->name);
+            state[i] = -1;
+            continue;
+        }
+
+        printf("Installing %s...\n", plugin->name);
+        state[i] = 1;
     }
 
-    // Get executable name dynamically
-    char *exec_name = get_exec_name();
-    if (!exec_name)
+    int have_cmake = cmake != NULL;
+    cmake_close(cmake);
+    cmake = NULL;
+
+    int result = fetch_plan_files(plan, state, count, use_cache);
+
+    // Pin git dependencies to the commit their version points at right now
+    for (int i = 0; i < count; i++)
     {
-        printf("Error: Could not determine executable name from CMakeLists.txt\n");
-        free(cmake_content);
+        if (state[i] != 1 || !plan[i]->git_url)
+            continue;
 
-        free(c_path);
-        free(h_path);
-        return -1;
+        if (resolve_git_revision(plan[i]->git_url, plan[i]->version, revisions[i], REVISION_SIZE) != 0)
+        {
+            printf("Warning: Could not resolve %s revision, tracking %s\n", plan[i]->name, plan[i]->version);
+            revisions[i][0] = '\0';
+        }
     }
 
-    StringBuilder *sb = sb_create();
-    if (!sb)
+    if (have_cmake)
     {
-        free(cmake_content);
-        free(exec_name);
+        cmake = cmake_open("CMakeLists.txt");
+        if (!cmake)
+            result = -1;
+    }
 
-        free(c_path);
-        free(h_path);
-        return -1;
+    const char *exec_name = cmake ? cmake_exec_name(cmake) : NULL;
+    if (cmake && !exec_name)
+    {
+        printf("Error: Could not determine executable name from CMakeLists.txt\n");
+        result = -1;
     }
 
-    sb_append(sb, cmake_content);
+    for (int i = 0; i < count && result == 0; i++)
+    {
+        Plugin *plugin = plan[i];
+        if (state[i] != 1)
+            continue;
+
+        const char *missing = failed_requirement(plan, state, count, plugin);
+        if (missing)
+        {
+            printf("Skipping %s, %s could not be installed\n", plugin->name, missing);
+            state[i] = -1;
+            continue;
+        }
+
+        if (!cmake)
+            continue;
+
+        // Added by another ecewo while the files were downloading
+        if (cmake_has_block(cmake, plugin->name) && !(sqlite_profile && strcmp(plugin->name, "SQLite3") == 0))
+        {
+            printf("%s is already in CMakeLists.txt\n", plugin->name);
+            state[i] = 0;
+            continue;
+        }
+
+        int edit_result = 0;
+        if (is_vendor_plugin(plugin))
+        {
+            // Vendors build into their own library, set up with the first one
+            edit_result = ensure_vendors_library(cmake, exec_name, sb);
+
+            // Only there when SQLite gets a new profile
+            cmake_remove_block(cmake, plugin->name, NULL);
+            vendor_block(sb, plugin, exec_name, sqlite_profile);
+        }
+        else
+        {
+            sb->size = 0;
+            sb->data[0] = '\0';
+            registry_cmake_lines(plugin, exec_name, revisions[i][0] ? revisions[i] : plugin->version, sb);
+        }
+
+        if (edit_result == 0)
+            edit_result = cmake_append_block(cmake, plugin->name, sb->data);
+
+        if (edit_result != 0)
+        {
+            printf("Error updating CMakeLists.txt\n");
+            result = -1;
+        }
+        else if (sqlite_profile && strcmp(plugin->name, "SQLite3") == 0)
+        {
+            printf("SQLite3 uses the %s profile\n", sqlite_profile->name);
+        }
+    }
 
-    // Check if vendors include directory already exists
-    if (!contains_string(cmake_content, "target_include_directories") ||
-        !contains_string(cmake_content, "vendors"))
+    if (!have_cmake)
+        printf("Warning: CMakeLists.txt not found, skipping CMake update.\n");
+    else if (result == 0 && cmake_commit(cmake) != 0)
     {
-        // Add vendors include directory (only once)
-        sb_append(sb, "\n# Vendors include directory\n");
-        sb_append(sb, "target_include_directories(");
-        sb_append(sb, exec_name);
-        sb_append(sb, " PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/vendors)\n");
+        printf("Error writing CMakeLists.txt\n");
+        result = -1;
     }
 
-    // Add vendor-specific source file
-    sb_append(sb, "\n# ");
-    sb_append(sb, plugin_name);
-    sb_append(sb, "\n");
-    sb_append(sb, "target_sources(");
-    sb_append(sb, exec_name);
-    sb_append(sb, " PRIVATE vendors/");
-    sb_append(sb, plugin_name);
-    sb_append(sb, ".c)\n");
+    int failed = result != 0;
+    for (int i = 0; i < count && result == 0; i++)
+    {
+        if (state[i] < 0)
+            failed = 1;
+        if (state[i] != 1)
+            continue;
 
-    // Write updated file
-    int write_result = write_file("CMakeLists.txt", sb->data);
+        if (plan[i]->git_url && revisions[i][0])
+        {
+            char name[256];
+            git_lock_name(plan[i]->git_url, name, sizeof(name));
+            lock_record_git(name, plan[i]->git_url, revisions[i]);
+        }
 
-    // Cleanup
-    free(cmake_content);
-    free(exec_name);
+        if (cmake)
+            printf("%s installed and added to CMakeLists.txt successfully!\n", plan[i]->name);
+    }
 
-    free(c_path);
-    free(h_path);
     sb_free(sb);
+    free(state);
+    free(revisions);
+    cmake_close(cmake);
+    return failed ? -1 : 0;
+}
 
-    if (write_result != 0)
-    {
-        printf("Error updating CMakeLists.txt\n");
+// Install every selected library along with the ones they require
+static int install_selected_plugins(int use_cache, const SqliteProfile *sqlite_profile)
+{
+    Plugin **plan = malloc(sizeof(Plugin *) * (plugin_count > 0 ? plugin_count : 1));
+    if (!plan)
         return -1;
-    }
 
-    printf("%s installed and added to CMakeLists.txt successfully!\n", plugin_name);
-    return 0;
+    int count = registry_plan(plan);
+    int result = count < 0 ? -1 : install_plugins(plan, count, use_cache, sqlite_profile);
+    if (result != 0)
+        fprintf(stderr, "Error installing one or more plugins\n");
+
+    free(plan);
+    return result;
 }
 
-static int uninstall_vendor(const char *plugin_name)
+static int uninstall_vendor(CMakeFile *cmake, const char *plugin_name)
 {
     if (!plugin_name)
         return -1;
@@ -214,58 +911,254 @@ static int uninstall_vendor(const char *plugin_name)
         }
     }
 
-    // Remove from CMakeLists.txt (only the source file, keep include directory)
-    char *cmake_content = read_file("CMakeLists.txt");
-    if (cmake_content)
+    // Remove from CMakeLists.txt, and the vendors library with the last one
+    cmake_remove_block(cmake, plugin_name, NULL);
+
+    int vendors_left = 0;
+    for (int i = 0; i < plugin_count; i++)
     {
-        char *result = malloc(strlen(cmake_content) + 1);
-        if (result)
-        {
-            strcpy(result, cmake_content);
+        if (is_vendor_plugin(&plugins[i]) && cmake_has_block(cmake, plugins[i].name))
+            vendors_left++;
+    }
+    if (!vendors_left && cmake_remove_block(cmake, VENDORS_LIBRARY_BLOCK, NULL))
+        printf("Removed the vendors library from CMakeLists.txt\n");
 
-            // Remove only the plugin-specific support block
-            size_t comment_size = strlen("# ") + strlen(plugin_name) + strlen("\n") + 1;
-            char *comment_start = malloc(comment_size);
-            if (comment_start)
-            {
-                snprintf(comment_start, comment_size, "# %s\n", plugin_name);
-                char *block_start = strstr(result, comment_start);
+    // Forget the files in ecewo.lock
+    char key[512];
+    lock_key(c_path, key, sizeof(key));
+    lock_forget(key);
+    lock_key(h_path, key, sizeof(key));
+    lock_forget(key);
 
-                if (block_start)
-                {
-                    // Find end of this plugin's block (next comment or end of file)
-                    char *block_end = strstr(block_start + strlen(comment_start), "\n# ");
-                    if (!block_end)
-                    {
-                        // If no next comment, go to end of file
-                        block_end = result + strlen(result);
-                    }
+    free(c_path);
+    free(h_path);
 
-                    memmove(block_start, block_end, strlen(block_end) + 1);
-                }
+    printf("%s uninstalled successfully. %d files removed.\n", plugin_name, removed_any);
+    return 0;
+}
 
-                // Clean up extra newlines
-                char *triple_newline;
-                while ((triple_newline = strstr(result, "\n\n\n")) != NULL)
-                {
-                    memmove(triple_newline, triple_newline + 1, strlen(triple_newline));
-                }
+// Remove a library from CMakeLists.txt. For one that is only CMake lines
+// the block goes up to the last line the registry gives it, anything
+// added below that line stays.
+static int uninstall_plugin(CMakeFile *cmake, const Plugin *plugin)
+{
+    if (is_vendor_plugin(plugin))
+        return uninstall_vendor(cmake, plugin->name);
 
-                write_file("CMakeLists.txt", result);
-                free(comment_start);
-            }
-            free(result);
+    printf("Uninstalling %s...\n", plugin->name);
+
+    if (!cmake)
+    {
+        printf("Error: CMakeLists.txt not found.\n");
+        return -1;
+    }
+
+    if (!cmake_has_block(cmake, plugin->name))
+    {
+        printf("%s is not installed.\n", plugin->name);
+        return 0;
+    }
+
+    StringBuilder *sb = sb_create();
+    if (!sb)
+        return -1;
+
+    const char *exec_name = cmake_exec_name(cmake);
+    if (exec_name)
+        registry_cmake_lines(plugin, exec_name, plugin->version, sb);
+
+    const char *end_line = NULL;
+    for (size_t i = 0; i + 1 < sb->size; i++)
+    {
+        if (sb->data[i] == '\n')
+            end_line = sb->data + i + 1;
+    }
+    if (sb->size > 0 && !end_line)
+        end_line = sb->data;
+
+    // A last line that was edited by hand, or holds the pinned revision
+    if (!end_line || !cmake_remove_block(cmake, plugin->name, end_line))
+        cmake_remove_block(cmake, plugin->name, NULL);
+    sb_free(sb);
+
+    if (plugin->git_url)
+    {
+        char name[256];
+        char key[300];
+        git_lock_name(plugin->git_url, name, sizeof(name));
+        snprintf(key, sizeof(key), "git:%s", name);
+        lock_forget(key);
+    }
+
+    printf("%s uninstalled successfully!\n", plugin->name);
+    return 0;
+}
+
+// Point out installed libraries that lost something they require
+static void check_requirements(const CMakeFile *cmake)
+{
+    for (int i = 0; i < plugin_count; i++)
+    {
+        if (!cmake_has_block(cmake, plugins[i].name))
+            continue;
+
+        for (int r = 0; r < plugins[i].require_count; r++)
+        {
+            const Plugin *required = registry_find(plugins[i].requires[r]);
+            if (!cmake_has_block(cmake, required->name))
+                printf("Warning: %s requires %s, which is not installed\n", plugins[i].name, required->name);
         }
-        free(cmake_content);
     }
+}
 
-    free(c_path);
-    free(h_path);
+// Bring vendors/ in line with ecewo.lock. By default every locked file is
+// revalidated against upstream and the lock is updated; with frozen set
+// the exact locked revisions are restored and verified.
+static int sync_project(int use_cache, int frozen)
+{
+    if (!file_exists(LOCK_FILE))
+    {
+        printf("No %s found in the current directory\n", LOCK_FILE);
+        return -1;
+    }
 
-    printf("%s uninstalled successfully. %d files removed.\n", plugin_name, removed_any);
+    Lockfile lock;
+    lock_load(&lock, LOCK_FILE);
+
+    DownloadJob *jobs = calloc(lock.count ? lock.count : 1, sizeof(DownloadJob));
+    char **urls = calloc(lock.count ? lock.count : 1, sizeof(char *));
+    char **paths = calloc(lock.count ? lock.count : 1, sizeof(char *));
+    if (!jobs || !urls || !paths)
+    {
+        free(jobs);
+        free(urls);
+        free(paths);
+        lock_free(&lock);
+        return -1;
+    }
+
+    int slots = lock.count;
+    int count = 0;
+    for (int i = 0; i < lock.count; i++)
+    {
+        LockEntry *entry = &lock.entries[i];
+        if (strncmp(entry->name, "vendors/", strlen("vendors/")) != 0)
+            continue;
+
+        size_t url_size = strlen(entry->url) + 1;
+        size_t path_size = strlen(entry->name) + 1;
+        urls[count] = malloc(url_size);
+        paths[count] = malloc(path_size);
+        if (!urls[count] || !paths[count])
+            break;
+
+        memcpy(urls[count], entry->url, url_size);
+        snprintf(paths[count], path_size, "vendors%s%s", PATH_SEPARATOR, entry->name + strlen("vendors/"));
+
+        struct stat st;
+        jobs[count].url = urls[count];
+        jobs[count].output_path = paths[count];
+        jobs[count].size_hint = stat(paths[count], &st) == 0 ? (size_t)st.st_size : 0;
+        count++;
+    }
+    lock_free(&lock);
+
+    int failed = -1;
+    if (create_directory("vendors") == 0)
+        failed = fetch_vendor_files(jobs, count, use_cache, frozen);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (jobs[i].result == 0 && jobs[i].status == 200)
+            printf("Updated: %s\n", jobs[i].output_path);
+        else if (jobs[i].result != 0)
+            printf("Failed: %s\n", jobs[i].output_path);
+    }
+
+    for (int i = 0; i < slots; i++)
+    {
+        free(urls[i]);
+        free(paths[i]);
+    }
+    free(jobs);
+    free(urls);
+    free(paths);
+
+    if (failed != 0)
+    {
+        printf("Sync finished with errors\n");
+        return -1;
+    }
+
+    printf("Vendors are in sync with %s\n", LOCK_FILE);
     return 0;
 }
 
+// Value of -j/--jobs, 0 if it isn't a positive number
+static int parse_jobs(const char *value)
+{
+    char *end;
+    long jobs = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || jobs <= 0 || jobs > 4096)
+    {
+        printf("Invalid job count: %s\n", value);
+        return 0;
+    }
+    return (int)jobs;
+}
+
+// Value of --port, 0 if it isn't a valid port
+static int parse_port(const char *value)
+{
+    char *end;
+    long port = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || port <= 0 || port > 65535)
+    {
+        printf("Invalid port: %s\n", value);
+        return 0;
+    }
+    return (int)port;
+}
+
+// Value of --requests, 0 if it isn't a positive number
+static int parse_requests(const char *value)
+{
+    char *end;
+    long requests = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || requests <= 0 || requests > 10000000)
+    {
+        printf("Invalid request count: %s\n", value);
+        return 0;
+    }
+    return (int)requests;
+}
+
+// Positive number for a bench option, 0 if it isn't one
+static double parse_positive(const char *value, const char *what, double max)
+{
+    char *end;
+    double number = strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || !(number > 0) || number > max)
+    {
+        printf("Invalid %s: %s\n", what, value);
+        return 0;
+    }
+    return number;
+}
+
+// Value of --march, NULL if it doesn't look like a CPU name. It ends up
+// in a shell command, so only plain names are accepted.
+static const char *parse_march(const char *value)
+{
+    size_t len = strlen(value);
+    if (len == 0 || len >= MARCH_SIZE || strspn(value, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.+") != len)
+    {
+        printf("Invalid CPU name: %s\n", value);
+        return NULL;
+    }
+    return value;
+}
+
 static void parse_arguments(int argc, char *argv[], flags_t *flags)
 {
     memset(flags, 0, sizeof(flags_t));
@@ -274,7 +1167,16 @@ static void parse_arguments(int argc, char *argv[], flags_t *flags)
     {
         // Project
         if (strcmp(argv[i], "run") == 0)
+        {
             flags->run = 1;
+            if (i + 1 < argc && strcmp(argv[i + 1], "dev") == 0)
+                i++;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "prod") == 0)
+            {
+                flags->run_prod = 1;
+                i++;
+            }
+        }
         else if (strcmp(argv[i], "create") == 0)
             flags->create = 1;
         else if (strcmp(argv[i], "libs") == 0)
@@ -283,6 +1185,127 @@ static void parse_arguments(int argc, char *argv[], flags_t *flags)
             flags->install = 1;
         else if (strcmp(argv[i], "uninstall") == 0)
             flags->uninstall = 1;
+        else if (strcmp(argv[i], "--no-cache") == 0)
+            flags->no_cache = 1;
+        else if (strcmp(argv[i], "sync") == 0)
+            flags->sync = 1;
+        else if (strcmp(argv[i], "--frozen") == 0)
+            flags->frozen = 1;
+        else if (strcmp(argv[i], "--full") == 0)
+            flags->full = 1;
+        else if (strcmp(argv[i], "--timings") == 0)
+            flags->timings = 1;
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "auto") == 0)
+                flags->workers = -1;
+            else
+            {
+                flags->workers = (int)parse_positive(argv[i], "worker count", WORKERS_MAX);
+                if (flags->workers == 0)
+                    flags->workers = WORKERS_INVALID;
+            }
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            flags->sqlite_profile = argv[++i];
+        else if (strcmp(argv[i], "--restart") == 0)
+            flags->restart = 1;
+        else if (strcmp(argv[i], "--ready-check") == 0)
+            flags->ready_check = 1;
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            flags->warmup = argv[++i];
+        else if (strcmp(argv[i], "--watch") == 0)
+            flags->watch = 1;
+        else if (strcmp(argv[i], "--lto") == 0)
+            flags->lto = 1;
+        else if (strcmp(argv[i], "--no-plt") == 0)
+            flags->no_plt = 1;
+        else if (strcmp(argv[i], "--gc-sections") == 0)
+            flags->gc_sections = 1;
+        else if (strcmp(argv[i], "--optimize") == 0)
+            flags->optimize = 1;
+        else if (strcmp(argv[i], "--unity") == 0)
+            flags->unity = 1;
+        else if (strncmp(argv[i], "--unity=", 8) == 0)
+        {
+            flags->unity = 1;
+            flags->unity_batch = (int)parse_positive(argv[i] + 8, "unity batch size", UNITY_MAX_BATCH_SIZE);
+        }
+        else if (strcmp(argv[i], "--no-unity") == 0)
+            flags->unity = -1;
+        else if (strcmp(argv[i], "--march") == 0 && i + 1 < argc)
+            flags->march = parse_march(argv[++i]);
+        else if (strncmp(argv[i], "--march=", 8) == 0)
+            flags->march = parse_march(argv[i] + 8);
+        else if (strcmp(argv[i], "bench") == 0)
+        {
+            flags->bench = 1;
+            if (i + 1 < argc && strcmp(argv[i + 1], "dev") == 0)
+            {
+                flags->bench_dev = 1;
+                i++;
+            }
+            else if (i + 1 < argc && strcmp(argv[i + 1], "prod") == 0)
+                i++;
+        }
+        else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc)
+            flags->connections = (int)parse_positive(argv[++i], "connection count", 100000);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            flags->threads = (int)parse_positive(argv[++i], "thread count", 1024);
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+            flags->duration = (int)parse_positive(argv[++i], "duration", 86400);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+            flags->rate = parse_positive(argv[++i], "rate", 1e9);
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            flags->threshold = parse_positive(argv[++i], "threshold", 1000);
+        else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+            flags->path = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            flags->output = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+            flags->compare = argv[++i];
+        else if (strcmp(argv[i], "--layout") == 0)
+            flags->layout = 1;
+        else if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc)
+            flags->workload = argv[++i];
+        else if (strncmp(argv[i], "--workload=", 11) == 0)
+            flags->workload = argv[i] + 11;
+        else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc)
+            flags->requests = parse_requests(argv[++i]);
+        else if (strncmp(argv[i], "--requests=", 11) == 0)
+            flags->requests = parse_requests(argv[i] + 11);
+        else if (strcmp(argv[i], "--handoff") == 0)
+            flags->handoff = 1;
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+            flags->port = parse_port(argv[++i]);
+        else if (strncmp(argv[i], "--port=", 7) == 0)
+            flags->port = parse_port(argv[i] + 7);
+        else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0)
+        {
+            if (i + 1 < argc)
+                flags->jobs = parse_jobs(argv[++i]);
+            else
+                printf("Missing value for %s\n", argv[i]);
+        }
+        else if (strncmp(argv[i], "--jobs=", 7) == 0)
+            flags->jobs = parse_jobs(argv[i] + 7);
+        else if (strncmp(argv[i], "-j", 2) == 0)
+            flags->jobs = parse_jobs(argv[i] + 2);
+        else if (strcmp(argv[i], "cache") == 0)
+        {
+            flags->cache = 1;
+            if (i + 1 < argc && strcmp(argv[i + 1], "stats") == 0)
+            {
+                flags->cache_stats = 1;
+                i++;
+            }
+            else if (i + 1 < argc && strcmp(argv[i + 1], "prune") == 0)
+            {
+                flags->cache_prune = 1;
+                i++;
+            }
+        }
         else if (strcmp(argv[i], "build") == 0)
         {
             flags->build = 1;
@@ -298,6 +1321,11 @@ static void parse_arguments(int argc, char *argv[], flags_t *flags)
                     flags->build_prod = 1;
                     i++;
                 }
+                else if (strcmp(argv[i + 1], "pgo") == 0)
+                {
+                    flags->pgo = 1;
+                    i++;
+                }
                 else
                 {
                     flags->build_dev = 1;
@@ -335,29 +1363,15 @@ static void parse_arguments(int argc, char *argv[], flags_t *flags)
             }
         }
 
-        // Libraries
-        else if (strcmp(argv[i], "cjson") == 0)
-            flags->cjson = 1;
-        else if (strcmp(argv[i], "dotenv") == 0)
-            flags->dotenv = 1;
-        else if (strcmp(argv[i], "sqlite") == 0)
-            flags->sqlite = 1;
-        else if (strcmp(argv[i], "postgres") == 0)
-            flags->postgres = 1;
-        else if (strcmp(argv[i], "pquv") == 0)
-            flags->pquv = 1;
-        else if (strcmp(argv[i], "session") == 0)
-            flags->session = 1;
-        else if (strcmp(argv[i], "slugify") == 0)
-            flags->slugify = 1;
-        else if (strcmp(argv[i], "cbor") == 0)
-            flags->cbor = 1;
+        // Libraries, looked up in the plugin registry later
+        else if ((flags->install || flags->uninstall) && flags->library_count < MAX_LIBRARY_ARGS)
+            flags->libraries[flags->library_count++] = argv[i];
         else
             printf("Unknown argument: %s\n", argv[i]);
     }
 }
 
-static int create_project(void)
+static int create_project(int use_cache)
 {
     // Get project name from user
     size_t project_name_size = 256;
@@ -428,8 +1442,22 @@ static int create_project(void)
         return -1;
     }
 
+    // ECEWO_REPOSITORY points new projects at a mirror of ecewo
+    const char *ecewo_url = getenv("ECEWO_REPOSITORY");
+    if (!ecewo_url || !*ecewo_url)
+        ecewo_url = ECEWO_GIT_URL;
+
+    // Pin ecewo to the commit main points at right now
+    char ecewo_revision[REVISION_SIZE];
+    int pinned = resolve_git_revision(ecewo_url, "main", ecewo_revision, sizeof(ecewo_revision)) == 0;
+    if (!pinned)
+    {
+        printf("Warning: Could not resolve ecewo revision, tracking main\n");
+        snprintf(ecewo_revision, sizeof(ecewo_revision), "main");
+    }
+
     // Create CMakeLists.txt with project name
-    size_t cmake_size = 1024 + strlen(project_name) * 3; // 3 times for 3 occurrences
+    size_t cmake_size = 1024 + strlen(project_name) * 3 + strlen(ecewo_url); // 3 times for 3 occurrences
     char *cmake_content = malloc(cmake_size);
     if (!cmake_content)
     {
@@ -445,8 +1473,8 @@ static int create_project(void)
              "\n"
              "FetchContent_Declare(\n"
              "   ecewo\n"
-             "   GIT_REPOSITORY https://github.com/savashn/ecewo.git\n"
-             "   GIT_TAG main\n"
+             "   GIT_REPOSITORY %s\n"
+             "   GIT_TAG %s\n"
              ")\n"
              "\n"
              "FetchContent_MakeAvailable(ecewo)\n"
@@ -456,7 +1484,7 @@ static int create_project(void)
              ")\n"
              "\n"
              "target_link_libraries(%s PRIVATE ecewo)\n",
-             project_name, project_name, project_name);
+             project_name, ecewo_url, ecewo_revision, project_name, project_name);
 
     if (write_file("CMakeLists.txt", cmake_content) != 0)
     {
@@ -466,257 +1494,1922 @@ static int create_project(void)
         return -1;
     }
 
+    if (pinned)
+        lock_record_git("ecewo", ecewo_url, ecewo_revision);
+
     // Install selected plugins
-    for (int i = 0; i < plugin_count; i++)
+    install_selected_plugins(use_cache, NULL);
+
+    printf("Starter project created successfully.\n");
+    printf("Project '%s' created successfully!\n", project_name);
+    printf("To build and run your project:\n");
+    printf("ecewo run\n");
+
+    free(project_name);
+    free(cmake_content);
+    return 0;
+}
+
+// Print and return the number of parallel compile jobs for this build
+static int plan_build_jobs(int requested)
+{
+    if (requested > 0)
+    {
+        printf("Jobs: %d (from --jobs)\n", requested);
+        return requested;
+    }
+
+    // The SQLite amalgamation needs far more memory than anything else
+    char sqlite_path[64];
+    build_vendor_path(sqlite_path, sizeof(sqlite_path), "SQLite3", "c");
+    int heavy = file_exists(sqlite_path);
+
+    int cpus = detect_cpu_count();
+    long long memory_mb = detect_available_memory_mb();
+    int jobs = choose_build_jobs(cpus, memory_mb, heavy);
+
+    if (memory_mb >= 0)
+        printf("Jobs: %d (%d CPUs, %.1f GB available%s)\n",
+               jobs, cpus, memory_mb / 1024.0, heavy ? ", SQLite3 vendored" : "");
+    else
+        printf("Jobs: %d (%d CPUs)\n", jobs, cpus);
+
+    return jobs;
+}
+
+// Pick the compiler cache for this build and point it at the shared
+// cache directory. A configured tree keeps the launcher it was set up
+// with. Must run from the project root.
+static const char *plan_compiler_cache(const char *cache_path)
+{
+    const char *launcher = NULL;
+
+    if (!file_exists(cache_path))
+    {
+        launcher = detect_compiler_launcher();
+    }
+    else
+    {
+        char *configured = cmake_cache_value(cache_path, "CMAKE_C_COMPILER_LAUNCHER");
+        if (configured && strstr(configured, "sccache"))
+            launcher = "sccache";
+        else if (configured && strstr(configured, "ccache"))
+            launcher = "ccache";
+        free(configured);
+    }
+
+    if (!launcher)
+        return NULL;
+
+    char dir[1024];
+    if (prepare_compiler_cache(launcher, dir, sizeof(dir)) != 0)
+    {
+        printf("Warning: Could not set up the %s directory\n", launcher);
+        return launcher;
+    }
+
+    printf("Compiler cache: %s (%s)\n", launcher, dir);
+    return launcher;
+}
+
+static const char *build_tree(build_type_t type)
+{
+    return type == BUILD_TYPE_PROD ? BUILD_PROD_DIR : BUILD_DEV_DIR;
+}
+
+// Older versions configured a single tree directly in build/. Its
+// generated files would just sit next to the per-type trees, so drop
+// them the first time a per-type tree is built.
+static void remove_legacy_build_tree(void)
+{
+    if (!file_exists("build" PATH_SEPARATOR "CMakeCache.txt"))
+        return;
+
+    const char *keep[] = {"dev", "prod"};
+    printf("Removing the old single build tree from build/...\n");
+    if (clean_directory("build", keep, sizeof(keep) / sizeof(keep[0])) != 0)
+        printf("Warning: Some files in build/ could not be removed\n");
+}
+
+// Print where the build in the current build tree spent its time and add
+// it to the tree's history
+static void report_timings(BuildTimings *timings, int trace_configure, long long log_mark)
+{
+    printf("\nTimings:\n");
+    if (timings->configure_ms > 0)
+        printf("  configure  %8.1f s\n", timings->configure_ms / 1000.0);
+    else
+        printf("  configure    cached\n");
+    printf("  build      %8.1f s\n", timings->build_ms / 1000.0);
+
+    if (timings->configure_ms > 0 && trace_configure)
+        timings_configure_report(TIMINGS_CONFIGURE_TRACE, TIMINGS_REPORT_ROWS);
+
+    if (timings_build_report(log_mark, TIMINGS_REPORT_ROWS, timings) != 0)
+        printf("\nNote: Timings per step need the Ninja generator\n");
+    else if (timings->steps > 0)
+        printf("\n%d steps, %.1f s of work on %d jobs\n",
+               timings->steps, timings->work_ms / 1000.0, timings->jobs);
+
+    timings_record(TIMINGS_HISTORY_FILE, timings);
+}
+
+// Get the project ready for a unity build: the CMake block that turns it
+// on and the sources that can't share a translation unit listed in
+// ecewo.unity
+static int prepare_unity_build(void)
+{
+    CMakeFile *cmake = cmake_open("CMakeLists.txt");
+    if (!cmake)
+        return -1;
+
+    int result = 0;
+    if (!cmake_has_block(cmake, UNITY_BLOCK))
+    {
+        const char *exec_name = cmake_exec_name(cmake);
+        StringBuilder *sb = sb_create();
+        if (!exec_name || !sb)
+        {
+            printf("Error: Could not find the executable target in CMakeLists.txt\n");
+            result = -1;
+        }
+        else if (append_unity_block(cmake, exec_name, sb) == 0)
+        {
+            printf("Added the unity build block to CMakeLists.txt\n");
+        }
+        else
+        {
+            result = -1;
+        }
+        sb_free(sb);
+    }
+
+    if (result == 0)
+        result = cmake_commit(cmake);
+    cmake_close(cmake);
+    if (result != 0)
+        return -1;
+
+    int excluded = unity_update_exclusions();
+    if (excluded < 0)
+    {
+        printf("Error: Could not update %s\n", UNITY_EXCLUDE_FILE);
+        return -1;
+    }
+    if (excluded > 0)
+        printf("Unity build: %d source%s compiled on their own, see %s\n",
+               excluded, excluded == 1 ? "" : "s", UNITY_EXCLUDE_FILE);
+    return 0;
+}
+
+static void unity_cmake_args(int batch, StringBuilder *sb)
+{
+    char number[32];
+    if (batch > 0)
+    {
+        snprintf(number, sizeof(number), "%d", batch);
+        sb_append(sb, " -DECEWO_UNITY=ON -DECEWO_UNITY_BATCH_SIZE=");
+        sb_append(sb, number);
+    }
+    else
+    {
+        sb_append(sb, " -DECEWO_UNITY=OFF");
+    }
+}
+
+static int build_project(const build_options_t *options)
+{
+    const char *build_dir = build_tree(options->type);
+    const char *build_mode;
+    const char *cmake_build_type;
+
+    switch (options->type)
+    {
+    case BUILD_TYPE_PROD:
+        build_mode = "Production";
+        cmake_build_type = "Release";
+        break;
+    case BUILD_TYPE_DEV:
+    default:
+        build_mode = "Development";
+        cmake_build_type = "Debug";
+        break;
+    }
+
+    printf("Creating %s build...\n", build_mode);
+
+    remove_legacy_build_tree();
+
+    char cache_path[256];
+    snprintf(cache_path, sizeof(cache_path), "%s%sCMakeCache.txt", build_dir, PATH_SEPARATOR);
+
+    int jobs = plan_build_jobs(options->jobs);
+    const char *launcher = plan_compiler_cache(cache_path);
+
+    // Compiles run from all over the build tree, so PGO needs the
+    // absolute path of its data
+    char pgo_dir[1100];
+    char project_dir[1024];
+    if (getcwd(project_dir, sizeof(project_dir)))
+        snprintf(pgo_dir, sizeof(pgo_dir), "%s%s%s", project_dir, PATH_SEPARATOR, PGO_DIR);
+    else
+        snprintf(pgo_dir, sizeof(pgo_dir), "%s", PGO_DIR);
+
+    int pgo_drift = options->type == BUILD_TYPE_PROD && !options->pgo ? pgo_source_drift(PGO_DIR) : 0;
+
+    // Unity builds stay on for a tree until --no-unity, like the profile
+    char unity_path[300];
+    snprintf(unity_path, sizeof(unity_path), "%s%s%s", build_dir, PATH_SEPARATOR, UNITY_FILE);
+    int recorded_batch = unity_load(unity_path);
+    int unity_batch = 0;
+    if (options->unity > 0)
+        unity_batch = options->unity_batch ? options->unity_batch : recorded_batch ? recorded_batch : unity_batch_size(jobs);
+    else if (options->unity == 0)
+        unity_batch = recorded_batch;
+
+    if (unity_batch > 0)
+    {
+        if (prepare_unity_build() != 0)
+            return -1;
+        printf("Unity build: batches of up to %d sources\n", unity_batch);
+    }
+
+    if (create_directory(build_dir) != 0)
+    {
+        printf("Error creating build directory: %s\n", build_dir);
+        return -1;
+    }
+
+    if (chdir(build_dir) != 0)
     {
-        if (plugins[i].selected)
+        printf("Error: Cannot change to build directory: %s\n", build_dir);
+        return -1;
+    }
+
+    int cache_exists = file_exists("CMakeCache.txt");
+    int unity_changed = cache_exists && unity_batch != recorded_batch;
+    char number[32];
+
+    BuildTimings timings;
+    memset(&timings, 0, sizeof(timings));
+    timings.jobs = jobs;
+
+    // A trace from an earlier configure would be reported as this one's
+    int trace_configure = options->timings && timings_trace_supported();
+    remove(TIMINGS_CONFIGURE_TRACE);
+
+    // Production trees carry an optimization profile. Options on the
+    // command line replace the recorded one, otherwise it is kept.
+    BuildProfile recorded, profile;
+    int use_profile = options->type == BUILD_TYPE_PROD;
+    int profile_changed = 0;
+
+    if (use_profile)
+    {
+        char description[256];
+        profile_load(&recorded, PROFILE_FILE);
+        profile = options->profile_set ? options->profile : recorded;
+
+        // PGO data outlives changes to the other options. An instrumented
+        // tree is only wanted during training and is left over from an
+        // interrupted one otherwise.
+        snprintf(profile.pgo, sizeof(profile.pgo), "%s", options->pgo ? options->pgo : recorded.pgo);
+        if (!options->pgo && strcmp(profile.pgo, PGO_GENERATE) == 0)
+        {
+            profile.pgo[0] = '\0';
+        }
+        else if (!options->pgo && profile.pgo[0])
+        {
+            if (pgo_drift < 0)
+                printf("Warning: PGO data is missing, building without it (run 'ecewo build pgo')\n");
+            else if (pgo_drift > PGO_MAX_DRIFT_PERCENT)
+                printf("Warning: %d%% of src/ changed since PGO training, building without it (run 'ecewo build pgo')\n", pgo_drift);
+            else if (pgo_drift > 0)
+                printf("PGO data: trained on sources %d%% different from now\n", pgo_drift);
+
+            if (pgo_drift < 0 || pgo_drift > PGO_MAX_DRIFT_PERCENT)
+                profile.pgo[0] = '\0';
+        }
+
+        // Same for the function layout: gprof instrumentation is only for
+        // profiling, and BOLT rewrites one linked binary, not the next
+        snprintf(profile.layout, sizeof(profile.layout), "%s", options->layout ? options->layout : recorded.layout);
+        char order_path[1200];
+        snprintf(order_path, sizeof(order_path), "%s%s%s", pgo_dir, PATH_SEPARATOR, LAYOUT_ORDER_FILE);
+
+        if (!options->layout && strcmp(profile.layout, LAYOUT_GPROF) == 0)
+        {
+            profile.layout[0] = '\0';
+        }
+        else if (!options->layout && strcmp(profile.layout, LAYOUT_BOLT) == 0)
+        {
+            printf("Note: Run 'ecewo build prod --layout' again to BOLT the new binary\n");
+        }
+        else if (!options->layout && profile.layout[0] && !file_exists(order_path))
+        {
+            printf("Warning: The function order is missing, building without it (run 'ecewo build prod --layout')\n");
+            profile.layout[0] = '\0';
+        }
+
+        profile_changed = cache_exists && !profile_equal(&profile, &recorded);
+
+        profile_describe(&profile, description, sizeof(description));
+        printf("Profile: %s\n", description);
+    }
+    else if (options->profile_set)
+    {
+        printf("Note: Optimization options only apply to build prod\n");
+    }
+
+    if (!cache_exists)
+    {
+        const char *generator = detect_generator();
+        if (generator)
+            printf("Generator: %s\n", generator);
+        else if (getenv("CMAKE_GENERATOR"))
+            printf("Generator: %s (from CMAKE_GENERATOR)\n", getenv("CMAKE_GENERATOR"));
+        else
+            printf("Generator: CMake default (Ninja not found)\n");
+
+        printf("Configuring with CMake (%s)...\n", cmake_build_type);
+
+        StringBuilder *cmake_cmd = sb_create();
+        if (!cmake_cmd)
+        {
+            printf("Error: Memory allocation failed\n");
+            chdir(PROJECT_FROM_BUILD_DIR);
+            return -1;
+        }
+
+        sb_append(cmake_cmd, "cmake");
+        if (generator)
+        {
+            sb_append(cmake_cmd, " -G \"");
+            sb_append(cmake_cmd, generator);
+            sb_append(cmake_cmd, "\"");
+        }
+        if (launcher)
+        {
+            sb_append(cmake_cmd, " -DCMAKE_C_COMPILER_LAUNCHER=");
+            sb_append(cmake_cmd, launcher);
+        }
+        sb_append(cmake_cmd, " -DCMAKE_BUILD_TYPE=");
+        sb_append(cmake_cmd, cmake_build_type);
+        if (use_profile)
+            profile_cmake_args(&profile, pgo_dir, cmake_cmd);
+        if (unity_batch > 0 || recorded_batch > 0)
+            unity_cmake_args(unity_batch, cmake_cmd);
+        if (trace_configure)
+            sb_append(cmake_cmd, " --profiling-format=google-trace --profiling-output=" TIMINGS_CONFIGURE_TRACE);
+        sb_append(cmake_cmd, " " PROJECT_FROM_BUILD_DIR);
+
+        long long configure_start = monotonic_ms();
+        int configure_result = execute_command(cmake_cmd->data);
+        timings.configure_ms = monotonic_ms() - configure_start;
+
+        if (configure_result != 0)
+        {
+            printf("Error: cmake configuration failed\n");
+            sb_free(cmake_cmd);
+            chdir(PROJECT_FROM_BUILD_DIR);
+            return -1;
+        }
+        sb_free(cmake_cmd);
+    }
+    else if (profile_changed || unity_changed)
+    {
+        printf("%s changed, reconfiguring...\n", profile_changed ? "Profile" : "Unity build");
+
+        StringBuilder *cmake_cmd = sb_create();
+        if (!cmake_cmd)
+        {
+            printf("Error: Memory allocation failed\n");
+            chdir(PROJECT_FROM_BUILD_DIR);
+            return -1;
+        }
+
+        sb_append(cmake_cmd, "cmake");
+        if (use_profile)
+            profile_cmake_args(&profile, pgo_dir, cmake_cmd);
+        if (unity_batch > 0 || recorded_batch > 0)
+            unity_cmake_args(unity_batch, cmake_cmd);
+        if (trace_configure)
+            sb_append(cmake_cmd, " --profiling-format=google-trace --profiling-output=" TIMINGS_CONFIGURE_TRACE);
+        sb_append(cmake_cmd, " .");
+
+        long long configure_start = monotonic_ms();
+        int configure_result = execute_command(cmake_cmd->data);
+        timings.configure_ms = monotonic_ms() - configure_start;
+
+        if (configure_result != 0)
+        {
+            printf("Error: cmake configuration failed\n");
+            sb_free(cmake_cmd);
+            chdir(PROJECT_FROM_BUILD_DIR);
+            return -1;
+        }
+        sb_free(cmake_cmd);
+    }
+    else
+    {
+        char *generator = cmake_cache_value("CMakeCache.txt", "CMAKE_GENERATOR");
+        printf("Using existing CMake cache (%s)...\n", generator ? generator : "unknown generator");
+        free(generator);
+    }
+
+    if (use_profile && (!cache_exists || profile_changed) && profile_save(&profile, PROFILE_FILE) != 0)
+        printf("Warning: Could not record the build profile\n");
+
+    if ((!cache_exists || unity_changed) && unity_save(UNITY_FILE, unity_batch) != 0)
+        printf("Warning: Could not record the unity build setting\n");
+
+    printf("Building (%s)...\n", cmake_build_type);
+
+    StringBuilder *build_cmd = sb_create();
+    if (!build_cmd)
+    {
+        printf("Error: Memory allocation failed\n");
+        chdir(PROJECT_FROM_BUILD_DIR);
+        return -1;
+    }
+
+    snprintf(number, sizeof(number), "%d", jobs);
+    sb_append(build_cmd, "cmake --build . --config ");
+    sb_append(build_cmd, cmake_build_type);
+    sb_append(build_cmd, " --parallel ");
+    sb_append(build_cmd, number);
+
+    // The counters are cumulative, so the build's share is the difference
+    long hits_before = 0, misses_before = 0;
+    int have_counts = launcher && compiler_cache_counts(launcher, &hits_before, &misses_before) == 0;
+
+    long long log_mark = timings_log_mark();
+    long long build_start = monotonic_ms();
+    int build_result = execute_command(build_cmd->data);
+    timings.build_ms = monotonic_ms() - build_start;
+    sb_free(build_cmd);
+
+    long hits = 0, misses = 0;
+    if (have_counts && compiler_cache_counts(launcher, &hits, &misses) == 0)
+    {
+        hits -= hits_before;
+        misses -= misses_before;
+        if (hits + misses > 0)
+            printf("Compiler cache: %ld hits, %ld misses (%.1f%% hit rate)\n",
+                   hits, misses, 100.0 * hits / (hits + misses));
+        else
+            printf("Compiler cache: nothing compiled\n");
+    }
+
+    if (build_result != 0)
+    {
+        printf("Error: Build failed\n");
+        chdir(PROJECT_FROM_BUILD_DIR);
+        return -1;
+    }
+
+    printf("%s build completed successfully!\n", build_mode);
+
+    if (options->timings)
+        report_timings(&timings, trace_configure, log_mark);
+
+    chdir(PROJECT_FROM_BUILD_DIR);
+    return 0;
+}
+
+// Whether a configured tree can be reconfigured in place. FetchContent
+// sub-builds refuse to switch generators, so a tree set up with another
+// generator than the one build_project would pick now has to go.
+static int generator_unchanged(const char *cache_path)
+{
+    char *cached = cmake_cache_value(cache_path, "CMAKE_GENERATOR");
+    if (!cached)
+        return 1;
+
+    const char *wanted = detect_generator();
+    int unchanged = wanted ? strcmp(cached, wanted) == 0 : strcmp(cached, "Ninja") != 0;
+    free(cached);
+    return unchanged;
+}
+
+static int rebuild_project(const build_options_t *options)
+{
+    const char *build_dir = build_tree(options->type);
+    const char *build_mode;
+
+    switch (options->type)
+    {
+    case BUILD_TYPE_PROD:
+        build_mode = "Production";
+        break;
+    case BUILD_TYPE_DEV:
+    default:
+        build_mode = "Development";
+        break;
+    }
+
+    printf("Rebuilding %s build...\n", build_mode);
+
+    char cache_path[256];
+    snprintf(cache_path, sizeof(cache_path), "%s%sCMakeCache.txt", build_dir, PATH_SEPARATOR);
+
+    int full = options->full;
+    if (!full && !generator_unchanged(cache_path))
+    {
+        printf("Generator changed, cleaning everything...\n");
+        full = 1;
+    }
+
+    if (full)
+    {
+        printf("Cleaning build directory...\n");
+        if (remove_directory(build_dir) != 0)
+        {
+            printf("Warning: Could not remove build directory (may not exist)\n");
+        }
+
+        printf("Removed build directory\n");
+    }
+    else if (directory_exists(build_dir))
+    {
+        // Keep FetchContent checkouts and their objects, the vendors
+        // library, and the Ninja logs that tell Ninja those objects are
+        // still up to date. The cache, generated build files and the
+        // application's objects go.
+        const char *keep[] = {"_deps", VENDORS_BINARY_DIR, ".ninja_log", ".ninja_deps",
+                              PROFILE_FILE, UNITY_FILE, TIMINGS_HISTORY_FILE, READY_HISTORY_FILE};
+
+        printf("Cleaning build directory (keeping _deps and %s)...\n", VENDORS_BINARY_DIR);
+        if (clean_directory(build_dir, keep, sizeof(keep) / sizeof(keep[0])) != 0)
+        {
+            printf("Warning: Some files in %s could not be removed\n", build_dir);
+        }
+
+        printf("Cleaned build directory, use 'rebuild --full' to refetch dependencies\n");
+    }
+
+    printf("\n");
+
+    return build_project(options);
+}
+
+#ifndef _WIN32
+// Signals ecewo passes on to a server it runs. Those from the terminal
+// (Ctrl-C, Ctrl-\\) already reach the server through the process group,
+// the ones sent to ecewo alone by kill, systemd or docker don't.
+static const int run_signals[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2};
+#define RUN_SIGNAL_COUNT ((int)(sizeof(run_signals) / sizeof(run_signals[0])))
+
+static volatile sig_atomic_t run_received[RUN_SIGNAL_COUNT];
+static volatile sig_atomic_t run_forward[RUN_SIGNAL_COUNT];
+
+static void on_run_signal(int sig, siginfo_t *info, void *context)
+{
+    (void)context;
+    for (int i = 0; i < RUN_SIGNAL_COUNT; i++)
+    {
+        if (run_signals[i] != sig)
+            continue;
+        run_received[i] = 1;
+        if (!info || info->si_code == SI_USER || info->si_code == SI_QUEUE)
+            run_forward[i] = 1;
+    }
+}
+
+static void install_run_signals(void)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = on_run_signal;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    for (int i = 0; i < RUN_SIGNAL_COUNT; i++)
+        sigaction(run_signals[i], &action, NULL);
+}
+
+// Pass pending signals on to the running servers (pid > 0). Returns 1
+// if one of them asks the servers to stop.
+static int forward_run_signals(const int *servers, int count)
+{
+    int stop = 0;
+    for (int i = 0; i < RUN_SIGNAL_COUNT; i++)
+    {
+        if (!run_received[i])
+            continue;
+
+        run_received[i] = 0;
+        for (int j = 0; run_forward[i] && j < count; j++)
+        {
+            if (servers[j] > 0)
+                kill((pid_t)servers[j], run_signals[i]);
+        }
+        run_forward[i] = 0;
+
+        if (run_signals[i] != SIGUSR1 && run_signals[i] != SIGUSR2)
+            stop = 1;
+    }
+    return stop;
+}
+
+// Keep server (already started from program in build_dir) in the
+// foreground: forward signals, report how it exits and, with restart,
+// start it again after a crash, waiting longer after each crash in a
+// row. Returns the last exit code of the server.
+static int supervise_server(const char *build_dir, const char *program, int server, int restart)
+{
+    int backoff_ms = RESTART_BACKOFF_MIN_MS;
+
+    while (1)
+    {
+        long long started = monotonic_ms();
+        long long stop_requested = 0;
+        int exit_code = -1, signaled = 0;
+
+        while (process_poll(server, &exit_code, &signaled) == 0)
+        {
+            if (forward_run_signals(&server, 1))
+            {
+                // A second Ctrl-C doesn't wait for a graceful exit
+                if (stop_requested)
+                {
+                    printf("Killing the server...\n");
+                    kill((pid_t)server, SIGKILL);
+                }
+                stop_requested = monotonic_ms();
+            }
+
+            if (stop_requested && monotonic_ms() - stop_requested > WATCH_STOP_TIMEOUT_MS)
+            {
+                printf("Server still running %d s after the signal, sending SIGTERM...\n",
+                       WATCH_STOP_TIMEOUT_MS / 1000);
+                exit_code = process_stop(server, WATCH_STOP_TIMEOUT_MS, &signaled);
+                break;
+            }
+
+            sleep_ms(10);
+        }
+
+        // Ctrl-C reaches the server too, which may be gone before ecewo
+        // got to the signal
+        if (!stop_requested && forward_run_signals(NULL, 0))
+            stop_requested = monotonic_ms();
+
+        char description[128];
+        process_describe_exit(exit_code, signaled, description, sizeof(description));
+
+        if (stop_requested)
+        {
+            printf("Server stopped in %lld ms (%s)\n", monotonic_ms() - stop_requested, description);
+            return exit_code;
+        }
+
+        printf("Server %s after %.1f s (%s)\n", signaled ? "crashed" : "exited",
+               (monotonic_ms() - started) / 1000.0, description);
+
+        if (!restart || exit_code == 0)
+            return exit_code;
+
+        // A server that stayed up for a while starts over with short waits
+        if (monotonic_ms() - started >= RESTART_STABLE_MS)
+            backoff_ms = RESTART_BACKOFF_MIN_MS;
+
+        printf("Restarting in %d ms...\n", backoff_ms);
+        long long restart_at = monotonic_ms() + backoff_ms;
+        while (monotonic_ms() < restart_at)
+        {
+            if (forward_run_signals(NULL, 0))
+                return exit_code;
+            sleep_ms(10);
+        }
+
+        backoff_ms = backoff_ms * 2 > RESTART_BACKOFF_MAX_MS ? RESTART_BACKOFF_MAX_MS : backoff_ms * 2;
+
+        server = process_start(build_dir, program, -1);
+        if (server < 0)
+        {
+            printf("Error: Could not start %s\n", program);
+            return -1;
+        }
+    }
+}
+#endif
+
+static int run_project(const build_options_t *options, const run_options_t *run)
+{
+    const char *build_dir = build_tree(options->type);
+
+    // Check if build folder exists
+    if (!file_exists(build_dir))
+    {
+        printf("Build not found. Building %s version first...\n",
+               options->type == BUILD_TYPE_PROD ? "production" : "development");
+        if (build_project(options) != 0)
+        {
+            return -1;
+        }
+        printf("\n");
+    }
+
+    char *exec_name = get_exec_name();
+    if (!exec_name)
+    {
+        printf("Could not determine executable name. Check CMakeLists.txt.\n");
+        return -1;
+    }
+
+    char exec_path[512];
+#ifdef _WIN32
+    (void)run;
+    snprintf(exec_path, sizeof(exec_path), "%s%s%s.exe", build_dir, PATH_SEPARATOR, exec_name);
+    if (!file_exists(exec_path))
+        snprintf(exec_path, sizeof(exec_path), "%s%s%s", build_dir, PATH_SEPARATOR, exec_name);
+#else
+    snprintf(exec_path, sizeof(exec_path), "%s%s%s", build_dir, PATH_SEPARATOR, exec_name);
+#endif
+
+    if (!file_exists(exec_path))
+    {
+        printf("Executable %s not found. Build may have failed.\n", exec_name);
+        free(exec_name);
+        return -1;
+    }
+
+    printf("Running server...\n");
+
+#ifdef _WIN32
+    // The server runs inside build_dir, like it does elsewhere
+    if (chdir(build_dir) != 0)
+    {
+        printf("Error: Cannot change to build directory: %s\n", build_dir);
+        free(exec_name);
+        return -1;
+    }
+    execute_command(exec_name);
+    chdir(PROJECT_FROM_BUILD_DIR);
+    free(exec_name);
+    return 0;
+#else
+    char program[512];
+    snprintf(program, sizeof(program), "./%s", exec_name);
+    free(exec_name);
+
+    install_run_signals();
+
+    int server = process_start(build_dir, program, -1);
+    if (server < 0)
+    {
+        printf("Error: Could not start %s\n", program);
+        return -1;
+    }
+
+    return supervise_server(build_dir, program, server, run->restart);
+#endif
+}
+
+// Drive the server under training: the user's workload script if there
+// is one, the request replay otherwise
+static int run_training_workload(const train_options_t *train)
+{
+    if (!train->workload)
+        return pgo_replay(PGO_REQUESTS_FILE, train->port, train->requests);
+
+#ifdef _WIN32
+    return -1;
+#else
+    char value[64];
+    snprintf(value, sizeof(value), "%d", train->port);
+    setenv("ECEWO_PGO_PORT", value, 1);
+    snprintf(value, sizeof(value), "http://127.0.0.1:%d", train->port);
+    setenv("ECEWO_PGO_URL", value, 1);
+
+    printf("Running workload %s against %s...\n", train->workload, value);
+    return execute_command(train->workload) == 0 ? 0 : -1;
+#endif
+}
+
+// Path of the server relative to its build tree, "./<name>"
+static int server_program(char *program, size_t program_size)
+{
+    char *exec_name = get_exec_name();
+    if (!exec_name)
+    {
+        printf("Could not determine executable name. Check CMakeLists.txt.\n");
+        return -1;
+    }
+
+    snprintf(program, program_size, "./%s", exec_name);
+    free(exec_name);
+    return 0;
+}
+
+// Start argv in build/prod (the server, or a profiler wrapping it), wait
+// for the server to listen, run the workload and stop it again. Returns
+// 0 if the workload succeeded, with the exit code of argv in exit_code.
+static int train_server(char *const argv[], const train_options_t *train, int *exit_code)
+{
+    *exit_code = -1;
+
+    int server = process_spawn(BUILD_PROD_DIR, argv, -1);
+    if (server < 0)
+    {
+        printf("Error: Could not start %s\n", argv[0]);
+        return -1;
+    }
+
+    if (process_wait_port(server, train->port, SERVER_START_TIMEOUT_MS) != 0)
+    {
+        printf("Error: The server didn't open port %d (use --port to change it)\n", train->port);
+        *exit_code = process_stop(server, PGO_STOP_TIMEOUT_MS, NULL);
+        return -1;
+    }
+
+    int result = run_training_workload(train);
+    *exit_code = process_stop(server, PGO_STOP_TIMEOUT_MS, NULL);
+
+    if (result != 0)
+        printf("Error: The training workload failed\n");
+    return result;
+}
+
+// Profile-guided build of the production tree: build it instrumented,
+// train the server, then rebuild it with the collected profile. Later
+// `build prod` runs keep using the profile until src/ drifts too far.
+static int pgo_build_project(const build_options_t *options, const train_options_t *train)
+{
+#ifdef _WIN32
+    (void)options;
+    (void)train;
+    printf("Error: build pgo is not supported on Windows yet\n");
+    return -1;
+#else
+    char program[512];
+    if (server_program(program, sizeof(program)) != 0)
+        return -1;
+
+    if (train->workload && !file_exists(train->workload))
+    {
+        printf("Error: Workload script not found: %s\n", train->workload);
+        return -1;
+    }
+
+    if (pgo_reset(PGO_DIR) != 0)
+    {
+        printf("Error: Could not prepare %s/ for profile data\n", PGO_DIR);
+        return -1;
+    }
+
+    build_options_t step = *options;
+    step.type = BUILD_TYPE_PROD;
+    step.pgo = PGO_GENERATE;
+
+    printf("PGO 1/3: instrumented build\n\n");
+    if (build_project(&step) != 0)
+        return -1;
+
+    printf("\nPGO 2/3: training\n\n");
+    char *server_argv[] = {program, NULL};
+    int exit_code;
+    if (train_server(server_argv, train, &exit_code) != 0)
+        return -1;
+
+    // GCC and Clang both understand the instrumentation flags, anything
+    // else fails the instrumented build or writes no data
+    const char *compiler = pgo_merge(PGO_DIR);
+    if (!compiler)
+    {
+        printf("Error: No profile data was written (server exit code %d). The server has to\n", exit_code);
+        printf("exit normally on SIGTERM within %d s for the counters to be saved.\n", PGO_STOP_TIMEOUT_MS / 1000);
+        return -1;
+    }
+
+    if (pgo_record_sources(PGO_DIR) != 0)
+        printf("Warning: Could not record the trained sources, the data won't be reused\n");
+
+    printf("\nPGO 3/3: optimized build\n\n");
+    step.pgo = compiler;
+    int result = build_project(&step);
+
+    if (result == 0)
+        printf("Profile data kept in %s/, 'ecewo build prod' keeps using it\n", PGO_DIR);
+    return result;
+#endif
+}
+
+typedef struct
+{
+    long text_size;
+    int hot_pages;
+    double icache_mpki; // i-cache misses per 1000 instructions, -1 if unknown
+} layout_stats_t;
+
+// Measure the built server before or after the layout stage. The
+// symbol table is kept so hot pages can be counted once the order is
+// known. The i-cache counters need perf and one more training run.
+static void measure_layout(const char *binary, const char *program, const char *snapshot,
+                           const train_options_t *train, int have_perf, layout_stats_t *stats)
+{
+    stats->text_size = layout_text_size(binary);
+    stats->hot_pages = -1;
+    stats->icache_mpki = -1;
+
+    if (layout_snapshot(binary, snapshot) != 0)
+        printf("Warning: Could not read the symbols of %s\n", binary);
+
+    if (!have_perf)
+        return;
+
+    char stat_path[256];
+    snprintf(stat_path, sizeof(stat_path), PROJECT_FROM_BUILD_DIR "%s" PGO_DIR "%sperf-stat.txt", PATH_SEPARATOR, PATH_SEPARATOR);
+
+    char *argv[] = {"perf", "stat", "-x", ",", "-e", "instructions:u,L1-icache-load-misses:u",
+                    "-o", stat_path, "--", (char *)program, NULL};
+    int exit_code;
+    if (train_server(argv, train, &exit_code) != 0)
+        return;
+
+    char project_stat_path[256];
+    snprintf(project_stat_path, sizeof(project_stat_path), "%s%sperf-stat.txt", PGO_DIR, PATH_SEPARATOR);
+    stats->icache_mpki = layout_icache_mpki(project_stat_path);
+    remove(project_stat_path);
+}
+
+static void print_layout_row(const char *label, double before, double after, const char *format)
+{
+    char before_text[32] = "n/a", after_text[32] = "n/a";
+    if (before >= 0)
+        snprintf(before_text, sizeof(before_text), format, before);
+    if (after >= 0)
+        snprintf(after_text, sizeof(after_text), format, after);
+
+    printf("  %-24s %12s %12s", label, before_text, after_text);
+    if (before > 0 && after >= 0)
+        printf("   %+.1f%%", (after - before) * 100.0 / before);
+    printf("\n");
+}
+
+// Post-link layout stage of build prod: profile the server under the
+// training workload and pack its hot functions together, with llvm-bolt
+// when it and perf are installed and a linker ordering file otherwise.
+// Without perf the profile comes from a gprof-instrumented build.
+static int layout_build_project(const build_options_t *options, const train_options_t *train)
+{
+#ifndef __linux__
+    (void)options;
+    (void)train;
+    printf("Error: build prod --layout is only supported on Linux\n");
+    return -1;
+#else
+    char program[512];
+    if (server_program(program, sizeof(program)) != 0)
+        return -1;
+
+    if (train->workload && !file_exists(train->workload))
+    {
+        printf("Error: Workload script not found: %s\n", train->workload);
+        return -1;
+    }
+
+    int have_perf = find_program("perf");
+    int use_bolt = have_perf && find_program("llvm-bolt") && find_program("perf2bolt");
+    const char *linker = use_bolt ? NULL : layout_linker();
+    if (!use_bolt && !linker)
+    {
+        printf("Error: The layout stage needs llvm-bolt and perf, or the lld or gold linker\n");
+        return -1;
+    }
+
+    if (create_directory(PGO_DIR) != 0)
+    {
+        printf("Error: Could not create %s/\n", PGO_DIR);
+        return -1;
+    }
+
+    char binary[600], snapshot_before[64], snapshot_after[64], perf_data[64], gmon[600];
+    snprintf(binary, sizeof(binary), "%s%s%s", BUILD_PROD_DIR, PATH_SEPARATOR, program + 2);
+    snprintf(snapshot_before, sizeof(snapshot_before), "%s%ssymbols-before.txt", PGO_DIR, PATH_SEPARATOR);
+    snprintf(snapshot_after, sizeof(snapshot_after), "%s%ssymbols-after.txt", PGO_DIR, PATH_SEPARATOR);
+    snprintf(perf_data, sizeof(perf_data), "%s%sperf.data", PGO_DIR, PATH_SEPARATOR);
+    snprintf(gmon, sizeof(gmon), "%s%sgmon.out", BUILD_PROD_DIR, PATH_SEPARATOR);
+
+    // perf runs inside the build tree
+    char perf_output[128];
+    snprintf(perf_output, sizeof(perf_output), PROJECT_FROM_BUILD_DIR "%s%s", PATH_SEPARATOR, perf_data);
+
+    build_options_t step = *options;
+    step.type = BUILD_TYPE_PROD;
+    step.layout = use_bolt ? LAYOUT_BOLT : "";
+
+    printf("Layout 1/3: baseline build\n\n");
+    if (build_project(&step) != 0)
+        return -1;
+
+    layout_stats_t before, after;
+    measure_layout(binary, program, snapshot_before, train, have_perf, &before);
+
+    printf("\nLayout 2/3: profiling with %s\n\n", have_perf ? "perf" : "gprof");
+    int exit_code;
+    int lbr = 0;
+    int functions;
+
+    if (have_perf)
+    {
+        lbr = use_bolt && layout_perf_has_lbr();
+        char *lbr_argv[] = {"perf", "record", "-q", "-e", "cycles:u", "-b", "-o", perf_output, "--", program, NULL};
+        char *sample_argv[] = {"perf", "record", "-q", "-e", "cycles:u", "-o", perf_output, "--", program, NULL};
+        if (train_server(lbr ? lbr_argv : sample_argv, train, &exit_code) != 0)
+            return -1;
+
+        functions = layout_order_from_perf(PGO_DIR, perf_data);
+    }
+    else
+    {
+        step.layout = LAYOUT_GPROF;
+        if (build_project(&step) != 0)
+            return -1;
+
+        remove(gmon);
+        char *argv[] = {program, NULL};
+        if (train_server(argv, train, &exit_code) != 0)
+            return -1;
+
+        functions = layout_order_from_gprof(PGO_DIR, binary, gmon);
+        remove(gmon);
+    }
+
+    if (functions <= 0)
+    {
+        printf("Error: The profile has no samples of the server's functions (exit code %d)\n", exit_code);
+        if (!have_perf)
+            printf("gprof only writes its data when the server exits normally on SIGTERM.\n");
+        return -1;
+    }
+    printf("Function order: %d functions, hottest first\n", functions);
+
+    if (use_bolt)
+    {
+        printf("\nLayout 3/3: rewriting the binary with llvm-bolt%s\n\n", lbr ? "" : " (no branch stacks)");
+        if (layout_bolt(binary, perf_data, lbr) != 0)
+        {
+            printf("Error: llvm-bolt failed, the binary is unchanged\n");
+            return -1;
+        }
+    }
+    else
+    {
+        printf("\nLayout 3/3: relinking in profile order with %s\n\n", linker);
+        step.layout = linker;
+        if (build_project(&step) != 0)
+            return -1;
+    }
+
+    measure_layout(binary, program, snapshot_after, train, have_perf, &after);
+    before.hot_pages = layout_hot_pages(snapshot_before, PGO_DIR, LAYOUT_HOT_FUNCTIONS);
+    after.hot_pages = layout_hot_pages(snapshot_after, PGO_DIR, LAYOUT_HOT_FUNCTIONS);
+    remove(snapshot_before);
+    remove(snapshot_after);
+
+    printf("\nLayout report (%s):\n", use_bolt ? "llvm-bolt" : "symbol order");
+    printf("  %-24s %12s %12s\n", "", "before", "after");
+    print_layout_row(".text bytes", before.text_size, after.text_size, "%.0f");
+    print_layout_row("4 KiB pages, hot code", before.hot_pages, after.hot_pages, "%.0f");
+    print_layout_row("i-cache misses / 1k ins", before.icache_mpki, after.icache_mpki, "%.2f");
+    if (!have_perf)
+        printf("  (i-cache counters need perf)\n");
+    printf("  Hot code is the %d hottest functions of the profile\n", LAYOUT_HOT_FUNCTIONS);
+
+    return 0;
+#endif
+}
+
+// Start the built server, load it with the generator, save the result
+// and compare it with a baseline. Returns 1 when the comparison finds a
+// regression beyond the threshold.
+static int bench_project(const build_options_t *options, const bench_options_t *bench,
+                         const char *output, const char *baseline_path, double threshold)
+{
+    const char *build_dir = build_tree(options->type);
+
+    BenchResult baseline;
+    if (baseline_path && bench_load_json(baseline_path, &baseline) != 0)
+    {
+        printf("Error: Could not read a bench result from %s\n", baseline_path);
+        return -1;
+    }
+
+    if (!file_exists(build_dir))
+    {
+        printf("Build not found. Building %s version first...\n",
+               options->type == BUILD_TYPE_PROD ? "production" : "development");
+        if (build_project(options) != 0)
+            return -1;
+        printf("\n");
+    }
+
+    char program[512];
+    if (server_program(program, sizeof(program)) != 0)
+        return -1;
+
+    int server = process_start(build_dir, program, -1);
+    if (server < 0)
+    {
+        printf("Error: Could not start %s\n", program);
+        return -1;
+    }
+
+    if (process_wait_port(server, bench->port, SERVER_START_TIMEOUT_MS) != 0)
+    {
+        printf("Error: The server didn't open port %d (use --port to change it)\n", bench->port);
+        process_stop(server, WATCH_STOP_TIMEOUT_MS, NULL);
+        return -1;
+    }
+
+    if (bench->rate > 0)
+        printf("Benchmarking http://127.0.0.1:%d%s for %d s: %d threads, %d connections, %.0f req/s open loop\n",
+               bench->port, bench->path, bench->duration, bench->threads, bench->connections, bench->rate);
+    else
+        printf("Benchmarking http://127.0.0.1:%d%s for %d s: %d threads, %d connections, closed loop\n",
+               bench->port, bench->path, bench->duration, bench->threads, bench->connections);
+    fflush(stdout);
+
+    BenchResult result;
+    int run_result = bench_run(bench, &result);
+    process_stop(server, WATCH_STOP_TIMEOUT_MS, NULL);
+
+    if (run_result != 0)
+    {
+        printf("Error: No request completed (%lld connection errors)\n", result.socket_errors);
+        return -1;
+    }
+
+    bench_print(&result);
+
+    create_directory("build");
+    if (bench_save_json(bench, &result, output) == 0)
+        printf("\nSaved to %s\n", output);
+    else
+        printf("Warning: Could not write %s\n", output);
+
+    if (!baseline_path)
+        return 0;
+
+    int regressions = bench_compare(&baseline, &result, threshold);
+    if (regressions > 0)
+    {
+        printf("\n%d metric%s regressed beyond %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+        return 1;
+    }
+
+    printf("\nNo regression beyond %.1f%%\n", threshold);
+    return 0;
+}
+
+#ifndef _WIN32
+static volatile sig_atomic_t watch_interrupted = 0;
+
+static void on_watch_interrupt(int sig)
+{
+    (void)sig;
+    watch_interrupted = 1;
+}
+
+// Wait for a restarted server to accept on port. Returns 0 once it does,
+// 1 with its exit code if it exits first, -1 on timeout.
+static int wait_for_server(int server, int port, int *exit_code, int *signaled)
+{
+    long long deadline = monotonic_ms() + SERVER_START_TIMEOUT_MS;
+    while (monotonic_ms() < deadline)
+    {
+        int fd = connect_to_port(port);
+        if (fd >= 0)
+        {
+            close(fd);
+            return 0;
+        }
+
+        if (process_poll(server, exit_code, signaled) == 1)
+            return 1;
+        sleep_ms(50);
+    }
+    return -1;
+}
+#endif
+
+// Build, start the server and keep rebuilding and restarting it whenever
+// src/, vendors/ or CMakeLists.txt change. A failed build leaves the
+// running server alone. With handoff the new server takes over the
+// listening socket before the old one is asked to drain and exit, so the
+// port never closes.
+static int watch_project(const build_options_t *options, const run_options_t *run)
+{
+#ifdef _WIN32
+    (void)options;
+    (void)run;
+    printf("Error: run --watch is not supported on Windows yet\n");
+    return -1;
+#else
+    const char *build_dir = build_tree(options->type);
+
+    char *exec_name = get_exec_name();
+    if (!exec_name)
+    {
+        printf("Could not determine executable name. Check CMakeLists.txt.\n");
+        return -1;
+    }
+
+    size_t program_size = strlen("./") + strlen(exec_name) + 1;
+    char *program = malloc(program_size);
+    if (!program)
+    {
+        free(exec_name);
+        return -1;
+    }
+    snprintf(program, program_size, "./%s", exec_name);
+    free(exec_name);
+
+    int listen_fd = -1;
+    if (run->handoff)
+    {
+        // With SO_REUSEPORT a server that binds the port itself still can
+        listen_fd = open_listen_socket(run->port, 1);
+        if (listen_fd < 0)
+        {
+            printf("Error: Could not listen on port %d\n", run->port);
+            free(program);
+            return -1;
+        }
+        printf("Listening on port %d, passed to the server as LISTEN_FDS\n", run->port);
+    }
+
+    const char *dirs[] = {"src", "vendors"};
+    const char *files[] = {"CMakeLists.txt"};
+    Watcher *watcher = watcher_create(dirs, 2, files, 1);
+    if (!watcher)
+    {
+        printf("Error: Could not watch the project for changes\n");
+        if (listen_fd >= 0)
+            close(listen_fd);
+        free(program);
+        return -1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_watch_interrupt;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int server = -1;
+    if (build_project(options) == 0)
+    {
+        server = process_start(build_dir, program, listen_fd);
+        if (server < 0)
+            printf("Error: Could not start %s\n", program);
+    }
+
+    printf("\nWatching src/, vendors/ and CMakeLists.txt for changes (Ctrl-C to stop)\n");
+
+    long long unaccepted_since = 0;
+    while (!watch_interrupted)
+    {
+        int changed = watcher_wait(watcher, 500);
+
+        // A server that listens on a socket of its own shares the port
+        // with ecewo's, and whatever the kernel queues on ecewo's is never
+        // accepted. Give the socket up and restart the plain way.
+        if (listen_fd >= 0 && server > 0 && listen_socket_pending(listen_fd))
+        {
+            long long now = monotonic_ms();
+            if (!unaccepted_since)
+                unaccepted_since = now;
+            else if (now - unaccepted_since > WATCH_HANDOFF_GRACE_MS)
+            {
+                printf("Warning: The server doesn't accept on the LISTEN_FDS socket, handoff is off\n");
+                close_listen_socket(listen_fd);
+                listen_fd = -1;
+                unaccepted_since = 0;
+            }
+        }
+        else
+            unaccepted_since = 0;
+
+        int exit_code, signaled;
+        if (server > 0 && process_poll(server, &exit_code, &signaled) == 1)
+        {
+            char description[128];
+            process_describe_exit(exit_code, signaled, description, sizeof(description));
+            printf("Server exited (%s), waiting for changes...\n", description);
+            server = -1;
+        }
+
+        if (changed <= 0 || watch_interrupted)
+            continue;
+
+        long long change_time = monotonic_ms();
+
+        // Let a burst of saves settle before building
+        while (!watch_interrupted && watcher_wait(watcher, WATCH_DEBOUNCE_MS) > 0)
+            ;
+        if (watch_interrupted)
+            break;
+
+        printf("\nChange detected, rebuilding...\n");
+        long long build_start = monotonic_ms();
+
+        if (build_project(options) != 0)
+        {
+            printf("Build failed, %s\n", server > 0 ? "the previous server keeps running" : "waiting for changes");
+            continue;
+        }
+
+        long long build_ms = monotonic_ms() - build_start;
+
+        // Without handoff the old server has to release the port first
+        int previous = server;
+        if (previous > 0 && listen_fd < 0)
+        {
+            process_stop(previous, WATCH_STOP_TIMEOUT_MS, NULL);
+            previous = -1;
+        }
+
+        // Ready is when the port accepts again. A handed-off socket never
+        // stops accepting, so there only the start is timed.
+        server = process_start(build_dir, program, listen_fd);
+        if (server < 0)
+        {
+            printf("Error: Could not start %s\n", program);
+            server = previous;
+            previous = -1;
+        }
+        else if (listen_fd >= 0)
+        {
+            // The old server only goes once the new one has outlived a
+            // short grace period, a broken build would leave nothing
+            int exit_code, signaled, exited = 0;
+            long long grace_end = monotonic_ms() + WATCH_HANDOFF_GRACE_MS;
+            while (monotonic_ms() < grace_end)
+            {
+                if (process_poll(server, &exit_code, &signaled) == 1)
+                {
+                    exited = 1;
+                    break;
+                }
+                sleep_ms(10);
+            }
+
+            if (exited)
+            {
+                char description[128];
+                process_describe_exit(exit_code, signaled, description, sizeof(description));
+                printf("New server exited (%s), %s\n", description,
+                       previous > 0 ? "the previous server keeps running" : "waiting for changes");
+                server = previous;
+                previous = -1;
+            }
+            else
+            {
+                printf("Server restarted %lld ms after the change (build %lld ms), the port stayed open\n",
+                       monotonic_ms() - change_time, build_ms);
+            }
+        }
+        else
         {
-            // Specific processes only for cbor and postgres
-            if (strcmp(plugins[i].name, "CBOR") == 0)
+            int exit_code, signaled;
+            int ready = wait_for_server(server, run->port, &exit_code, &signaled);
+            if (ready == 0)
             {
-                printf("Handling TinyCBOR integration...\n");
-                install_cbor();
-                continue;
+                printf("Server ready on port %d %lld ms after the change (build %lld ms)\n",
+                       run->port, monotonic_ms() - change_time, build_ms);
             }
-
-            if (strcmp(plugins[i].name, "Postgres") == 0)
+            else if (ready > 0)
             {
-                printf("Handling postgres integration...\n");
-                install_postgres();
-                continue;
+                char description[128];
+                process_describe_exit(exit_code, signaled, description, sizeof(description));
+                printf("Server exited (%s) before opening port %d, waiting for changes...\n", description, run->port);
+                server = -1;
             }
-
-            // Installing process for the other plugins
-            if (install_vendor(
-                    plugins[i].name,
-                    plugins[i].c_url,
-                    plugins[i].h_url) != 0)
+            else
             {
-                fprintf(stderr, "Error installing %s\n", plugins[i].name);
+                printf("Warning: The new server didn't open port %d (use --port to change it)\n", run->port);
             }
         }
+
+        // The old server finishes its connections while the new one accepts
+        if (previous > 0)
+        {
+            long long drain_start = monotonic_ms();
+            int signaled;
+            int exit_code = process_stop(previous, WATCH_STOP_TIMEOUT_MS, &signaled);
+            char description[128];
+            process_describe_exit(exit_code, signaled, description, sizeof(description));
+            printf("Previous server drained in %lld ms (%s)\n",
+                   monotonic_ms() - drain_start, description);
+        }
     }
 
-    printf("Starter project created successfully.\n");
-    printf("Project '%s' created successfully!\n", project_name);
-    printf("To build and run your project:\n");
-    printf("ecewo run\n");
+    printf("\nStopping...\n");
+    if (server > 0)
+        process_stop(server, WATCH_STOP_TIMEOUT_MS, NULL);
 
-    free(project_name);
-    free(cmake_content);
+    if (listen_fd >= 0)
+        close(listen_fd);
+    watcher_free(watcher);
+    free(program);
     return 0;
+#endif
 }
 
-static int build_project(build_type_t build_type)
+// Print a startup time next to the one of the previous ready check
+static void print_ready_time(const char *label, long long us, long long previous_us)
 {
-    const char *build_dir = "build";
-    const char *build_mode;
-    const char *cmake_build_type;
-    const char *cmake_config;
+    printf("  %-12s %8.1f ms after exec", label, us / 1000.0);
+    if (previous_us > 0)
+        printf("  (previous run: %.1f ms)", previous_us / 1000.0);
+    printf("\n");
+}
+
+// Add a ready check to the history in the build tree and return the
+// previous one in previous[3] (listening, first 200, warmed up)
+static void record_ready_times(const char *build_dir, const long long times[3], long long previous[3])
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s%s%s", build_dir, PATH_SEPARATOR, READY_HISTORY_FILE);
 
-    switch (build_type)
+    previous[0] = previous[1] = previous[2] = 0;
+    FILE *file = fopen(path, "r");
+    if (file)
     {
-    case BUILD_TYPE_PROD:
-        build_mode = "Production";
-        cmake_build_type = "Release";
-        cmake_config = "--config Release";
-        break;
-    case BUILD_TYPE_DEV:
-    default:
-        build_mode = "Development";
-        cmake_build_type = "Debug";
-        cmake_config = "--config Debug";
-        break;
+        char line[256];
+        while (fgets(line, sizeof(line), file))
+        {
+            long long when, listen_us, ok_us, warm_us;
+            if (sscanf(line, "%lld %lld %lld %lld", &when, &listen_us, &ok_us, &warm_us) != 4)
+                continue;
+            previous[0] = listen_us;
+            previous[1] = ok_us;
+            previous[2] = warm_us;
+        }
+        fclose(file);
     }
 
-    printf("Creating %s build...\n", build_mode);
+    int is_new = !file_exists(path);
+    file = fopen(path, "a");
+    if (!file)
+        return;
+    if (is_new)
+        fprintf(file, "# time listening_us first_200_us warmed_up_us, written by ecewo run --ready-check\n");
+    fprintf(file, "%lld %lld %lld %lld\n", (long long)time(NULL), times[0], times[1], times[2]);
+    fclose(file);
+}
 
-    if (create_directory(build_dir) != 0)
+// Start the server like run does and measure how long it takes from exec
+// to accepting connections and to answering GET path with 200, then
+// replay the warmup requests before announcing it ready. The server
+// keeps running in the foreground afterwards.
+static int ready_project(const build_options_t *options, const run_options_t *run)
+{
+#ifdef _WIN32
+    (void)options;
+    (void)run;
+    printf("Error: run --ready-check is not supported on Windows yet\n");
+    return -1;
+#else
+    const char *build_dir = build_tree(options->type);
+
+    if (!file_exists(build_dir))
     {
-        printf("Error creating build directory: %s\n", build_dir);
-        return -1;
+        printf("Build not found. Building %s version first...\n",
+               options->type == BUILD_TYPE_PROD ? "production" : "development");
+        if (build_project(options) != 0)
+            return -1;
+        printf("\n");
     }
 
-    if (chdir(build_dir) != 0)
+    char program[512];
+    if (server_program(program, sizeof(program)) != 0)
+        return -1;
+
+    printf("Running server...\n");
+    install_run_signals();
+
+    long long exec_us = monotonic_us();
+    int server = process_start(build_dir, program, -1);
+    if (server < 0)
     {
-        printf("Error: Cannot change to build directory: %s\n", build_dir);
+        printf("Error: Could not start %s\n", program);
         return -1;
     }
 
-    int cache_exists = file_exists("CMakeCache.txt");
-    
-    if (!cache_exists)
-    {
-        printf("Configuring with CMake (%s)...\n", cmake_build_type);
+    // times[0]: accepting connections, [1]: first 200, [2]: warmed up
+    long long times[3] = {0, 0, 0};
+    long long deadline_us = exec_us + (long long)SERVER_START_TIMEOUT_MS * 1000;
+    int last_status = -1, exited = 0, stopped = 0;
 
-        size_t cmake_cmd_size = strlen("cmake -DCMAKE_BUILD_TYPE= ..") + strlen(cmake_build_type) + 1;
-        char *cmake_cmd = malloc(cmake_cmd_size);
-        if (!cmake_cmd)
+    while (!times[1] && monotonic_us() < deadline_us)
+    {
+        if (forward_run_signals(&server, 1))
         {
-            printf("Error: Memory allocation failed\n");
-            chdir("..");
-            return -1;
+            stopped = 1;
+            break;
         }
 
-        snprintf(cmake_cmd, cmake_cmd_size, "cmake -DCMAKE_BUILD_TYPE=%s ..", cmake_build_type);
+        if (process_poll(server, NULL, NULL) != 0)
+        {
+            exited = 1;
+            break;
+        }
 
-        if (execute_command(cmake_cmd) != 0)
+        if (!times[0])
         {
-            printf("Error: cmake configuration failed\n");
-            free(cmake_cmd);
-            chdir("..");
-            return -1;
+            int fd = connect_to_port(run->port);
+            if (fd >= 0)
+            {
+                times[0] = monotonic_us() - exec_us;
+                close(fd);
+                continue;
+            }
+        }
+        else
+        {
+            last_status = pgo_request(run->port, "GET", run->path, NULL);
+            if (last_status == 200)
+            {
+                times[1] = monotonic_us() - exec_us;
+                continue;
+            }
         }
-        free(cmake_cmd);
+
+        sleep_ms(READY_POLL_MS);
     }
-    else
+
+    if (!times[1])
     {
-        printf("Using existing CMake cache...\n");
+        if (exited)
+            printf("Error: The server exited before it was ready\n");
+        else if (!times[0] && !stopped)
+            printf("Error: The server didn't open port %d (use --port to change it)\n", run->port);
+        else if (!stopped)
+            printf("Error: GET %s didn't answer 200 (last status: %d, use --path to change it)\n",
+                   run->path, last_status);
+        process_stop(server, WATCH_STOP_TIMEOUT_MS, NULL);
+        return -1;
     }
 
-    printf("Building (%s)...\n", cmake_build_type);
-
-    size_t build_cmd_size = strlen("cmake --build . ") + strlen(cmake_config) + 1;
-    char *build_cmd = malloc(build_cmd_size);
-    if (!build_cmd)
+    if (run->warmup)
     {
-        printf("Error: Memory allocation failed\n");
-        chdir("..");
-        return -1;
+        if (!file_exists(run->warmup))
+            printf("Warning: Warmup requests %s not found, skipping warmup\n", run->warmup);
+        else if (pgo_replay(run->warmup, run->port, run->warmup_requests) != 0)
+            printf("Warning: The warmup requests got no response\n");
+        times[2] = monotonic_us() - exec_us;
     }
 
-    snprintf(build_cmd, build_cmd_size, "cmake --build . %s", cmake_config);
+    long long previous[3];
+    record_ready_times(build_dir, times, previous);
+
+    printf("\nReady check:\n");
+    print_ready_time("listening", times[0], previous[0]);
+    print_ready_time("first 200", times[1], previous[1]);
+    if (times[2])
+        print_ready_time("warmed up", times[2], previous[2]);
+    printf("Server ready on port %d (Ctrl-C to stop)\n", run->port);
+    fflush(stdout);
+
+    return supervise_server(build_dir, program, server, run->restart);
+#endif
+}
 
-    if (execute_command(build_cmd) != 0)
+#ifndef _WIN32
+typedef struct
+{
+    int pid;       // -1 while waiting for a restart or after the last exit
+    int cpu;       // Pinned to, -1 for none
+    int listen_fd; // Own SO_REUSEPORT socket, or the shared one
+    int backoff_ms;
+    long long started;
+    long long restart_at; // 0 when no restart is due
+    int restarts;
+    int exit_code;
+    int signaled;           // The last exit was by a signal
+    ProcessUsage usage;     // Last sample
+    long long reported_cpu; // cpu_ms at the last report
+} Worker;
+
+// Start (or restart) a worker. One whose SO_REUSEPORT socket was closed
+// when it last exited gets a fresh one on port.
+static int start_worker(Worker *worker, int index, int count, int port, const char *build_dir, const char *program)
+{
+    if (worker->listen_fd < 0)
     {
-        printf("Error: Build failed\n");
-        free(build_cmd);
-        chdir("..");
-        return -1;
+        worker->listen_fd = open_listen_socket(port, 1);
+        if (worker->listen_fd < 0)
+            return -1;
     }
-    free(build_cmd);
 
-    printf("%s build completed successfully!\n", build_mode);
-    chdir("..");
-    return 0;
+    char value[16];
+    snprintf(value, sizeof(value), "%d", index);
+    setenv("ECEWO_WORKER", value, 1);
+    snprintf(value, sizeof(value), "%d", count);
+    setenv("ECEWO_WORKERS", value, 1);
+
+    char *argv[] = {(char *)program, NULL};
+    worker->pid = process_spawn_pinned(build_dir, argv, worker->listen_fd, worker->cpu);
+    worker->started = monotonic_ms();
+    worker->restart_at = 0;
+    memset(&worker->usage, 0, sizeof(worker->usage));
+    worker->reported_cpu = 0;
+    return worker->pid > 0 ? 0 : -1;
 }
 
-static int rebuild_project(build_type_t build_type)
+// One line per worker: CPU use since the last report (100% is one full
+// CPU) and memory. With final, total CPU time and peak memory instead.
+static void print_worker_usage(Worker *workers, int count, long long interval_ms, int final)
 {
-    const char *build_dir = "build";
-    const char *build_mode;
-
-    switch (build_type)
+    printf(final ? "\nWorker  CPU      CPU time  peak RSS  restarts\n"
+                 : "\nWorker  CPU      CPU use   RSS\n");
+    for (int i = 0; i < count; i++)
     {
-    case BUILD_TYPE_PROD:
-        build_mode = "Production";
-        break;
-    case BUILD_TYPE_DEV:
-    default:
-        build_mode = "Development";
-        break;
+        Worker *worker = &workers[i];
+        char cpu[16];
+        if (worker->cpu >= 0)
+            snprintf(cpu, sizeof(cpu), "%d", worker->cpu);
+        else
+            snprintf(cpu, sizeof(cpu), "any");
+
+        if (final)
+        {
+            printf("  %-5d %-8s %6.1f s  %5lld MB  %d\n", i, cpu, worker->usage.cpu_ms / 1000.0,
+                   worker->usage.peak_rss_kb / 1024, worker->restarts);
+        }
+        else
+        {
+            double percent = interval_ms > 0 ? 100.0 * (worker->usage.cpu_ms - worker->reported_cpu) / interval_ms : 0;
+            printf("  %-5d %-8s %6.1f%%  %5lld MB%s\n", i, cpu, percent, worker->usage.rss_kb / 1024,
+                   worker->pid > 0 ? "" : "  (down)");
+            worker->reported_cpu = worker->usage.cpu_ms;
+        }
     }
+    fflush(stdout);
+}
 
-    printf("Rebuilding %s build...\n", build_mode);
+#endif
+
+// Start count servers on one port, each on its own CPU, and supervise
+// them like run does: forward signals, report exits, restart crashed
+// ones with backoff. Each gets its own SO_REUSEPORT socket through
+// LISTEN_FDS, so the kernel balances connections over them, or one
+// shared socket where SO_REUSEPORT doesn't exist.
+static int workers_project(const build_options_t *options, const run_options_t *run)
+{
+#ifdef _WIN32
+    (void)options;
+    (void)run;
+    printf("Error: run --workers is not supported on Windows yet\n");
+    return -1;
+#else
+    const char *build_dir = build_tree(options->type);
 
-    printf("Cleaning build directory...\n");
-    if (remove_directory(build_dir) != 0)
+    if (!file_exists(build_dir))
     {
-        printf("Warning: Could not remove build directory (may not exist)\n");
+        printf("Build not found. Building %s version first...\n",
+               options->type == BUILD_TYPE_PROD ? "production" : "development");
+        if (build_project(options) != 0)
+            return -1;
+        printf("\n");
     }
 
-    printf("Removed build directory\n");
-    printf("\n");
+    char program[512];
+    if (server_program(program, sizeof(program)) != 0)
+        return -1;
 
-    return build_project(build_type);
-}
+    int cpus[WORKERS_MAX];
+    int cpu_count = process_cpu_list(cpus, WORKERS_MAX);
+    int count = run->workers > 0 ? run->workers : (cpu_count > 0 ? cpu_count : detect_cpu_count());
+    if (count > WORKERS_MAX)
+        count = WORKERS_MAX;
+    if (cpu_count > 0 && count > cpu_count)
+        printf("Warning: %d workers on %d CPUs, some of them share a CPU\n", count, cpu_count);
 
-static int run_project(void)
-{
-    const char *build_dir = "build";
+    Worker *workers = calloc((size_t)count, sizeof(Worker));
+    if (!workers)
+        return -1;
 
-    // Check if build folder exists
-    if (!file_exists(build_dir))
+    // Without SO_REUSEPORT the first socket already fails
+    int reuseport = 1;
+    for (int i = 0; i < count; i++)
+    {
+        workers[i].listen_fd = reuseport ? open_listen_socket(run->port, 1) : -1;
+        if (i == 0 && workers[i].listen_fd < 0)
+            reuseport = 0;
+        workers[i].cpu = cpu_count > 0 ? cpus[i % cpu_count] : -1;
+        workers[i].backoff_ms = RESTART_BACKOFF_MIN_MS;
+        workers[i].pid = -1;
+    }
+
+    if (!reuseport)
     {
-        printf("Build not found. Building development version first...\n");
-        if (build_project(BUILD_TYPE_DEV) != 0)
+        int shared_fd = open_listen_socket(run->port, 0);
+        for (int i = 0; i < count; i++)
+            workers[i].listen_fd = shared_fd;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (workers[i].listen_fd < 0)
         {
+            printf("Error: Could not listen on port %d\n", run->port);
+            for (int j = 0; j < count; j++)
+            {
+                if (workers[j].listen_fd >= 0 && (reuseport || j == 0))
+                    close(workers[j].listen_fd);
+            }
+            free(workers);
             return -1;
         }
-        printf("\n");
     }
 
-    if (chdir(build_dir) != 0)
+    install_run_signals();
+
+    int *pids = malloc((size_t)count * sizeof(int));
+    int result = pids ? 0 : -1;
+    for (int i = 0; result == 0 && i < count; i++)
     {
-        printf("Error: Cannot change to build directory: %s\n", build_dir);
-        return -1;
+        if (start_worker(&workers[i], i, count, run->port, build_dir, program) != 0)
+        {
+            printf("Error: Could not start worker %d\n", i);
+            result = -1;
+        }
     }
 
-    printf("Running server...\n");
+    // A server that binds the port itself instead of taking the socket
+    // from LISTEN_FDS finds it in use, so every worker dies at once.
+    // Restarting them would only repeat that.
+    long long startup_end = monotonic_ms() + WORKERS_STARTUP_MS;
+    int exited = 0;
+    while (result == 0 && exited < count && monotonic_ms() < startup_end)
+    {
+        sleep_ms(10);
+        exited = 0;
+        for (int i = 0; i < count; i++)
+            exited += process_exited(workers[i].pid);
+    }
 
-    // Get executable name dynamically
-    chdir("..");
-    char *exec_name = get_exec_name();
-    chdir(build_dir);
+    if (result == 0 && exited == count)
+    {
+        char description[128];
+        for (int i = 0; i < count; i++)
+            process_poll(workers[i].pid, &workers[i].exit_code, &workers[i].signaled);
+        process_describe_exit(workers[0].exit_code, workers[0].signaled, description, sizeof(description));
+        printf("Error: All %d workers exited right after starting (%s)\n", count, description);
+        printf("The server has to accept on the socket it gets through LISTEN_FDS,\n");
+        printf("one that listens on port %d by itself finds the port taken.\n", run->port);
+        for (int i = 0; i < count; i++)
+            workers[i].pid = -1;
+        result = -1;
+    }
+    else if (result == 0)
+    {
+        printf("Running %d workers on port %d (%s, LISTEN_FDS)\n", count, run->port,
+               reuseport ? "one SO_REUSEPORT socket each" : "one shared socket");
+    }
 
-    if (exec_name)
+    long long stop_requested = 0, last_sample = monotonic_ms(), last_report = last_sample;
+    int exit_code = 0;
+
+    while (result == 0)
     {
-        // Platform-specific executable path ve extension
-        size_t exec_path_size = strlen(exec_name) + 10;
-        char *exec_path = malloc(exec_path_size);
-        if (exec_path)
-        {
+        for (int i = 0; i < count; i++)
+            pids[i] = workers[i].pid;
 
-#ifdef _WIN32
-            snprintf(exec_path, exec_path_size, "%s.exe", exec_name);
-            if (file_exists(exec_path))
+        if (forward_run_signals(pids, count))
+        {
+            if (stop_requested)
             {
-                execute_command(exec_path);
+                printf("Killing the workers...\n");
+                for (int i = 0; i < count; i++)
+                {
+                    if (workers[i].pid > 0)
+                        kill((pid_t)workers[i].pid, SIGKILL);
+                }
             }
-            else
+            stop_requested = monotonic_ms();
+        }
+
+        long long now = monotonic_ms();
+        int running = 0, pending = 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            Worker *worker = &workers[i];
+
+            if (worker->pid > 0 && process_poll(worker->pid, &worker->exit_code, &worker->signaled) != 0)
             {
-                snprintf(exec_path, exec_path_size, "%s", exec_name);
-                if (file_exists(exec_path))
+                char description[128];
+                process_describe_exit(worker->exit_code, worker->signaled, description, sizeof(description));
+                worker->pid = -1;
+
+                // The kernel keeps handing connections to a SO_REUSEPORT
+                // socket nobody accepts on, where they would sit until a
+                // restart or forever
+                if (reuseport)
                 {
-                    execute_command(exec_path);
+                    close(worker->listen_fd);
+                    worker->listen_fd = -1;
                 }
-                else
+
+                if (!stop_requested)
                 {
-                    printf("Executable %s not found. Build may have failed.\n", exec_name);
-                    chdir("..");
-                    free(exec_path);
-                    free(exec_name);
-                    return -1;
+                    printf("Worker %d %s after %.1f s (%s)\n", i, worker->signaled ? "crashed" : "exited",
+                           (now - worker->started) / 1000.0, description);
+
+                    if (run->restart && worker->exit_code != 0)
+                    {
+                        if (now - worker->started >= RESTART_STABLE_MS)
+                            worker->backoff_ms = RESTART_BACKOFF_MIN_MS;
+                        printf("Restarting worker %d in %d ms...\n", i, worker->backoff_ms);
+                        worker->restart_at = now + worker->backoff_ms;
+                        worker->backoff_ms = worker->backoff_ms * 2 > RESTART_BACKOFF_MAX_MS ? RESTART_BACKOFF_MAX_MS : worker->backoff_ms * 2;
+                    }
                 }
+
+                if (worker->exit_code != 0)
+                    exit_code = worker->exit_code;
             }
-#else
-            snprintf(exec_path, exec_path_size, "./%s", exec_name);
-            if (file_exists(exec_path))
+
+            if (worker->pid < 0 && worker->restart_at && !stop_requested && now >= worker->restart_at)
             {
-                execute_command(exec_path);
+                worker->restarts++;
+                if (start_worker(worker, i, count, run->port, build_dir, program) != 0)
+                    printf("Error: Could not restart worker %d\n", i);
             }
-            else
+
+            if (worker->pid > 0)
+                running++;
+            else if (worker->restart_at && !stop_requested)
+                pending++;
+        }
+
+        if (running == 0 && pending == 0)
+            break;
+
+        if (stop_requested && now - stop_requested > WATCH_STOP_TIMEOUT_MS)
+        {
+            printf("Workers still running %d s after the signal, sending SIGTERM...\n", WATCH_STOP_TIMEOUT_MS / 1000);
+            for (int i = 0; i < count; i++)
             {
-                printf("Executable %s not found. Build may have failed.\n", exec_name);
-                chdir("..");
-                free(exec_path);
-                free(exec_name);
-                return -1;
+                if (workers[i].pid > 0)
+                    workers[i].exit_code = process_stop(workers[i].pid, WATCH_STOP_TIMEOUT_MS, &workers[i].signaled);
+                workers[i].pid = -1;
             }
-#endif
-            free(exec_path);
+            break;
         }
-        free(exec_name);
+
+        if (now - last_sample >= WORKERS_SAMPLE_MS)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                ProcessUsage usage;
+                if (workers[i].pid > 0 && process_usage(workers[i].pid, &usage) == 0)
+                    workers[i].usage = usage;
+            }
+            last_sample = now;
+
+            // Only while there is load, an idle server stays quiet
+            long long busy = 0;
+            for (int i = 0; i < count; i++)
+                busy += workers[i].usage.cpu_ms - workers[i].reported_cpu;
+            if (now - last_report >= WORKERS_REPORT_MS)
+            {
+                if (busy * 100 >= now - last_report)
+                    print_worker_usage(workers, count, now - last_report, 0);
+                else
+                    for (int i = 0; i < count; i++)
+                        workers[i].reported_cpu = workers[i].usage.cpu_ms;
+                last_report = now;
+            }
+        }
+
+        sleep_ms(10);
     }
-    else
+
+    if (stop_requested)
+        printf("Workers stopped in %lld ms\n", monotonic_ms() - stop_requested);
+
+    if (result == 0 && process_cpu_list(cpus, 1) > 0)
+        print_worker_usage(workers, count, 0, 1);
+
+    for (int i = 0; i < count; i++)
     {
-        printf("Could not determine executable name. Check CMakeLists.txt.\n");
-        chdir("..");
-        return -1;
+        if (workers[i].pid > 0)
+            process_stop(workers[i].pid, WATCH_STOP_TIMEOUT_MS, NULL);
+        if (workers[i].listen_fd >= 0 && (reuseport || i == 0))
+            close(workers[i].listen_fd);
     }
 
-    chdir("..");
-    return 0;
+    free(pids);
+    free(workers);
+    return result == 0 ? exit_code : result;
+#endif
 }
 
 int main(int argc, char *argv[])
@@ -727,47 +3420,155 @@ int main(int argc, char *argv[])
     flags_t flags;
     parse_arguments(argc, argv, &flags);
 
+    build_options_t build_options;
+    build_options.type = BUILD_TYPE_DEV;
+    build_options.jobs = flags.jobs;
+    build_options.full = flags.full;
+    build_options.timings = flags.timings;
+    memset(&build_options.profile, 0, sizeof(build_options.profile));
+    build_options.profile.lto = flags.lto || flags.optimize;
+    build_options.profile.no_plt = flags.no_plt || flags.optimize;
+    build_options.profile.gc_sections = flags.gc_sections || flags.optimize;
+    if (flags.march)
+        snprintf(build_options.profile.march, sizeof(build_options.profile.march), "%s", flags.march);
+    build_options.profile_set = flags.lto || flags.no_plt || flags.gc_sections || flags.optimize || flags.march;
+    build_options.pgo = NULL;
+    build_options.layout = NULL;
+    build_options.unity = flags.unity;
+    build_options.unity_batch = flags.unity_batch;
+
+    train_options_t train_options;
+    train_options.port = flags.port ? flags.port : DEFAULT_SERVER_PORT;
+    train_options.requests = flags.requests ? flags.requests : PGO_DEFAULT_REQUESTS;
+    train_options.workload = flags.workload;
+
     // Check if no parameters were provided
-    if ((!flags.create && !flags.run && !flags.build && !flags.rebuild && !flags.libs && !flags.install && !flags.uninstall) || (flags.help))
+    if ((!flags.create && !flags.run && !flags.bench && !flags.build && !flags.rebuild && !flags.libs && !flags.install && !flags.uninstall && !flags.cache && !flags.sync) || (flags.help))
     {
         show_help();
         return 0;
     }
 
+    if ((flags.create || flags.libs || flags.install || flags.uninstall) && registry_load() != 0)
+        return 1;
+
     // Handle create command
     if (flags.create)
     {
-        return create_project();
+        return create_project(!flags.no_cache);
     }
 
     // Handle run command
     if (flags.run)
     {
-        return run_project();
+        if (flags.run_prod)
+            build_options.type = BUILD_TYPE_PROD;
+
+        run_options_t run_options;
+        run_options.handoff = flags.handoff;
+        run_options.port = flags.port ? flags.port : DEFAULT_SERVER_PORT;
+        run_options.path = flags.path ? flags.path : "/";
+        run_options.warmup = flags.warmup;
+        run_options.warmup_requests = flags.requests ? flags.requests : WARMUP_DEFAULT_REQUESTS;
+        run_options.restart = flags.restart;
+        run_options.workers = flags.workers;
+
+        // Running a single server instead would hide the typo
+        if (flags.workers == WORKERS_INVALID)
+        {
+            printf("Error: --workers takes a count from 1 to %d or \"auto\"\n", WORKERS_MAX);
+            return 1;
+        }
+
+        if (flags.watch)
+        {
+            if (flags.workers)
+                printf("Note: --workers is ignored by run --watch\n");
+            if (flags.ready_check)
+                printf("Note: --ready-check is ignored by run --watch\n");
+            return watch_project(&build_options, &run_options);
+        }
+
+        if (flags.handoff)
+            printf("Note: --handoff only applies to restarts in run --watch\n");
+
+        if (flags.workers)
+        {
+            if (flags.ready_check)
+                printf("Note: --ready-check is ignored with --workers\n");
+            return workers_project(&build_options, &run_options);
+        }
+
+        if (flags.ready_check)
+            return ready_project(&build_options, &run_options);
+        if (flags.warmup)
+            printf("Note: --warmup needs --ready-check\n");
+
+        return run_project(&build_options, &run_options);
+    }
+
+    if (flags.bench)
+    {
+        // Benchmarks are about the production build unless asked otherwise
+        build_options.type = flags.bench_dev ? BUILD_TYPE_DEV : BUILD_TYPE_PROD;
+
+        bench_options_t bench_options;
+        bench_options.port = flags.port ? flags.port : DEFAULT_SERVER_PORT;
+        bench_options.path = flags.path ? flags.path : "/";
+        bench_options.connections = flags.connections ? flags.connections : BENCH_DEFAULT_CONNECTIONS;
+        bench_options.duration = flags.duration ? flags.duration : BENCH_DEFAULT_DURATION;
+        bench_options.rate = flags.rate;
+
+        // Leave half of the CPUs to the server
+        int cpus = detect_cpu_count();
+        bench_options.threads = flags.threads ? flags.threads : (cpus > 1 ? cpus / 2 : 1);
+        if (bench_options.threads > bench_options.connections)
+            bench_options.threads = bench_options.connections;
+
+        return bench_project(&build_options, &bench_options,
+                             flags.output ? flags.output : BENCH_DEFAULT_OUTPUT,
+                             flags.compare, flags.threshold > 0 ? flags.threshold : BENCH_DEFAULT_THRESHOLD);
     }
 
     if (flags.build)
     {
-        if (flags.build_prod)
+        if (flags.pgo)
         {
-            return build_project(BUILD_TYPE_PROD);
+            return pgo_build_project(&build_options, &train_options);
         }
-        else // build_dev or default
+
+        if (flags.layout)
         {
-            return build_project(BUILD_TYPE_DEV);
+            if (!flags.build_prod)
+                printf("Note: --layout builds the production tree\n");
+            return layout_build_project(&build_options, &train_options);
         }
+
+        if (flags.build_prod)
+            build_options.type = BUILD_TYPE_PROD;
+
+        return build_project(&build_options);
     }
 
     if (flags.rebuild)
     {
         if (flags.rebuild_prod)
-        {
-            return rebuild_project(BUILD_TYPE_PROD);
-        }
-        else // rebuild_dev or default
-        {
-            return rebuild_project(BUILD_TYPE_DEV);
-        }
+            build_options.type = BUILD_TYPE_PROD;
+
+        return rebuild_project(&build_options);
+    }
+
+    if (flags.sync)
+    {
+        return sync_project(!flags.no_cache, flags.frozen);
+    }
+
+    if (flags.cache)
+    {
+        if (flags.cache_prune)
+            return cache_prune();
+
+        return cache_stats();
     }
 
     if (flags.libs)
@@ -778,77 +3579,77 @@ int main(int argc, char *argv[])
 
     if (flags.uninstall)
     {
-        int has_plugin_arg = flags.cjson || flags.dotenv || flags.sqlite || flags.pquv || flags.session || flags.slugify || flags.cbor || flags.postgres;
-
-        if (!has_plugin_arg)
+        if (flags.library_count == 0)
         {
             show_install_help();
             return 0;
         }
 
-        if (flags.cbor)
-            uninstall_cbor();
-
-        if (flags.postgres)
-            uninstall_postgres();
-
-        if (flags.cjson)
-            uninstall_vendor("cJSON");
-
-        if (flags.dotenv)
-            uninstall_vendor("dotenv");
+        Plugin *targets[MAX_LIBRARY_ARGS];
+        for (int i = 0; i < flags.library_count; i++)
+        {
+            targets[i] = registry_find(flags.libraries[i]);
+            if (!targets[i])
+            {
+                printf("Unknown library: %s (see ecewo libs)\n", flags.libraries[i]);
+                return 1;
+            }
+        }
 
-        if (flags.session)
-            uninstall_vendor("session");
+        // Every removal edits the same in-memory CMakeLists.txt
+        CMakeFile *cmake = cmake_open("CMakeLists.txt");
+        if (!cmake && file_exists("CMakeLists.txt"))
+            return 1;
 
-        if (flags.pquv)
-            uninstall_vendor("pquv");
+        for (int i = 0; i < flags.library_count; i++)
+            uninstall_plugin(cmake, targets[i]);
 
-        if (flags.slugify)
-            uninstall_vendor("slugify");
+        check_requirements(cmake);
 
-        if (flags.sqlite)
-            uninstall_vendor("SQLite3");
+        if (cmake && cmake_commit(cmake) != 0)
+            printf("Error writing CMakeLists.txt\n");
 
+        cmake_close(cmake);
         return 0;
     }
 
     // Handle install command
     if (flags.install)
     {
-        int has_plugin_arg = flags.cjson || flags.dotenv || flags.sqlite || flags.session || flags.cbor || flags.slugify || flags.pquv || flags.postgres;
-
-        if (!has_plugin_arg)
+        if (flags.library_count == 0)
         {
             show_install_help();
             return 0;
         }
 
-        if (flags.cbor)
-            install_cbor();
-
-        if (flags.postgres)
-            install_postgres();
-
-        if (flags.cjson)
-            install_vendor("cJSON", CJSON_C_URL, CJSON_H_URL);
-
-        if (flags.dotenv)
-            install_vendor("dotenv", DOTENV_C_URL, DOTENV_H_URL);
-
-        if (flags.session)
-            install_vendor("session", SESSION_C_URL, SESSION_H_URL);
-
-        if (flags.pquv)
-            install_vendor("pquv", PQUV_C_URL, PQUV_H_URL);
-
-        if (flags.slugify)
-            install_vendor("slugify", SLUGIFY_C_URL, SLUGIFY_H_URL);
+        for (int i = 0; i < flags.library_count; i++)
+        {
+            Plugin *plugin = registry_find(flags.libraries[i]);
+            if (!plugin)
+            {
+                printf("Unknown library: %s (see ecewo libs)\n", flags.libraries[i]);
+                return 1;
+            }
+            plugin->selected = 1;
+        }
 
-        if (flags.sqlite)
-            install_vendor("sqlite", SQLITE_C_URL, SQLITE_H_URL);
+        const SqliteProfile *sqlite_profile = NULL;
+        if (flags.sqlite_profile)
+        {
+            sqlite_profile = find_sqlite_profile(flags.sqlite_profile);
+            if (!sqlite_profile)
+            {
+                printf("Unknown SQLite profile: %s (use fast, default or minimal)\n", flags.sqlite_profile);
+                return 1;
+            }
+            const Plugin *sqlite = registry_find("SQLite3");
+            if (!sqlite || !sqlite->selected)
+                printf("Note: --profile only applies to install sqlite\n");
+        }
 
-        return 0;
+        // Plan the libraries with their requirements, fetch everything at
+        // once, then update CMakeLists.txt
+        return install_selected_plugins(!flags.no_cache, sqlite_profile) == 0 ? 0 : 1;
     }
 
     return 0;
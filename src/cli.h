@@ -1,56 +1,87 @@
+#ifndef _WIN32
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #ifdef _WIN32
 #include <direct.h>
 #include <io.h>
 #include <conio.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
 #define PATH_SEPARATOR "\\"
 #define mkdir(path, mode) _mkdir(path)
 #define access(path, mode) _access(path, mode)
 #define F_OK 0
 #define system_command(cmd) system(cmd)
+#define popen _popen
+#define pclose _pclose
+#define POPEN_READ_MODE "rb"
+#define NULL_DEVICE "nul"
 
 #else
 #include <unistd.h>
 #include <termios.h>
 #define PATH_SEPARATOR "/"
 #define system_command(cmd) system(cmd)
+#define POPEN_READ_MODE "r"
+#define NULL_DEVICE "/dev/null"
 #endif
 
 #define REPO_URL "https://github.com/savashn/ecewo"
+#define ECEWO_GIT_URL "https://github.com/savashn/ecewo.git"
+
+#define LOCK_FILE "ecewo.lock"
+#define PLUGINS_FILE "ecewo.plugins"
+#define SHA256_HEX_SIZE 65
+#define REVISION_SIZE 41
 
-#define CJSON_C_URL "https://raw.githubusercontent.com/DaveGamble/cJSON/master/cJSON.c"
-#define CJSON_H_URL "https://raw.githubusercontent.com/DaveGamble/cJSON/master/cJSON.h"
-#define DOTENV_C_URL "https://raw.githubusercontent.com/Isty001/dotenv-c/master/src/dotenv.c"
-#define DOTENV_H_URL "https://raw.githubusercontent.com/Isty001/dotenv-c/master/src/dotenv.h"
-#define SESSION_C_URL "https://raw.githubusercontent.com/savashn/ecewo-session/main/session.c"
-#define SESSION_H_URL "https://raw.githubusercontent.com/savashn/ecewo-session/main/session.h"
-#define SLUGIFY_C_URL "https://raw.githubusercontent.com/savashn/slugify-c/main/slugify.c"
-#define SLUGIFY_H_URL "https://raw.githubusercontent.com/savashn/slugify-c/main/slugify.h"
-#define PQUV_C_URL "https://raw.githubusercontent.com/savashn/pquv/main/pquv.c"
-#define PQUV_H_URL "https://raw.githubusercontent.com/savashn/pquv/main/pquv.h"
-#define SQLITE_C_URL "https://raw.githubusercontent.com/rhuijben/sqlite-amalgamation/master/sqlite3.c"
-#define SQLITE_H_URL "https://raw.githubusercontent.com/rhuijben/sqlite-amalgamation/master/sqlite3.h"
+// Maximum number of transfers in flight during a batch download
+#define DOWNLOAD_MAX_PARALLEL 6
 
+#define PLUGIN_MAX_REQUIRES 8
+
+// A library ecewo install can add, as described by the plugin registry
 typedef struct
 {
-    const char *name;
-    const char *c_url;
-    const char *h_url;
+    char *id;          // Word used on the command line
+    char *name;        // Block in CMakeLists.txt, file name under vendors/
+    char *description;
+    char *version;     // Branch or tag the URLs and git revision follow
+    char *c_url;       // NULL for libraries that are only CMake lines
+    char *h_url;
+    char c_sha256[SHA256_HEX_SIZE]; // Expected content, empty to accept any
+    char h_sha256[SHA256_HEX_SIZE];
+    size_t c_size; // Approximate size in bytes, used to schedule downloads
+    size_t h_size;
+    char *git_url; // Fetched by CMake at the commit version points at
+    char *cmake;   // Lines of the CMakeLists.txt block
+    char *requires[PLUGIN_MAX_REQUIRES];
+    int require_count;
     int selected;
 } Plugin;
 
-extern Plugin plugins[];
-extern const int plugin_count;
+extern Plugin *plugins;
+extern int plugin_count;
+
+// Libraries named on one install or uninstall command line
+#define MAX_LIBRARY_ARGS 32
 
 // Command flags
 typedef struct
 {
     int run;
+    int run_prod;
     int build;
     int build_dev;
     int build_prod;
@@ -62,14 +93,46 @@ typedef struct
     int uninstall;
     int create;
     int help;
-    int cjson;
-    int dotenv;
-    int sqlite;
-    int postgres;
-    int session;
-    int pquv;
-    int slugify;
-    int cbor;
+    const char *libraries[MAX_LIBRARY_ARGS];
+    int library_count;
+    int cache;
+    int cache_stats;
+    int cache_prune;
+    int no_cache;
+    int sync;
+    int frozen;
+    int jobs;
+    int full;
+    int watch;
+    int handoff;
+    int port;
+    int lto;
+    int no_plt;
+    int gc_sections;
+    int optimize;
+    const char *march;
+    int pgo;
+    int layout;
+    int requests;
+    const char *workload;
+    int bench;
+    int bench_dev;
+    int connections;
+    int threads;
+    int duration;
+    double rate;
+    const char *path;
+    const char *output;
+    const char *compare;
+    double threshold;
+    int timings;
+    int ready_check;
+    const char *warmup;
+    int restart;
+    int workers; // -1 for one per CPU, -2 for an invalid count
+    const char *sqlite_profile;
+    int unity; // 1 for --unity, -1 for --no-unity
+    int unity_batch;
 } flags_t;
 
 typedef struct
@@ -79,12 +142,146 @@ typedef struct
     size_t capacity;
 } StringBuilder;
 
+typedef enum
+{
+    HTTP_OK = 0,
+    HTTP_ERR_URL,
+    HTTP_ERR_RESOLVE,
+    HTTP_ERR_CONNECT,
+    HTTP_ERR_TLS,
+    HTTP_ERR_SEND,
+    HTTP_ERR_RECV,
+    HTTP_ERR_PROTOCOL,
+    HTTP_ERR_STATUS,
+    HTTP_ERR_REDIRECT,
+    HTTP_ERR_WRITE,
+    HTTP_ERR_NO_TLS
+} http_error_t;
+
+typedef struct HttpClient HttpClient;
+
+// Optimizations of a production build, recorded in its build tree
+#define PROFILE_FILE "ecewo-profile"
+#define MARCH_SIZE 64
+
+// Profile-guided optimization data, kept at the project root
+#define PGO_DIR "pgo"
+#define PGO_REQUESTS_FILE "pgo" PATH_SEPARATOR "requests.txt"
+#define PGO_MODE_SIZE 16
+#define PGO_GENERATE "generate"
+
+// Post-link code layout, its function order kept next to the PGO data
+#define LAYOUT_ORDER_FILE "symbol-order.txt"
+#define LAYOUT_SECTION_ORDER_FILE "section-order.txt"
+#define LAYOUT_MODE_SIZE 16
+#define LAYOUT_GPROF "gprof"
+#define LAYOUT_BOLT "bolt"
+
+typedef struct
+{
+    int lto;         // Interprocedural optimization for every target
+    int no_plt;      // -fno-plt -fno-semantic-interposition
+    int gc_sections; // Per-function/data sections, unused ones dropped
+    char march[MARCH_SIZE];
+    char pgo[PGO_MODE_SIZE]; // PGO_GENERATE while training, then the compiler of the data
+    char layout[LAYOUT_MODE_SIZE]; // LAYOUT_GPROF while profiling, LAYOUT_BOLT, or the ordering linker
+} BuildProfile;
+
+// Unity builds: the project's exclusion list, and the batch size a
+// build tree was configured with
+#define UNITY_EXCLUDE_FILE "ecewo.unity"
+#define UNITY_FILE "ecewo-unity"
+#define UNITY_MIN_BATCH_SIZE 4
+#define UNITY_DEFAULT_MAX_BATCH_SIZE 16
+#define UNITY_MAX_BATCH_SIZE 256
+
+// Build timings, their history kept in the build tree
+#define TIMINGS_HISTORY_FILE "ecewo-timings"
+#define TIMINGS_CONFIGURE_TRACE "ecewo-configure-trace.json"
+
+typedef struct
+{
+    long long configure_ms; // 0 when the existing configuration was used
+    long long build_ms;
+    long long work_ms; // Sum of all build steps, what one job would have taken
+    int steps;         // Build steps that ran, 0 if unknown
+    int jobs;
+} BuildTimings;
+
+// Load generator settings of ecewo bench
+typedef struct
+{
+    int port;
+    const char *path;
+    int threads;
+    int connections;
+    int duration; // Seconds
+    double rate;  // Requests per second over all threads, 0 for closed loop
+} bench_options_t;
+
+// Latencies are in microseconds
+typedef struct
+{
+    long long requests;
+    long long errors;        // 4xx and 5xx responses
+    long long socket_errors; // Failed connects, resets, malformed responses
+    long long backlog_max;   // Open loop: most due requests without a free connection
+    double elapsed;
+    double throughput;
+    double latency_mean;
+    long long latency_min;
+    long long latency_max;
+    long long latency_p50;
+    long long latency_p90;
+    long long latency_p99;
+    long long latency_p999;
+} BenchResult;
+
+// Resource use of a child process
+typedef struct
+{
+    long long cpu_ms; // User and system time so far
+    long long rss_kb;
+    long long peak_rss_kb;
+} ProcessUsage;
+
+// Recursive file change watcher
+typedef struct Watcher Watcher;
+
+// CMakeLists.txt opened for editing
+typedef struct CMakeFile CMakeFile;
+
+typedef struct
+{
+    const char *url;
+    const char *output_path;
+    size_t size_hint;
+    const char *etag; // Sent as If-None-Match when set
+    int result;
+    http_error_t error;
+    int status; // HTTP status, 304 when the file was unchanged
+    char response_etag[256];
+    char sha256[SHA256_HEX_SIZE];
+} DownloadJob;
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t buffer_len;
+} Sha256;
+
 // UTILS
 int file_exists(const char *path);
 int create_directory(const char *path);
 int remove_directory(const char *path);
-int download_file(const char *url, const char *output_path);
+int directory_exists(const char *path);
+int clean_directory(const char *path, const char **keep, int keep_count);
 int execute_command(const char *command);
+void sleep_ms(int milliseconds);
+long long monotonic_ms(void);
+long long monotonic_us(void);
 int write_file(const char *filename, const char *content);
 StringBuilder *sb_create(void);
 void sb_append(StringBuilder *sb, const char *str);
@@ -94,6 +291,154 @@ char *read_file(const char *filename);
 char *get_exec_name(void);
 void build_vendor_path(char *buffer, size_t buffer_size, const char *plugin_name, const char *extension);
 
+// DOWNLOAD
+int download_batch(DownloadJob *jobs, int count, int max_parallel);
+http_error_t download_file(const char *url, const char *output_path);
+
+// HTTP
+HttpClient *http_client_create(void);
+void http_client_free(HttpClient *client);
+http_error_t http_download(HttpClient *client, DownloadJob *job);
+const char *http_strerror(http_error_t error);
+
+typedef struct
+{
+    char *name;
+    char *url;
+    char *revision;
+    char *etag;
+    char sha256[SHA256_HEX_SIZE];
+} LockEntry;
+
+typedef struct
+{
+    LockEntry *entries;
+    int count;
+    int capacity;
+} Lockfile;
+
+// CACHE
+int cache_fetch(const char *url, const char *dest, char hash[SHA256_HEX_SIZE]);
+int cache_store(const char *url, const char *path);
+void cache_record(int hits, int misses);
+int cache_stats(void);
+int cache_prune(void);
+int cache_dir(char *buffer, size_t buffer_size, const char *sub);
+
+// TOOLCHAIN
+int find_program(const char *name);
+const char *detect_generator(void);
+int detect_cpu_count(void);
+long long detect_available_memory_mb(void);
+int choose_build_jobs(int cpus, long long memory_mb, int heavy);
+char *cmake_cache_value(const char *cache_path, const char *key);
+const char *detect_compiler_launcher(void);
+int profile_load(BuildProfile *profile, const char *path);
+int profile_save(const BuildProfile *profile, const char *path);
+int profile_equal(const BuildProfile *a, const BuildProfile *b);
+void profile_describe(const BuildProfile *profile, char *buffer, size_t buffer_size);
+void profile_cmake_args(const BuildProfile *profile, const char *pgo_dir, StringBuilder *sb);
+int prepare_compiler_cache(const char *launcher, char *dir, size_t dir_size);
+int compiler_cache_counts(const char *launcher, long *hits, long *misses);
+
+// WATCH
+Watcher *watcher_create(const char **dirs, int dir_count, const char **files, int file_count);
+int watcher_wait(Watcher *watcher, int timeout_ms);
+void watcher_free(Watcher *watcher);
+
+// PROCESS
+int open_listen_socket(int port, int reuseport);
+int connect_to_port(int port);
+int listen_socket_pending(int fd);
+void close_listen_socket(int fd);
+int process_wait_port(int pid, int port, int timeout_ms);
+int process_spawn(const char *work_dir, char *const argv[], int listen_fd);
+int process_spawn_pinned(const char *work_dir, char *const argv[], int listen_fd, int cpu);
+int process_start(const char *work_dir, const char *program, int listen_fd);
+int process_poll(int pid, int *exit_code, int *signaled);
+int process_stop(int pid, int timeout_ms, int *signaled);
+int process_exited(int pid);
+int process_cpu_list(int *cpus, int max);
+int process_usage(int pid, ProcessUsage *usage);
+void process_describe_exit(int exit_code, int signaled, char *buffer, size_t buffer_size);
+
+// PGO
+int pgo_reset(const char *dir);
+const char *pgo_merge(const char *dir);
+int pgo_record_sources(const char *dir);
+int pgo_source_drift(const char *dir);
+int pgo_request(int port, const char *method, const char *target, const char *body);
+int pgo_replay(const char *requests_path, int port, int total);
+
+// LAYOUT
+const char *layout_linker(void);
+int layout_perf_has_lbr(void);
+long layout_text_size(const char *binary);
+int layout_snapshot(const char *binary, const char *snapshot);
+int layout_hot_pages(const char *snapshot, const char *dir, int limit);
+int layout_order_from_perf(const char *dir, const char *perf_data);
+int layout_order_from_gprof(const char *dir, const char *binary, const char *gmon);
+int layout_bolt(const char *binary, const char *perf_data, int lbr);
+double layout_icache_mpki(const char *perf_stat_output);
+
+// LOAD GENERATOR
+int bench_run(const bench_options_t *options, BenchResult *result);
+void bench_print(const BenchResult *result);
+int bench_save_json(const bench_options_t *options, const BenchResult *result, const char *path);
+int bench_load_json(const char *path, BenchResult *result);
+int bench_compare(const BenchResult *baseline, const BenchResult *current, double threshold);
+
+// BUILD TIMINGS
+int timings_trace_supported(void);
+void timings_configure_report(const char *trace_path, int limit);
+long long timings_log_mark(void);
+int timings_build_report(long long mark, int limit, BuildTimings *timings);
+int timings_record(const char *path, const BuildTimings *timings);
+
+// UNITY BUILD
+int unity_update_exclusions(void);
+int unity_batch_size(int jobs);
+int unity_load(const char *path);
+int unity_save(const char *path, int batch);
+
+// CMAKE EDIT
+CMakeFile *cmake_open(const char *path);
+const char *cmake_exec_name(const CMakeFile *cmake);
+int cmake_contains(const CMakeFile *cmake, const char *needle);
+int cmake_has_block(const CMakeFile *cmake, const char *name);
+int cmake_append_block(CMakeFile *cmake, const char *name, const char *body);
+int cmake_remove_block(CMakeFile *cmake, const char *name, const char *end_line);
+int cmake_commit(CMakeFile *cmake);
+void cmake_close(CMakeFile *cmake);
+char *cmake_find_exec_name(const char *content);
+
+// SHA-256
+void sha256_init(Sha256 *ctx);
+void sha256_update(Sha256 *ctx, const void *data, size_t len);
+void sha256_final_hex(Sha256 *ctx, char hex[SHA256_HEX_SIZE]);
+void sha256_string_hex(const char *str, char hex[SHA256_HEX_SIZE]);
+int sha256_file_hex(const char *path, char hex[SHA256_HEX_SIZE]);
+
+// LOCKFILE
+int lock_load(Lockfile *lock, const char *path);
+int lock_save(const Lockfile *lock, const char *path);
+LockEntry *lock_find(Lockfile *lock, const char *name);
+LockEntry *lock_set(Lockfile *lock, const char *name, const char *url,
+                    const char *revision, const char *etag, const char *sha256);
+void lock_remove(Lockfile *lock, const char *name);
+void lock_free(Lockfile *lock);
+int lock_record_git(const char *name, const char *repo_url, const char *revision);
+int lock_forget(const char *name);
+int resolve_git_revision(const char *repo_url, const char *ref, char *revision, size_t revision_size);
+void resolve_url_revisions(const char **urls, int count, char (*revisions)[REVISION_SIZE]);
+int pin_url(const char *url, const char *revision, char *pinned, size_t pinned_size);
+
+// PLUGIN REGISTRY
+int registry_load(void);
+Plugin *registry_find(const char *id);
+int registry_plan(Plugin **plan);
+void registry_cmake_lines(const Plugin *plugin, const char *exec_name, const char *revision, StringBuilder *sb);
+
 // SELECT MENU
 void clear_screen(void);
 void draw_menu(int current);
@@ -104,8 +449,3 @@ void interactive_select(void);
 void show_install_help(void);
 void show_help(void);
 
-// LIBRARIES
-int install_cbor(void);
-int uninstall_cbor(void);
-int install_postgres(void);
-int uninstall_postgres(void);
@@ -0,0 +1,506 @@
+#include "cli.h"
+#include <dirent.h>
+#include <fcntl.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+// Layout of the shared vendor cache:
+//   <root>/objects/<sha256 of content>   read-only file contents
+//   <root>/urls/<sha256 of url>          "<content hash>\n<url>\n"
+//   <root>/stats                         "<hits> <misses>\n"
+//   <root>/stats.lock                    held while stats is updated
+// URL entries are touched on every hit so prune can tell which ones are
+// still in use.
+
+// Unused URL entries older than this are dropped by `ecewo cache prune`
+#define CACHE_MAX_AGE_DAYS 30
+
+static int cache_path(char *buffer, size_t buffer_size, const char *sub, const char *name)
+{
+    const char *base = getenv("ECEWO_CACHE_DIR");
+    int written;
+
+    if (base && *base)
+    {
+        written = snprintf(buffer, buffer_size, "%s", base);
+    }
+    else
+    {
+#ifdef _WIN32
+        base = getenv("LOCALAPPDATA");
+        if (!base)
+            return -1;
+        written = snprintf(buffer, buffer_size, "%s\\ecewo\\cache", base);
+#else
+        base = getenv("XDG_CACHE_HOME");
+        if (base && *base)
+        {
+            written = snprintf(buffer, buffer_size, "%s/ecewo", base);
+        }
+        else
+        {
+            base = getenv("HOME");
+            if (!base)
+                return -1;
+            written = snprintf(buffer, buffer_size, "%s/.cache/ecewo", base);
+        }
+#endif
+    }
+
+    if (written < 0 || (size_t)written >= buffer_size)
+        return -1;
+
+    if (sub)
+        written += snprintf(buffer + written, buffer_size - written, "%s%s", PATH_SEPARATOR, sub);
+    if (name)
+        written += snprintf(buffer + written, buffer_size - written, "%s%s", PATH_SEPARATOR, name);
+
+    return (size_t)written < buffer_size ? 0 : -1;
+}
+
+// Directory under the shared cache root, e.g. for the compiler cache
+int cache_dir(char *buffer, size_t buffer_size, const char *sub)
+{
+    return cache_path(buffer, buffer_size, sub, NULL);
+}
+
+static int copy_file(const char *src, const char *dst)
+{
+    FILE *in = fopen(src, "rb");
+    if (!in)
+        return -1;
+
+    FILE *out = fopen(dst, "wb");
+    if (!out)
+    {
+        fclose(in);
+        return -1;
+    }
+
+    char chunk[16384];
+    size_t n;
+    int result = 0;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0)
+    {
+        if (fwrite(chunk, 1, n, out) != n)
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    if (ferror(in))
+        result = -1;
+
+    fclose(in);
+    if (fclose(out) != 0)
+        result = -1;
+
+    return result;
+}
+
+// Put a cached object at dst: a reflink when the filesystem can share
+// extents, a hardlink when it can't, and a plain copy as a last resort
+static int place_file(const char *src, const char *dst)
+{
+    remove(dst);
+
+#ifdef __linux__
+    int src_fd = open(src, O_RDONLY);
+    if (src_fd >= 0)
+    {
+        int dst_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (dst_fd >= 0)
+        {
+            int cloned = ioctl(dst_fd, FICLONE, src_fd) == 0;
+            close(dst_fd);
+            close(src_fd);
+            if (cloned)
+                return 0;
+            remove(dst);
+        }
+        else
+        {
+            close(src_fd);
+        }
+    }
+#endif
+
+#ifndef _WIN32
+    // Objects are read-only, so a hardlink can't be edited through by accident
+    if (link(src, dst) == 0)
+        return 0;
+#endif
+
+    return copy_file(src, dst);
+}
+
+static int read_url_entry(const char *entry_path, const char *url, char hash[SHA256_HEX_SIZE])
+{
+    char *content = read_file(entry_path);
+    if (!content)
+        return -1;
+
+    char *newline = strchr(content, '\n');
+    if (!newline || newline - content != SHA256_HEX_SIZE - 1)
+    {
+        free(content);
+        return -1;
+    }
+
+    *newline = '\0';
+    char *stored_url = newline + 1;
+    char *end = strchr(stored_url, '\n');
+    if (end)
+        *end = '\0';
+
+    if (url && strcmp(stored_url, url) != 0)
+    {
+        free(content);
+        return -1;
+    }
+
+    memcpy(hash, content, SHA256_HEX_SIZE);
+    free(content);
+    return 0;
+}
+
+// Copy the cached content for url to dest. Returns 0 on a hit and
+// stores the hash of the placed file in hash when it is not NULL.
+int cache_fetch(const char *url, const char *dest, char hash[SHA256_HEX_SIZE])
+{
+    char url_hash[SHA256_HEX_SIZE];
+    char content_hash[SHA256_HEX_SIZE];
+    char entry_path[1024];
+    char object_path[1024];
+
+    sha256_string_hex(url, url_hash);
+    if (cache_path(entry_path, sizeof(entry_path), "urls", url_hash) != 0)
+        return -1;
+
+    if (read_url_entry(entry_path, url, content_hash) != 0)
+        return -1;
+
+    if (cache_path(object_path, sizeof(object_path), "objects", content_hash) != 0)
+        return -1;
+
+    if (!file_exists(object_path))
+    {
+        remove(entry_path);
+        return -1;
+    }
+
+    if (place_file(object_path, dest) != 0)
+        return -1;
+
+    // The object is named after its content, but disk errors or an edit
+    // through a hardlinked vendor file can change it since. What counts
+    // is what landed in dest; a damaged object is dropped and refetched.
+    char placed_hash[SHA256_HEX_SIZE];
+    if (sha256_file_hex(dest, placed_hash) != 0 || strcmp(placed_hash, content_hash) != 0)
+    {
+        printf("Warning: Cached copy of %s is damaged, downloading it again\n", dest);
+        remove(dest);
+        remove(object_path);
+        remove(entry_path);
+        return -1;
+    }
+
+    if (hash)
+        memcpy(hash, placed_hash, SHA256_HEX_SIZE);
+
+    // Rewrite the entry to mark it as recently used for prune
+    char entry[SHA256_HEX_SIZE + 1024];
+    snprintf(entry, sizeof(entry), "%s\n%s\n", content_hash, url);
+    write_file(entry_path, entry);
+
+    return 0;
+}
+
+// Add a freshly downloaded file to the cache under url
+int cache_store(const char *url, const char *path)
+{
+    char url_hash[SHA256_HEX_SIZE];
+    char content_hash[SHA256_HEX_SIZE];
+    char dir[1024];
+    char entry_path[1024];
+    char object_path[1024];
+    char tmp_path[1100];
+
+    if (cache_path(dir, sizeof(dir), "objects", NULL) != 0 || create_directory(dir) != 0)
+        return -1;
+    if (cache_path(dir, sizeof(dir), "urls", NULL) != 0 || create_directory(dir) != 0)
+        return -1;
+
+    if (sha256_file_hex(path, content_hash) != 0)
+        return -1;
+
+    if (cache_path(object_path, sizeof(object_path), "objects", content_hash) != 0)
+        return -1;
+
+    if (!file_exists(object_path))
+    {
+        // Write under a temporary name so a concurrent reader never sees half a file
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", object_path);
+        if (copy_file(path, tmp_path) != 0)
+        {
+            remove(tmp_path);
+            return -1;
+        }
+        chmod(tmp_path, 0444);
+        if (rename(tmp_path, object_path) != 0)
+        {
+            remove(tmp_path);
+            return -1;
+        }
+    }
+
+    sha256_string_hex(url, url_hash);
+    if (cache_path(entry_path, sizeof(entry_path), "urls", url_hash) != 0)
+        return -1;
+
+    char entry[SHA256_HEX_SIZE + 1024];
+    snprintf(entry, sizeof(entry), "%s\n%s\n", content_hash, url);
+    return write_file(entry_path, entry);
+}
+
+static void read_stats(long *hits, long *misses)
+{
+    char stats_path[1024];
+    *hits = 0;
+    *misses = 0;
+
+    if (cache_path(stats_path, sizeof(stats_path), "stats", NULL) != 0)
+        return;
+
+    char *content = read_file(stats_path);
+    if (!content)
+        return;
+
+    if (sscanf(content, "%ld %ld", hits, misses) != 2)
+    {
+        *hits = 0;
+        *misses = 0;
+    }
+    free(content);
+}
+
+// Add to the hit and miss counters. Installs running side by side each
+// add their own counts: the update is made under a lock on stats.lock and
+// the new counters written to a temporary file renamed over stats.
+void cache_record(int hits, int misses)
+{
+    char stats_path[1024];
+    char lock_path[1100];
+    char temp_path[1100];
+    char root[1024];
+    long total_hits, total_misses;
+
+    if (hits == 0 && misses == 0)
+        return;
+
+    if (cache_path(root, sizeof(root), NULL, NULL) != 0 || create_directory(root) != 0)
+        return;
+    if (cache_path(stats_path, sizeof(stats_path), "stats", NULL) != 0)
+        return;
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", stats_path);
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld", stats_path, (long)getpid());
+
+#ifndef _WIN32
+    int lock_fd = open(lock_path, O_WRONLY | O_CREAT, 0644);
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    if (lock_fd < 0 || fcntl(lock_fd, F_SETLKW, &lock) != 0)
+    {
+        if (lock_fd >= 0)
+            close(lock_fd);
+        return;
+    }
+#endif
+
+    read_stats(&total_hits, &total_misses);
+
+    char line[64];
+    snprintf(line, sizeof(line), "%ld %ld\n", total_hits + hits, total_misses + misses);
+    int written = write_file(temp_path, line) == 0;
+#ifdef _WIN32
+    if (written)
+        remove(stats_path);
+#endif
+    if (!written || rename(temp_path, stats_path) != 0)
+        remove(temp_path);
+
+#ifndef _WIN32
+    close(lock_fd);
+#endif
+}
+
+static void format_size(double bytes, char *buffer, size_t buffer_size)
+{
+    const char *units[] = {"B", "KB", "MB", "GB"};
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 3)
+    {
+        bytes /= 1024.0;
+        unit++;
+    }
+    snprintf(buffer, buffer_size, "%.1f %s", bytes, units[unit]);
+}
+
+int cache_stats(void)
+{
+    char root[1024];
+    char objects_dir[1024];
+    char object_path[2048];
+    char size[32];
+    long hits, misses;
+    long count = 0;
+    double total = 0;
+
+    if (cache_path(root, sizeof(root), NULL, NULL) != 0 ||
+        cache_path(objects_dir, sizeof(objects_dir), "objects", NULL) != 0)
+    {
+        printf("Error: Could not determine the cache directory\n");
+        return -1;
+    }
+
+    DIR *dir = opendir(objects_dir);
+    if (dir)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            struct stat st;
+            snprintf(object_path, sizeof(object_path), "%s%s%s", objects_dir, PATH_SEPARATOR, entry->d_name);
+            if (stat(object_path, &st) == 0)
+            {
+                total += (double)st.st_size;
+                count++;
+            }
+        }
+        closedir(dir);
+    }
+
+    read_stats(&hits, &misses);
+    format_size(total, size, sizeof(size));
+
+    printf("Cache directory: %s\n", root);
+    printf("Objects:         %ld\n", count);
+    printf("Disk usage:      %s\n", size);
+    printf("Hits:            %ld\n", hits);
+    printf("Misses:          %ld\n", misses);
+    if (hits + misses > 0)
+        printf("Hit rate:        %.1f%%\n", 100.0 * hits / (hits + misses));
+    else
+        printf("Hit rate:        n/a\n");
+
+    return 0;
+}
+
+// Drop URL entries that haven't been used for CACHE_MAX_AGE_DAYS, then
+// every object that no remaining entry points at
+int cache_prune(void)
+{
+    char urls_dir[1024];
+    char objects_dir[1024];
+    char path[2048];
+    char hash[SHA256_HEX_SIZE];
+    time_t cutoff = time(NULL) - (time_t)CACHE_MAX_AGE_DAYS * 24 * 60 * 60;
+    long removed_entries = 0;
+    long removed_objects = 0;
+    double freed = 0;
+
+    if (cache_path(urls_dir, sizeof(urls_dir), "urls", NULL) != 0 ||
+        cache_path(objects_dir, sizeof(objects_dir), "objects", NULL) != 0)
+    {
+        printf("Error: Could not determine the cache directory\n");
+        return -1;
+    }
+
+    // Collect live object hashes while walking the URL entries
+    size_t live_count = 0;
+    size_t live_capacity = 64;
+    char (*live)[SHA256_HEX_SIZE] = malloc(live_capacity * SHA256_HEX_SIZE);
+    if (!live)
+        return -1;
+
+    DIR *dir = opendir(urls_dir);
+    if (dir)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            struct stat st;
+            snprintf(path, sizeof(path), "%s%s%s", urls_dir, PATH_SEPARATOR, entry->d_name);
+            if (stat(path, &st) != 0)
+                continue;
+
+            if (st.st_mtime < cutoff || read_url_entry(path, NULL, hash) != 0)
+            {
+                if (remove(path) == 0)
+                    removed_entries++;
+                continue;
+            }
+
+            if (live_count == live_capacity)
+            {
+                live_capacity *= 2;
+                char (*grown)[SHA256_HEX_SIZE] = realloc(live, live_capacity * SHA256_HEX_SIZE);
+                if (!grown)
+                {
+                    closedir(dir);
+                    free(live);
+                    return -1;
+                }
+                live = grown;
+            }
+            memcpy(live[live_count++], hash, SHA256_HEX_SIZE);
+        }
+        closedir(dir);
+    }
+
+    dir = opendir(objects_dir);
+    if (dir)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            int referenced = 0;
+            for (size_t i = 0; i < live_count && !referenced; i++)
+                referenced = strcmp(live[i], entry->d_name) == 0;
+
+            if (referenced)
+                continue;
+
+            struct stat st;
+            snprintf(path, sizeof(path), "%s%s%s", objects_dir, PATH_SEPARATOR, entry->d_name);
+            if (stat(path, &st) == 0 && remove(path) == 0)
+            {
+                freed += (double)st.st_size;
+                removed_objects++;
+            }
+        }
+        closedir(dir);
+    }
+
+    free(live);
+
+    char size[32];
+    format_size(freed, size, sizeof(size));
+    printf("Pruned %ld URL entries and %ld objects, freed %s\n", removed_entries, removed_objects, size);
+    return 0;
+}
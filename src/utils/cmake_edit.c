@@ -0,0 +1,584 @@
+// realpath() is an XSI extension in glibc
+#ifndef _WIN32
+#define _XOPEN_SOURCE 700
+#endif
+#include "cli.h"
+#include <errno.h>
+#include <fcntl.h>
+
+// CMakeLists.txt is edited as a list of blocks. A block starts at a
+// "# Name" comment in the first column and runs until the next one, which
+// is exactly how install writes its sections ("# cJSON", "# TinyCBOR",
+// "# Vendors include directory", ...). Everything before the first such
+// comment is the preamble. Blocks are slices of the file as it was read
+// and are only copied once they change, so parsing allocates nothing per
+// block and untouched parts of the file are written back byte for byte.
+//
+// A command opens the file once, applies all of its edits in memory and
+// commits once. The file is locked git-style: "CMakeLists.txt.lock" is
+// created and locked, the new content is written into it and it is then
+// renamed over CMakeLists.txt, so readers never see a half written file
+// and two ecewo processes can't interleave their edits.
+
+#define CMAKE_LOCK_WAIT_MS 5000
+
+typedef struct
+{
+    const char *name; // Header comment without "# ", NULL for the preamble
+    size_t name_len;
+    char *text; // Header line and body, including the trailing newline
+    size_t len;
+    int owned; // text (and name) were allocated for this block
+} CMakeBlock;
+
+struct CMakeFile
+{
+    char *path;
+    char *lock_path;
+    int lock_fd;
+    char *exec_name;
+    char *content; // File as read, blocks point into it
+    CMakeBlock *blocks;
+    int count;
+    int capacity;
+    int dirty;
+};
+
+static char *copy_range(const char *start, size_t len)
+{
+    char *copy = malloc(len + 1);
+    if (!copy)
+        return NULL;
+    memcpy(copy, start, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static int add_block(CMakeFile *cmake, const char *name, size_t name_len, char *text, size_t len, int owned)
+{
+    if (cmake->count == cmake->capacity)
+    {
+        int capacity = cmake->capacity ? cmake->capacity * 2 : 32;
+        CMakeBlock *grown = realloc(cmake->blocks, sizeof(CMakeBlock) * capacity);
+        if (!grown)
+            return -1;
+        cmake->blocks = grown;
+        cmake->capacity = capacity;
+    }
+
+    CMakeBlock *block = &cmake->blocks[cmake->count++];
+    block->name = name;
+    block->name_len = name_len;
+    block->text = text;
+    block->len = len;
+    block->owned = owned;
+    return 0;
+}
+
+// Give a block its own copy of its text with room for extra more bytes
+static int own_block(CMakeBlock *block, size_t extra)
+{
+    char *text = block->owned ? realloc(block->text, block->len + extra + 1)
+                              : malloc(block->len + extra + 1);
+    if (!text)
+        return -1;
+
+    if (!block->owned)
+    {
+        memcpy(text, block->text, block->len);
+        if (block->name)
+            block->name = text + (block->name - block->text);
+    }
+    else if (block->name)
+    {
+        block->name = text + (block->name - block->text);
+    }
+
+    block->text = text;
+    block->text[block->len] = '\0';
+    block->owned = 1;
+    return 0;
+}
+
+// Single pass over the file: cut it at every "# " line in column 0
+static int parse_blocks(CMakeFile *cmake, char *content)
+{
+    char *block_start = content;
+    const char *name = NULL;
+    size_t name_len = 0;
+    char *line = content;
+
+    while (*line)
+    {
+        char *line_end = strchr(line, '\n');
+        char *next = line_end ? line_end + 1 : line + strlen(line);
+
+        if (line[0] == '#' && line[1] == ' ' && line != block_start)
+        {
+            if (add_block(cmake, name, name_len, block_start, (size_t)(line - block_start), 0) != 0)
+                return -1;
+            block_start = line;
+        }
+
+        if (line == block_start && line[0] == '#' && line[1] == ' ')
+        {
+            name = line + 2;
+            name_len = (size_t)((line_end ? line_end : next) - name);
+            if (name_len > 0 && name[name_len - 1] == '\r')
+                name_len--;
+        }
+        else if (line == block_start)
+        {
+            name = NULL;
+        }
+
+        line = next;
+    }
+
+    if (line > block_start || cmake->count == 0)
+        return add_block(cmake, name, name_len, block_start, (size_t)(line - block_start), 0);
+
+    return 0;
+}
+
+// Executable name from the first add_executable( in content
+char *cmake_find_exec_name(const char *content)
+{
+    if (!content)
+        return NULL;
+
+    const char *exec_line = strstr(content, "add_executable(");
+    if (!exec_line)
+        return NULL;
+
+    exec_line += strlen("add_executable(");
+    while (*exec_line == ' ' || *exec_line == '\t')
+        exec_line++;
+
+    const char *name_end = exec_line;
+    while (*name_end && *name_end != ' ' && *name_end != '\n' && *name_end != '\r' &&
+           *name_end != '\t' && *name_end != ')')
+        name_end++;
+
+    if (name_end == exec_line)
+        return NULL;
+
+    return copy_range(exec_line, (size_t)(name_end - exec_line));
+}
+
+#ifndef _WIN32
+// Take the lock file with an fcntl lock, which the kernel drops when the
+// holder exits, so a lock file left behind by a killed ecewo is simply
+// taken over. The file is renamed over CMakeLists.txt or removed while
+// still locked, so a waiter that ends up locking an unlinked file starts
+// over with the current one.
+static int try_lock(CMakeFile *cmake)
+{
+    int fd = open(cmake->lock_path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0)
+        return -1;
+
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    if (fcntl(fd, F_SETLK, &lock) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved == EACCES ? EAGAIN : saved;
+        return -1;
+    }
+
+    struct stat locked, current;
+    if (fstat(fd, &locked) != 0 || stat(cmake->lock_path, &current) != 0 ||
+        locked.st_ino != current.st_ino || locked.st_dev != current.st_dev)
+    {
+        close(fd);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Whatever a killed process wrote into it is of no use
+    if (ftruncate(fd, 0) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+#else
+static int try_lock(CMakeFile *cmake)
+{
+    int fd = open(cmake->lock_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST)
+        errno = EAGAIN;
+    return fd;
+}
+#endif
+
+static int acquire_lock(CMakeFile *cmake)
+{
+    int waited = 0;
+
+    while (1)
+    {
+        cmake->lock_fd = try_lock(cmake);
+        if (cmake->lock_fd >= 0)
+            return 0;
+
+        if (errno != EAGAIN || waited >= CMAKE_LOCK_WAIT_MS)
+            break;
+
+        sleep_ms(50);
+        waited += 50;
+    }
+
+    printf("Error: %s is locked by another ecewo process.\n", cmake->path);
+#ifdef _WIN32
+    printf("Remove %s if no other process is running.\n", cmake->lock_path);
+#endif
+    return -1;
+}
+
+static void release_lock(CMakeFile *cmake)
+{
+    if (cmake->lock_fd >= 0)
+    {
+        // Removed before the lock goes, see try_lock
+        remove(cmake->lock_path);
+        close(cmake->lock_fd);
+        cmake->lock_fd = -1;
+    }
+}
+
+// Lock and parse path. Returns NULL if the file doesn't exist or can't
+// be locked.
+CMakeFile *cmake_open(const char *path)
+{
+    if (!path || !file_exists(path))
+        return NULL;
+
+    CMakeFile *cmake = calloc(1, sizeof(CMakeFile));
+    if (!cmake)
+        return NULL;
+
+    cmake->lock_fd = -1;
+#ifndef _WIN32
+    // Edit the file a symlinked CMakeLists.txt points to, renaming over
+    // the link itself would replace it with a regular file
+    struct stat link;
+    if (lstat(path, &link) == 0 && S_ISLNK(link.st_mode))
+        cmake->path = realpath(path, NULL);
+    else
+        cmake->path = copy_range(path, strlen(path));
+#else
+    cmake->path = copy_range(path, strlen(path));
+#endif
+    if (!cmake->path)
+    {
+        cmake_close(cmake);
+        return NULL;
+    }
+    cmake->lock_path = malloc(strlen(cmake->path) + strlen(".lock") + 1);
+    if (!cmake->lock_path)
+    {
+        cmake_close(cmake);
+        return NULL;
+    }
+    sprintf(cmake->lock_path, "%s.lock", cmake->path);
+
+    if (acquire_lock(cmake) != 0)
+    {
+        cmake_close(cmake);
+        return NULL;
+    }
+
+    // Read after locking so we see the latest committed version
+    cmake->content = read_file(cmake->path);
+    if (!cmake->content)
+    {
+        cmake_close(cmake);
+        return NULL;
+    }
+
+    cmake->exec_name = cmake_find_exec_name(cmake->content);
+    if (parse_blocks(cmake, cmake->content) != 0)
+    {
+        cmake_close(cmake);
+        return NULL;
+    }
+
+    return cmake;
+}
+
+const char *cmake_exec_name(const CMakeFile *cmake)
+{
+    return cmake ? cmake->exec_name : NULL;
+}
+
+// Bounded search, block text isn't NUL-terminated
+static const char *find_in(const char *text, size_t len, const char *needle)
+{
+    size_t needle_len = strlen(needle);
+    if (needle_len == 0 || needle_len > len)
+        return needle_len == 0 ? text : NULL;
+
+    const char *end = text + len - needle_len + 1;
+    const char *p = text;
+    while (p < end && (p = memchr(p, needle[0], (size_t)(end - p))) != NULL)
+    {
+        if (memcmp(p, needle, needle_len) == 0)
+            return p;
+        p++;
+    }
+    return NULL;
+}
+
+int cmake_contains(const CMakeFile *cmake, const char *needle)
+{
+    if (!cmake || !needle)
+        return 0;
+
+    for (int i = 0; i < cmake->count; i++)
+    {
+        if (find_in(cmake->blocks[i].text, cmake->blocks[i].len, needle))
+            return 1;
+    }
+    return 0;
+}
+
+static int find_block(const CMakeFile *cmake, const char *name)
+{
+    size_t name_len = strlen(name);
+    for (int i = 0; i < cmake->count; i++)
+    {
+        const CMakeBlock *block = &cmake->blocks[i];
+        if (block->name && block->name_len == name_len && memcmp(block->name, name, name_len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int cmake_has_block(const CMakeFile *cmake, const char *name)
+{
+    return cmake && name && find_block(cmake, name) >= 0;
+}
+
+// Number of newlines at the end of a block
+static size_t trailing_newlines(const CMakeBlock *block)
+{
+    size_t n = 0;
+    while (n < block->len && block->text[block->len - 1 - n] == '\n')
+        n++;
+    return n;
+}
+
+// Append "# name" followed by body as a new block, separated from the
+// previous one by a single blank line
+int cmake_append_block(CMakeFile *cmake, const char *name, const char *body)
+{
+    if (!cmake || !name || !body)
+        return -1;
+
+    // Make sure the last block ends with exactly one blank line
+    CMakeBlock *last = cmake->count > 0 ? &cmake->blocks[cmake->count - 1] : NULL;
+    if (last && last->len > 0)
+    {
+        size_t newlines = trailing_newlines(last);
+        if (newlines < 2)
+        {
+            if (own_block(last, 2) != 0)
+                return -1;
+            while (newlines < 2)
+            {
+                last->text[last->len++] = '\n';
+                newlines++;
+            }
+            last->text[last->len] = '\0';
+        }
+    }
+
+    size_t name_len = strlen(name);
+    size_t body_len = strlen(body);
+    size_t len = 2 + name_len + 1 + body_len;
+    char *text = malloc(len + 1);
+    if (!text)
+        return -1;
+
+    snprintf(text, len + 1, "# %s\n%s", name, body);
+
+    if (add_block(cmake, text + 2, name_len, text, len, 1) != 0)
+    {
+        free(text);
+        return -1;
+    }
+
+    cmake->dirty = 1;
+    return 0;
+}
+
+// Remove the block called name. With end_line set, only the part of the
+// block up to and including that line goes away and whatever follows it
+// is kept. Returns 1 if something was removed.
+int cmake_remove_block(CMakeFile *cmake, const char *name, const char *end_line)
+{
+    if (!cmake || !name)
+        return 0;
+
+    int index = find_block(cmake, name);
+    if (index < 0)
+        return 0;
+
+    CMakeBlock *block = &cmake->blocks[index];
+    const char *rest = block->text + block->len;
+
+    const char *block_end = block->text + block->len;
+
+    if (end_line)
+    {
+        const char *end = find_in(block->text, block->len, end_line);
+        if (!end)
+            return 0;
+        rest = end + strlen(end_line);
+    }
+
+    // Skip the blank lines that separated the removed part from what follows
+    while (rest < block_end && *rest == '\n')
+        rest++;
+
+    size_t rest_len = block->len - (size_t)(rest - block->text);
+    CMakeBlock *prev = index > 0 ? &cmake->blocks[index - 1] : NULL;
+
+    if (rest_len > 0 && prev)
+    {
+        // Leftover lines without a header of their own belong to the previous block
+        if (own_block(prev, rest_len) != 0)
+            return 0;
+        memcpy(prev->text + prev->len, rest, rest_len);
+        prev->len += rest_len;
+        prev->text[prev->len] = '\0';
+    }
+
+    if (block->owned)
+        free(block->text);
+    memmove(block, block + 1, sizeof(CMakeBlock) * (cmake->count - index - 1));
+    cmake->count--;
+
+    // Don't leave a run of blank lines at the end of the file. Shrinking
+    // len is enough, the text itself doesn't need to change.
+    if (index == cmake->count && prev)
+    {
+        while (prev->len > 1 && prev->text[prev->len - 1] == '\n' && prev->text[prev->len - 2] == '\n')
+            prev->len--;
+    }
+
+    cmake->dirty = 1;
+    return 1;
+}
+
+// Write the edited file if anything changed and release the lock
+int cmake_commit(CMakeFile *cmake)
+{
+    if (!cmake)
+        return -1;
+
+    if (!cmake->dirty)
+    {
+        release_lock(cmake);
+        return 0;
+    }
+
+    // Lay the blocks out in one buffer so the file goes out in a single write
+    size_t total = 0;
+    for (int i = 0; i < cmake->count; i++)
+        total += cmake->blocks[i].len;
+
+    char *buffer = malloc(total + 1);
+    if (!buffer)
+        return -1;
+
+    size_t offset = 0;
+    for (int i = 0; i < cmake->count; i++)
+    {
+        memcpy(buffer + offset, cmake->blocks[i].text, cmake->blocks[i].len);
+        offset += cmake->blocks[i].len;
+    }
+
+    int result = 0;
+    const char *data = buffer;
+    size_t left = total;
+    while (left > 0)
+    {
+        long written = (long)write(cmake->lock_fd, data, left);
+        if (written <= 0)
+        {
+            result = -1;
+            break;
+        }
+        data += written;
+        left -= (size_t)written;
+    }
+    free(buffer);
+
+#ifdef _WIN32
+    if (close(cmake->lock_fd) != 0)
+        result = -1;
+    cmake->lock_fd = -1;
+
+    if (result == 0)
+    {
+        remove(cmake->path);
+        result = rename(cmake->lock_path, cmake->path);
+    }
+
+    if (result != 0)
+        remove(cmake->lock_path);
+#else
+    // Keep the permissions of the file being replaced, and make sure the
+    // content is on disk before the rename makes it CMakeLists.txt
+    struct stat original;
+    if (result == 0 && stat(cmake->path, &original) == 0)
+        result = fchmod(cmake->lock_fd, original.st_mode & 07777);
+    if (result == 0)
+        result = fsync(cmake->lock_fd);
+
+    // Renamed while still locked, so no waiter can take the file first
+    if (result == 0)
+        result = rename(cmake->lock_path, cmake->path);
+    if (result != 0)
+        remove(cmake->lock_path);
+
+    if (close(cmake->lock_fd) != 0)
+        result = -1;
+    cmake->lock_fd = -1;
+#endif
+
+    if (result == 0)
+        cmake->dirty = 0;
+
+    return result;
+}
+
+// Release the lock without writing and free everything
+void cmake_close(CMakeFile *cmake)
+{
+    if (!cmake)
+        return;
+
+    release_lock(cmake);
+
+    for (int i = 0; i < cmake->count; i++)
+    {
+        if (cmake->blocks[i].owned)
+            free(cmake->blocks[i].text);
+    }
+
+    free(cmake->blocks);
+    free(cmake->content);
+    free(cmake->exec_name);
+    free(cmake->path);
+    free(cmake->lock_path);
+    free(cmake);
+}
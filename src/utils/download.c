@@ -0,0 +1,387 @@
+#include "cli.h"
+#include <pthread.h>
+
+typedef struct
+{
+    DownloadJob *jobs;
+    HttpClient *client;
+    int *order;
+    int count;
+    int next;
+    int finished;
+    pthread_mutex_t lock;
+} DownloadQueue;
+
+#ifndef ECEWO_TLS
+// Only pass through ETag characters that are safe inside a quoted
+// shell argument on every platform
+static int etag_is_safe(const char *etag)
+{
+    for (const char *c = etag; *c; c++)
+    {
+        if (!(*c == '"' || *c == '/' || *c == '-' || *c == '_' || *c == '.' || *c == ':' ||
+              (*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z')))
+            return 0;
+    }
+    return 1;
+}
+
+// Parse one response header line into the job. Returns 1 when the line
+// ends the header block.
+static int parse_header_line(DownloadJob *job, char *line)
+{
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+
+    if (len == 0)
+        return 1;
+
+    if (strncmp(line, "HTTP/", 5) == 0)
+    {
+        char *space = strchr(line, ' ');
+        if (space)
+            job->status = atoi(space + 1);
+        return 0;
+    }
+
+    if ((line[0] == 'e' || line[0] == 'E') && len > 5 &&
+        (line[1] == 't' || line[1] == 'T') &&
+        (line[2] == 'a' || line[2] == 'A') &&
+        (line[3] == 'g' || line[3] == 'G') && line[4] == ':')
+    {
+        char *value = line + 5;
+        while (*value == ' ')
+            value++;
+        snprintf(job->response_etag, sizeof(job->response_etag), "%s", value);
+    }
+
+    return 0;
+}
+
+// Without a TLS library https transfers go through the curl binary. The
+// body is read from the pipe, written to disk and hashed in the same pass.
+static int fetch_stream(DownloadJob *job)
+{
+    char header[300] = "";
+
+    job->status = 0;
+    job->response_etag[0] = '\0';
+    job->sha256[0] = '\0';
+
+    if (job->etag && *job->etag && etag_is_safe(job->etag))
+    {
+#ifdef _WIN32
+        // cmd.exe passes \" through to curl as a literal quote
+        char escaped[260];
+        size_t out = 0;
+        for (const char *c = job->etag; *c && out < sizeof(escaped) - 3; c++)
+        {
+            if (*c == '"')
+                escaped[out++] = '\\';
+            escaped[out++] = *c;
+        }
+        escaped[out] = '\0';
+        snprintf(header, sizeof(header), " -H \"If-None-Match: %s\"", escaped);
+#else
+        snprintf(header, sizeof(header), " -H 'If-None-Match: %s'", job->etag);
+#endif
+    }
+
+    size_t cmd_size = strlen("curl -s --compressed -D -  \"\"") + strlen(header) + strlen(job->url) + 1;
+    char *command = malloc(cmd_size);
+    if (!command)
+        return -1;
+
+    snprintf(command, cmd_size, "curl -s --compressed -D -%s \"%s\"", header, job->url);
+    FILE *pipe = popen(command, POPEN_READ_MODE);
+    free(command);
+    if (!pipe)
+        return -1;
+
+    // Header block first; skip interim 1xx responses
+    char line[1024];
+    int in_headers = 1;
+    while (in_headers && fgets(line, sizeof(line), pipe))
+    {
+        if (parse_header_line(job, line) && job->status >= 200)
+            in_headers = 0;
+    }
+
+    if (job->status == 304)
+    {
+        pclose(pipe);
+        return 0;
+    }
+
+    if (job->status != 200)
+    {
+        // Drain the error body so curl can exit cleanly
+        while (fgets(line, sizeof(line), pipe))
+            ;
+        pclose(pipe);
+        return -1;
+    }
+
+    char part_path[1100];
+    snprintf(part_path, sizeof(part_path), "%s.part", job->output_path);
+
+    FILE *out = fopen(part_path, "wb");
+    if (!out)
+    {
+        pclose(pipe);
+        return -1;
+    }
+
+    Sha256 ctx;
+    sha256_init(&ctx);
+
+    unsigned char chunk[16384];
+    size_t n;
+    int result = 0;
+    while ((n = fread(chunk, 1, sizeof(chunk), pipe)) > 0)
+    {
+        sha256_update(&ctx, chunk, n);
+        if (fwrite(chunk, 1, n, out) != n)
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    if (fclose(out) != 0)
+        result = -1;
+    if (pclose(pipe) != 0)
+        result = -1;
+
+    if (result == 0)
+    {
+        remove(job->output_path);
+        result = rename(part_path, job->output_path);
+    }
+
+    if (result != 0)
+    {
+        remove(part_path);
+        return -1;
+    }
+
+    sha256_final_hex(&ctx, job->sha256);
+    return 0;
+}
+#endif
+
+// ECEWO_MIRROR replaces https://raw.githubusercontent.com, e.g. with a
+// local fixture server or an internal proxy
+static void apply_mirror(const char *url, char *out, size_t out_size)
+{
+    const char *origin = "https://raw.githubusercontent.com";
+    const char *mirror = getenv("ECEWO_MIRROR");
+    size_t origin_len = strlen(origin);
+
+    if (mirror && *mirror && strncmp(url, origin, origin_len) == 0)
+        snprintf(out, out_size, "%s%s", mirror, url + origin_len);
+    else
+        snprintf(out, out_size, "%s", url);
+}
+
+static int fetch_job(HttpClient *client, DownloadJob *job)
+{
+    char url[2048];
+    const char *original = job->url;
+
+    apply_mirror(original, url, sizeof(url));
+    job->url = url;
+
+#ifndef ECEWO_TLS
+    if (strncmp(url, "https://", 8) == 0)
+    {
+        if (fetch_stream(job) == 0)
+            job->error = HTTP_OK;
+        else
+            job->error = job->status ? HTTP_ERR_STATUS : HTTP_ERR_CONNECT;
+    }
+    else
+#endif
+    {
+        job->error = http_download(client, job);
+    }
+
+    job->url = original;
+    return job->error == HTTP_OK ? 0 : -1;
+}
+
+static void *download_worker(void *arg)
+{
+    DownloadQueue *queue = arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&queue->lock);
+        if (queue->next >= queue->count)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        DownloadJob *job = &queue->jobs[queue->order[queue->next++]];
+        pthread_mutex_unlock(&queue->lock);
+
+        int result = fetch_job(queue->client, job);
+
+        pthread_mutex_lock(&queue->lock);
+        job->result = result;
+        queue->finished++;
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    return NULL;
+}
+
+// Bytes on disk for a job: the partial file while it is in flight, the
+// final file once it has been renamed into place
+static size_t current_size(const char *path)
+{
+    char part_path[1100];
+    struct stat st;
+
+    snprintf(part_path, sizeof(part_path), "%s.part", path);
+    if (stat(part_path, &st) == 0 || stat(path, &st) == 0)
+        return (size_t)st.st_size;
+    return 0;
+}
+
+static void print_progress(DownloadQueue *queue, size_t total_hint)
+{
+    size_t received = 0;
+    for (int i = 0; i < queue->count; i++)
+        received += current_size(queue->jobs[i].output_path);
+
+    pthread_mutex_lock(&queue->lock);
+    int finished = queue->finished;
+    pthread_mutex_unlock(&queue->lock);
+
+    if (total_hint > received)
+        printf("\rDownloading: %d/%d files, %.1f / ~%.1f MB",
+               finished, queue->count,
+               received / (1024.0 * 1024.0),
+               total_hint / (1024.0 * 1024.0));
+    else
+        printf("\rDownloading: %d/%d files, %.1f MB",
+               finished, queue->count,
+               received / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+// Download every job concurrently with at most max_parallel transfers
+// in flight. Jobs with the largest size hint are started first so that
+// a big file never ends up queued behind the small ones.
+// Returns the number of failed jobs, or -1 on setup error.
+int download_batch(DownloadJob *jobs, int count, int max_parallel)
+{
+    if (!jobs || count <= 0)
+        return 0;
+
+    if (max_parallel <= 0)
+        max_parallel = DOWNLOAD_MAX_PARALLEL;
+    if (max_parallel > count)
+        max_parallel = count;
+
+    DownloadQueue queue;
+    queue.jobs = jobs;
+    queue.count = count;
+    queue.next = 0;
+    queue.finished = 0;
+    queue.order = malloc(sizeof(int) * count);
+    if (!queue.order)
+        return -1;
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * max_parallel);
+    queue.client = http_client_create();
+    if (!threads || !queue.client)
+    {
+        free(threads);
+        free(queue.order);
+        http_client_free(queue.client);
+        return -1;
+    }
+
+    // Largest first (insertion sort, the list is tiny)
+    size_t total_hint = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int j = i;
+        while (j > 0 && jobs[queue.order[j - 1]].size_hint < jobs[i].size_hint)
+        {
+            queue.order[j] = queue.order[j - 1];
+            j--;
+        }
+        queue.order[j] = i;
+        jobs[i].result = -1;
+        jobs[i].error = HTTP_OK;
+        total_hint += jobs[i].size_hint;
+    }
+
+    pthread_mutex_init(&queue.lock, NULL);
+
+    int started = 0;
+    for (int i = 0; i < max_parallel; i++)
+    {
+        if (pthread_create(&threads[started], NULL, download_worker, &queue) == 0)
+            started++;
+    }
+
+    if (started == 0)
+    {
+        // No threads available, fall back to a serial download
+        download_worker(&queue);
+    }
+
+    while (1)
+    {
+        print_progress(&queue, total_hint);
+
+        pthread_mutex_lock(&queue.lock);
+        int done = queue.finished == queue.count;
+        pthread_mutex_unlock(&queue.lock);
+
+        if (done)
+            break;
+
+        sleep_ms(100);
+    }
+    printf("\n");
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&queue.lock);
+    http_client_free(queue.client);
+    free(threads);
+    free(queue.order);
+
+    int failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (jobs[i].result != 0)
+            failed++;
+    }
+
+    return failed;
+}
+
+// Fetch a single file. Returns HTTP_OK or the reason it failed.
+http_error_t download_file(const char *url, const char *output_path)
+{
+    if (!url || !output_path)
+        return HTTP_ERR_URL;
+
+    DownloadJob job;
+    memset(&job, 0, sizeof(job));
+    job.url = url;
+    job.output_path = output_path;
+
+    if (download_batch(&job, 1, 1) < 0)
+        return HTTP_ERR_CONNECT;
+
+    return job.error;
+}
@@ -1,18 +1,25 @@
-#include <stdio.h>
+#include "cli.h"
 
 void show_install_help(void)
 {
     printf("Libraries:\n");
     printf("=============================================\n");
-    printf("  JSON          ecewo install cjson\n");
-    printf("  CBOR          ecewo install cbor\n");
-    printf("  .env          ecewo install dotenv\n");
-    printf("  SQLite3       ecewo install sqlite\n");
-    printf("  PostgreSQL    ecewo install postgres\n");
-    printf("  Session       ecewo install session\n");
-    printf("  PQUV          ecewo install pquv\n");
-    printf("  Slugify       ecewo install slugify\n");
+    for (int i = 0; i < plugin_count; i++)
+    {
+        printf("  %-13s ecewo install %s", plugins[i].description, plugins[i].id);
+        if (plugins[i].require_count > 0)
+        {
+            printf(" (with");
+            for (int r = 0; r < plugins[i].require_count; r++)
+                printf(" %s", plugins[i].requires[r]);
+            printf(")");
+        }
+        printf("\n");
+    }
     printf("=============================================\n");
+    printf("Add --no-cache to skip the local vendor cache.\n");
+    printf("SQLite compile options: ecewo install sqlite --profile fast|default|minimal\n");
+    printf("Add or pin libraries for a project in " PLUGINS_FILE ".\n");
 }
 
 void show_help(void)
@@ -21,12 +28,48 @@ void show_help(void)
     printf("==========================================================\n");
     printf("  ecewo create          # Create a new Ecewo project\n");
     printf("  ecewo run             # Build and run the project\n");
+    printf("  ecewo run prod        # Run the production build\n");
+    printf("  ecewo run --restart   # Restart the server after a crash, with backoff\n");
+    printf("  ecewo run --workers N|auto [--port N]\n");
+    printf("                        # N servers on one port (LISTEN_FDS), one per CPU\n");
+    printf("  ecewo run --ready-check [--path /health] [--port N]\n");
+    printf("                        # Report the time from exec to listening and first 200\n");
+    printf("  ecewo run --ready-check --warmup requests.txt [--requests N]\n");
+    printf("                        # Replay requests before announcing ready\n");
+    printf("  ecewo run --watch     # Rebuild and restart on every change\n");
+    printf("  ecewo run --watch --handoff [--port N]\n");
+    printf("                        # Keep the port open across restarts (LISTEN_FDS)\n");
     printf("  ecewo build dev       # Build for development\n");
     printf("  ecewo build prod      # Build for production\n");
     printf("  ecewo rebuild dev     # Clean and rebuild for development\n");
     printf("  ecewo rebuild prod    # Clean and rebuild for production\n");
+    printf("  ecewo rebuild --full  # Also refetch and rebuild dependencies\n");
+    printf("  ecewo build -j N      # Build with N parallel jobs (default: auto)\n");
+    printf("  ecewo build --timings # Time configure and each build step, flag slower builds\n");
+    printf("  ecewo build --unity[=N] # Compile sources in batches of N (default: auto),\n");
+    printf("                        # clashing ones listed in ecewo.unity; --no-unity undoes it\n");
+    printf("  ecewo build prod --optimize [--march=native]\n");
+    printf("                        # LTO, no-PLT calls and gc-sections; also\n");
+    printf("                        # --lto, --no-plt, --gc-sections one by one\n");
+    printf("  ecewo build pgo       # Profile-guided build prod: instrument, train, rebuild\n");
+    printf("  ecewo build pgo --workload ./load.sh [--port N]\n");
+    printf("                        # Train with a script instead of replaying\n");
+    printf("                        # pgo/requests.txt (--requests N, default 5000)\n");
+    printf("  ecewo bench [dev|prod] # Load the built server (default: prod) and\n");
+    printf("                        # save latencies to build/bench.json\n");
+    printf("  ecewo bench --connections N --threads N --duration S --path /x\n");
+    printf("  ecewo bench --rate R  # Open loop at R req/s instead of closed loop\n");
+    printf("  ecewo bench --compare old.json [--threshold PCT]\n");
+    printf("                        # Fail when req/s or p99/p99.9 regress (default 10%%)\n");
+    printf("  ecewo build prod --layout\n");
+    printf("                        # Profile the server and pack hot functions\n");
+    printf("                        # together (llvm-bolt, or lld/gold ordering)\n");
     printf("  ecewo libs            # See library installation commands\n");
     printf("  ecewo install [lib]   # Install a library\n");
     printf("  ecewo uninstall [lib] # Uninstall a library\n");
+    printf("  ecewo sync            # Update vendors and ecewo.lock\n");
+    printf("  ecewo sync --frozen   # Restore vendors exactly as locked\n");
+    printf("  ecewo cache stats     # Show vendor cache usage and hit rate\n");
+    printf("  ecewo cache prune     # Remove unused vendor cache entries\n");
     printf("==========================================================\n");
 }
@@ -0,0 +1,911 @@
+#include "cli.h"
+#include <pthread.h>
+#include <signal.h>
+
+#ifdef _WIN32
+typedef SOCKET socket_t;
+#define INVALID_SOCKET_FD INVALID_SOCKET
+#define close_socket closesocket
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+typedef int socket_t;
+#define INVALID_SOCKET_FD (-1)
+#define close_socket close
+#endif
+
+#ifdef ECEWO_TLS
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+#ifdef ECEWO_ZLIB
+#include <zlib.h>
+#endif
+
+// Minimal HTTP/1.1 client for fetching vendor files. Connections are kept
+// alive in a small pool shared by all download workers, so every file of
+// an install that lives on the same host goes over an already open
+// (and, for https, already handshaken) connection.
+
+#define HTTP_TIMEOUT_SECONDS 30
+#define HTTP_MAX_REDIRECTS 5
+#define HTTP_MAX_IDLE 16
+
+typedef struct
+{
+    char host[256];
+    char port[8];
+    int tls;
+    socket_t fd;
+#ifdef ECEWO_TLS
+    SSL *ssl;
+#endif
+    unsigned char buffer[16384];
+    size_t start;
+    size_t end;
+    int reused;
+} HttpConnection;
+
+struct HttpClient
+{
+    pthread_mutex_t lock;
+    HttpConnection *idle[HTTP_MAX_IDLE];
+    int idle_count;
+#ifdef ECEWO_TLS
+    SSL_CTX *tls_ctx;
+#endif
+};
+
+typedef struct
+{
+    int tls;
+    char host[256];
+    char port[8];
+    char path[2048];
+} HttpUrl;
+
+typedef struct
+{
+    int status;
+    long long content_length;
+    long long range_start;
+    int chunked;
+    int compressed;
+    int keep_alive;
+    char etag[256];
+    char location[2048];
+} HttpResponse;
+
+typedef int (*http_sink_t)(void *ctx, const unsigned char *data, size_t len);
+
+const char *http_strerror(http_error_t error)
+{
+    switch (error)
+    {
+    case HTTP_OK:
+        return "OK";
+    case HTTP_ERR_URL:
+        return "invalid URL";
+    case HTTP_ERR_RESOLVE:
+        return "could not resolve host";
+    case HTTP_ERR_CONNECT:
+        return "could not connect";
+    case HTTP_ERR_TLS:
+        return "TLS handshake failed";
+    case HTTP_ERR_SEND:
+        return "failed to send request";
+    case HTTP_ERR_RECV:
+        return "connection closed while receiving";
+    case HTTP_ERR_PROTOCOL:
+        return "malformed response";
+    case HTTP_ERR_STATUS:
+        return "unexpected HTTP status";
+    case HTTP_ERR_REDIRECT:
+        return "too many redirects";
+    case HTTP_ERR_WRITE:
+        return "could not write file";
+    case HTTP_ERR_NO_TLS:
+        return "built without TLS support";
+    default:
+        return "unknown error";
+    }
+}
+
+static http_error_t parse_url(const char *url, HttpUrl *out)
+{
+    const char *rest;
+
+    if (strncmp(url, "http://", 7) == 0)
+    {
+        out->tls = 0;
+        rest = url + 7;
+    }
+    else if (strncmp(url, "https://", 8) == 0)
+    {
+        out->tls = 1;
+        rest = url + 8;
+    }
+    else
+    {
+        return HTTP_ERR_URL;
+    }
+
+    const char *path = strchr(rest, '/');
+    size_t authority_len = path ? (size_t)(path - rest) : strlen(rest);
+    const char *colon = memchr(rest, ':', authority_len);
+    size_t host_len = colon ? (size_t)(colon - rest) : authority_len;
+
+    if (host_len == 0 || host_len >= sizeof(out->host))
+        return HTTP_ERR_URL;
+
+    memcpy(out->host, rest, host_len);
+    out->host[host_len] = '\0';
+
+    if (colon)
+    {
+        size_t port_len = authority_len - host_len - 1;
+        if (port_len == 0 || port_len >= sizeof(out->port))
+            return HTTP_ERR_URL;
+        memcpy(out->port, colon + 1, port_len);
+        out->port[port_len] = '\0';
+    }
+    else
+    {
+        snprintf(out->port, sizeof(out->port), "%s", out->tls ? "443" : "80");
+    }
+
+    int written = snprintf(out->path, sizeof(out->path), "%s", path ? path : "/");
+    if (written < 0 || (size_t)written >= sizeof(out->path))
+        return HTTP_ERR_URL;
+
+    return HTTP_OK;
+}
+
+HttpClient *http_client_create(void)
+{
+    HttpClient *client = calloc(1, sizeof(HttpClient));
+    if (!client)
+        return NULL;
+
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#else
+    // A peer closing a kept-alive connection must not kill the CLI
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+#ifdef ECEWO_TLS
+    client->tls_ctx = SSL_CTX_new(TLS_client_method());
+    if (!client->tls_ctx)
+    {
+        free(client);
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(client->tls_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_default_verify_paths(client->tls_ctx);
+    SSL_CTX_set_verify(client->tls_ctx, SSL_VERIFY_PEER, NULL);
+#endif
+
+    pthread_mutex_init(&client->lock, NULL);
+    return client;
+}
+
+static void connection_close(HttpConnection *conn)
+{
+    if (!conn)
+        return;
+
+#ifdef ECEWO_TLS
+    if (conn->ssl)
+    {
+        SSL_shutdown(conn->ssl);
+        SSL_free(conn->ssl);
+    }
+#endif
+
+    if (conn->fd != INVALID_SOCKET_FD)
+        close_socket(conn->fd);
+
+    free(conn);
+}
+
+void http_client_free(HttpClient *client)
+{
+    if (!client)
+        return;
+
+    for (int i = 0; i < client->idle_count; i++)
+        connection_close(client->idle[i]);
+
+#ifdef ECEWO_TLS
+    SSL_CTX_free(client->tls_ctx);
+#endif
+
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+
+#ifdef _WIN32
+    WSACleanup();
+#else
+    signal(SIGPIPE, SIG_DFL);
+#endif
+}
+
+static http_error_t connection_open(HttpClient *client, const HttpUrl *url, HttpConnection **out)
+{
+#ifndef ECEWO_TLS
+    (void)client;
+    if (url->tls)
+        return HTTP_ERR_NO_TLS;
+#endif
+
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(url->host, url->port, &hints, &result) != 0)
+        return HTTP_ERR_RESOLVE;
+
+    socket_t fd = INVALID_SOCKET_FD;
+    for (struct addrinfo *ai = result; ai; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == INVALID_SOCKET_FD)
+            continue;
+
+        if (connect(fd, ai->ai_addr, (int)ai->ai_addrlen) == 0)
+            break;
+
+        close_socket(fd);
+        fd = INVALID_SOCKET_FD;
+    }
+    freeaddrinfo(result);
+
+    if (fd == INVALID_SOCKET_FD)
+        return HTTP_ERR_CONNECT;
+
+#ifdef _WIN32
+    DWORD timeout = HTTP_TIMEOUT_SECONDS * 1000;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = HTTP_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+#endif
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&nodelay, sizeof(nodelay));
+
+    HttpConnection *conn = calloc(1, sizeof(HttpConnection));
+    if (!conn)
+    {
+        close_socket(fd);
+        return HTTP_ERR_CONNECT;
+    }
+
+    conn->fd = fd;
+    conn->tls = url->tls;
+    snprintf(conn->host, sizeof(conn->host), "%s", url->host);
+    snprintf(conn->port, sizeof(conn->port), "%s", url->port);
+
+#ifdef ECEWO_TLS
+    if (url->tls)
+    {
+        conn->ssl = SSL_new(client->tls_ctx);
+        if (!conn->ssl ||
+            SSL_set_fd(conn->ssl, (int)fd) != 1 ||
+            SSL_set_tlsext_host_name(conn->ssl, url->host) != 1 ||
+            SSL_set1_host(conn->ssl, url->host) != 1 ||
+            SSL_connect(conn->ssl) != 1)
+        {
+            connection_close(conn);
+            return HTTP_ERR_TLS;
+        }
+    }
+#endif
+
+    *out = conn;
+    return HTTP_OK;
+}
+
+// Take an idle connection to the same host from the pool, or open one
+static http_error_t connection_acquire(HttpClient *client, const HttpUrl *url, HttpConnection **out)
+{
+    pthread_mutex_lock(&client->lock);
+    for (int i = client->idle_count - 1; i >= 0; i--)
+    {
+        HttpConnection *conn = client->idle[i];
+        if (conn->tls == url->tls && strcmp(conn->host, url->host) == 0 && strcmp(conn->port, url->port) == 0)
+        {
+            client->idle[i] = client->idle[--client->idle_count];
+            pthread_mutex_unlock(&client->lock);
+            conn->reused = 1;
+            *out = conn;
+            return HTTP_OK;
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    return connection_open(client, url, out);
+}
+
+static void connection_release(HttpClient *client, HttpConnection *conn)
+{
+    pthread_mutex_lock(&client->lock);
+    if (client->idle_count < HTTP_MAX_IDLE)
+    {
+        client->idle[client->idle_count++] = conn;
+        conn = NULL;
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    connection_close(conn);
+}
+
+static int connection_send(HttpConnection *conn, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        long sent;
+#ifdef ECEWO_TLS
+        if (conn->ssl)
+            sent = SSL_write(conn->ssl, data, (int)len);
+        else
+#endif
+            sent = send(conn->fd, data, (int)len, 0);
+
+        if (sent <= 0)
+            return -1;
+
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+// Refill the read buffer. Returns the number of bytes now buffered, 0 on
+// orderly close and -1 on error.
+static long connection_fill(HttpConnection *conn)
+{
+    if (conn->start < conn->end)
+        return (long)(conn->end - conn->start);
+
+    long received;
+#ifdef ECEWO_TLS
+    if (conn->ssl)
+        received = SSL_read(conn->ssl, conn->buffer, sizeof(conn->buffer));
+    else
+#endif
+        received = recv(conn->fd, (char *)conn->buffer, sizeof(conn->buffer), 0);
+
+    if (received < 0)
+        return -1;
+
+    conn->start = 0;
+    conn->end = (size_t)received;
+    return received;
+}
+
+static int connection_read_line(HttpConnection *conn, char *line, size_t size)
+{
+    size_t len = 0;
+
+    while (1)
+    {
+        long available = connection_fill(conn);
+        if (available <= 0)
+            return -1;
+
+        while (conn->start < conn->end)
+        {
+            char c = (char)conn->buffer[conn->start++];
+            if (c == '\n')
+            {
+                if (len > 0 && line[len - 1] == '\r')
+                    len--;
+                line[len] = '\0';
+                return 0;
+            }
+            if (len + 1 >= size)
+                return -1;
+            line[len++] = c;
+        }
+    }
+}
+
+static int header_is(const char *line, const char *name)
+{
+    size_t len = strlen(name);
+    for (size_t i = 0; i < len; i++)
+    {
+        char a = line[i];
+        if (a >= 'A' && a <= 'Z')
+            a = (char)(a - 'A' + 'a');
+        if (a != name[i])
+            return 0;
+    }
+    return line[len] == ':';
+}
+
+static const char *header_value(const char *line)
+{
+    const char *value = strchr(line, ':') + 1;
+    while (*value == ' ' || *value == '\t')
+        value++;
+    return value;
+}
+
+static http_error_t read_response_head(HttpConnection *conn, HttpResponse *response)
+{
+    char line[4096];
+
+    // Skip interim 1xx responses
+    do
+    {
+        memset(response, 0, sizeof(HttpResponse));
+        response->content_length = -1;
+        response->keep_alive = 1;
+
+        if (connection_read_line(conn, line, sizeof(line)) != 0)
+            return HTTP_ERR_RECV;
+
+        if (strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12)
+            return HTTP_ERR_PROTOCOL;
+
+        if (line[7] == '0')
+            response->keep_alive = 0;
+        response->status = atoi(line + 9);
+
+        while (1)
+        {
+            if (connection_read_line(conn, line, sizeof(line)) != 0)
+                return HTTP_ERR_RECV;
+            if (line[0] == '\0')
+                break;
+
+            if (header_is(line, "content-length"))
+                response->content_length = atoll(header_value(line));
+            else if (header_is(line, "transfer-encoding"))
+                response->chunked = strstr(header_value(line), "chunked") != NULL;
+            else if (header_is(line, "connection"))
+                response->keep_alive = strstr(header_value(line), "close") == NULL;
+            else if (header_is(line, "content-encoding"))
+                response->compressed = strstr(header_value(line), "gzip") != NULL ||
+                                       strstr(header_value(line), "deflate") != NULL;
+            else if (header_is(line, "content-range"))
+            {
+                const char *value = header_value(line);
+                if (strncmp(value, "bytes ", 6) == 0)
+                    response->range_start = atoll(value + 6);
+            }
+            else if (header_is(line, "etag"))
+                snprintf(response->etag, sizeof(response->etag), "%s", header_value(line));
+            else if (header_is(line, "location"))
+                snprintf(response->location, sizeof(response->location), "%s", header_value(line));
+        }
+    } while (response->status >= 100 && response->status < 200);
+
+    return HTTP_OK;
+}
+
+// Pass up to len bytes of body to sink
+static http_error_t read_exact(HttpConnection *conn, long long len, http_sink_t sink, void *ctx)
+{
+    while (len > 0)
+    {
+        long available = connection_fill(conn);
+        if (available <= 0)
+            return HTTP_ERR_RECV;
+
+        size_t take = (size_t)available;
+        if ((long long)take > len)
+            take = (size_t)len;
+
+        if (sink && sink(ctx, conn->buffer + conn->start, take) != 0)
+            return HTTP_ERR_WRITE;
+
+        conn->start += take;
+        len -= (long long)take;
+    }
+    return HTTP_OK;
+}
+
+static http_error_t read_body(HttpConnection *conn, HttpResponse *response, http_sink_t sink, void *ctx)
+{
+    if (response->status == 204 || response->status == 304)
+        return HTTP_OK;
+
+    if (response->chunked)
+    {
+        char line[256];
+        while (1)
+        {
+            if (connection_read_line(conn, line, sizeof(line)) != 0)
+                return HTTP_ERR_RECV;
+
+            long long size = strtoll(line, NULL, 16);
+            if (size < 0)
+                return HTTP_ERR_PROTOCOL;
+
+            if (size == 0)
+            {
+                // Trailers end with an empty line
+                do
+                {
+                    if (connection_read_line(conn, line, sizeof(line)) != 0)
+                        return HTTP_ERR_RECV;
+                } while (line[0] != '\0');
+                return HTTP_OK;
+            }
+
+            http_error_t error = read_exact(conn, size, sink, ctx);
+            if (error != HTTP_OK)
+                return error;
+
+            if (connection_read_line(conn, line, sizeof(line)) != 0)
+                return HTTP_ERR_RECV;
+        }
+    }
+
+    if (response->content_length >= 0)
+        return read_exact(conn, response->content_length, sink, ctx);
+
+    // No framing: the body runs until the server closes the connection
+    response->keep_alive = 0;
+    while (1)
+    {
+        long available = connection_fill(conn);
+        if (available < 0)
+            return HTTP_ERR_RECV;
+        if (available == 0)
+            return HTTP_OK;
+
+        if (sink && sink(ctx, conn->buffer + conn->start, (size_t)available) != 0)
+            return HTTP_ERR_WRITE;
+        conn->start = conn->end;
+    }
+}
+
+static http_error_t send_request(HttpConnection *conn, const HttpUrl *url, const char *etag,
+                                 long long range_start, const char *if_range)
+{
+    char request[4096];
+    char range[384] = "";
+    const char *encoding = "";
+    int default_port = strcmp(url->port, url->tls ? "443" : "80") == 0;
+
+    if (range_start > 0)
+    {
+        // Ranges refer to the identity encoding, so don't ask for gzip here
+        if (if_range && *if_range)
+            snprintf(range, sizeof(range), "Range: bytes=%lld-\r\nIf-Range: %s\r\n", range_start, if_range);
+        else
+            snprintf(range, sizeof(range), "Range: bytes=%lld-\r\n", range_start);
+    }
+    else
+    {
+#ifdef ECEWO_ZLIB
+        encoding = "Accept-Encoding: gzip, deflate\r\n";
+#endif
+    }
+
+    int written = snprintf(request, sizeof(request),
+                           "GET %s HTTP/1.1\r\n"
+                           "Host: %s%s%s\r\n"
+                           "User-Agent: ecewo-cli\r\n"
+                           "Accept: */*\r\n"
+                           "Connection: keep-alive\r\n"
+                           "%s%s"
+                           "%s%s%s"
+                           "\r\n",
+                           url->path,
+                           url->host, default_port ? "" : ":", default_port ? "" : url->port,
+                           encoding, range,
+                           etag ? "If-None-Match: " : "", etag ? etag : "", etag ? "\r\n" : "");
+
+    if (written < 0 || (size_t)written >= sizeof(request))
+        return HTTP_ERR_URL;
+
+    return connection_send(conn, request, (size_t)written) == 0 ? HTTP_OK : HTTP_ERR_SEND;
+}
+
+typedef struct
+{
+    FILE *file;
+    Sha256 sha;
+    int inflating;
+    int finished;
+#ifdef ECEWO_ZLIB
+    z_stream zs;
+#endif
+} BodySink;
+
+static int write_plain(BodySink *sink, const unsigned char *data, size_t len)
+{
+    sha256_update(&sink->sha, data, len);
+    return fwrite(data, 1, len, sink->file) == len ? 0 : -1;
+}
+
+// Decode (when the body is compressed), hash and write one piece of body
+static int body_sink(void *ctx, const unsigned char *data, size_t len)
+{
+    BodySink *sink = ctx;
+
+#ifdef ECEWO_ZLIB
+    if (sink->inflating)
+    {
+        unsigned char out[16384];
+
+        if (sink->finished)
+            return 0;
+
+        sink->zs.next_in = (unsigned char *)data;
+        sink->zs.avail_in = (unsigned int)len;
+
+        do
+        {
+            sink->zs.next_out = out;
+            sink->zs.avail_out = sizeof(out);
+
+            int rc = inflate(&sink->zs, Z_NO_FLUSH);
+            if (rc == Z_NEED_DICT || rc == Z_DATA_ERROR || rc == Z_MEM_ERROR || rc == Z_STREAM_ERROR)
+                return -1;
+
+            size_t produced = sizeof(out) - sink->zs.avail_out;
+            if (produced > 0 && write_plain(sink, out, produced) != 0)
+                return -1;
+
+            if (rc == Z_STREAM_END)
+            {
+                sink->finished = 1;
+                return 0;
+            }
+            if (rc == Z_BUF_ERROR)
+                break;
+        } while (sink->zs.avail_in > 0 || sink->zs.avail_out == 0);
+
+        return 0;
+    }
+#endif
+
+    return write_plain(sink, data, len);
+}
+
+// Make a relative redirect target absolute
+static void resolve_location(const HttpUrl *base, const char *location, char *out, size_t out_size)
+{
+    if (strncmp(location, "http://", 7) == 0 || strncmp(location, "https://", 8) == 0)
+        snprintf(out, out_size, "%s", location);
+    else
+        snprintf(out, out_size, "%s://%s:%s%s", base->tls ? "https" : "http", base->host, base->port, location);
+}
+
+static void finish_connection(HttpClient *client, HttpConnection *conn, const HttpResponse *response)
+{
+    if (response->keep_alive)
+        connection_release(client, conn);
+    else
+        connection_close(conn);
+}
+
+// Feed the bytes already in a partial download into the running hash
+static int hash_existing(const char *path, Sha256 *sha)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return -1;
+
+    unsigned char chunk[16384];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        sha256_update(sha, chunk, n);
+
+    int failed = ferror(file);
+    fclose(file);
+    return failed ? -1 : 0;
+}
+
+// GET job->url into job->output_path, hashing the body as it is written.
+// Fills in job->status, job->response_etag and job->sha256. A 304 reply
+// to job->etag leaves the file untouched and counts as success.
+//
+// The body goes to "<output>.part" and is renamed into place once
+// complete. When a transfer breaks off, the partial file is kept together
+// with the ETag it came from ("<output>.part.etag") and the next attempt
+// asks only for the missing bytes with Range/If-Range.
+http_error_t http_download(HttpClient *client, DownloadJob *job)
+{
+    char current[2048];
+    char part_path[1100];
+    char meta_path[1100];
+    char validator[256] = "";
+    HttpUrl url;
+    HttpResponse response;
+    struct stat st;
+    long long offset = 0;
+
+    job->status = 0;
+    job->response_etag[0] = '\0';
+    job->sha256[0] = '\0';
+    snprintf(current, sizeof(current), "%s", job->url);
+    snprintf(part_path, sizeof(part_path), "%s.part", job->output_path);
+    snprintf(meta_path, sizeof(meta_path), "%s.part.etag", job->output_path);
+
+    // A partial file is only worth resuming if we know what it belongs to
+    char *meta = read_file(meta_path);
+    if (meta && *meta && stat(part_path, &st) == 0 && st.st_size > 0)
+    {
+        snprintf(validator, sizeof(validator), "%s", meta);
+        offset = (long long)st.st_size;
+    }
+    else
+    {
+        remove(part_path);
+        remove(meta_path);
+    }
+    free(meta);
+
+    int restarted = 0;
+    for (int redirects = 0; redirects <= HTTP_MAX_REDIRECTS; redirects++)
+    {
+        http_error_t error = parse_url(current, &url);
+        if (error != HTTP_OK)
+            return error;
+
+        const char *etag = job->etag && *job->etag ? job->etag : NULL;
+        HttpConnection *conn = NULL;
+
+        // An idle connection may have been closed by the server in the
+        // meantime; that only shows up once we try to use it
+        for (int attempt = 0; attempt <= HTTP_MAX_IDLE; attempt++)
+        {
+            error = connection_acquire(client, &url, &conn);
+            if (error != HTTP_OK)
+                return error;
+
+            error = send_request(conn, &url, etag, offset, validator);
+            if (error == HTTP_OK)
+                error = read_response_head(conn, &response);
+
+            if (error == HTTP_OK || !conn->reused)
+                break;
+
+            connection_close(conn);
+            conn = NULL;
+        }
+
+        if (error != HTTP_OK)
+        {
+            connection_close(conn);
+            return error;
+        }
+
+        job->status = response.status;
+
+        if (response.status == 304)
+        {
+            snprintf(job->response_etag, sizeof(job->response_etag), "%s", response.etag);
+            finish_connection(client, conn, &response);
+            return HTTP_OK;
+        }
+
+        int resumed = response.status == 206 && offset > 0 && response.range_start == offset;
+
+        if (response.status != 200 && !resumed)
+        {
+            // Drain the body so the connection can be reused
+            error = read_body(conn, &response, NULL, NULL);
+            if (error == HTTP_OK)
+                finish_connection(client, conn, &response);
+            else
+                connection_close(conn);
+
+            // The partial file doesn't fit the server's copy any more
+            if ((response.status == 416 || response.status == 206) && offset > 0 && !restarted)
+            {
+                remove(part_path);
+                remove(meta_path);
+                offset = 0;
+                validator[0] = '\0';
+                restarted = 1;
+                redirects--;
+                continue;
+            }
+
+            if (response.status >= 300 && response.status < 400 && response.location[0])
+            {
+                char next[2048];
+                resolve_location(&url, response.location, next, sizeof(next));
+                snprintf(current, sizeof(current), "%s", next);
+                continue;
+            }
+
+            return HTTP_ERR_STATUS;
+        }
+
+        BodySink sink;
+        memset(&sink, 0, sizeof(sink));
+        sha256_init(&sink.sha);
+
+        if (resumed)
+        {
+            if (hash_existing(part_path, &sink.sha) != 0)
+            {
+                connection_close(conn);
+                return HTTP_ERR_WRITE;
+            }
+            sink.file = fopen(part_path, "ab");
+        }
+        else
+        {
+            sink.file = fopen(part_path, "wb");
+
+            // Strong validators let an interrupted transfer resume later
+            remove(meta_path);
+            if (response.etag[0] && strncmp(response.etag, "W/", 2) != 0)
+                write_file(meta_path, response.etag);
+        }
+
+        if (!sink.file)
+        {
+            connection_close(conn);
+            return HTTP_ERR_WRITE;
+        }
+
+#ifdef ECEWO_ZLIB
+        if (response.compressed)
+        {
+            // 15 + 32: accept both gzip and zlib wrapped streams
+            if (inflateInit2(&sink.zs, 15 + 32) != Z_OK)
+            {
+                fclose(sink.file);
+                connection_close(conn);
+                return HTTP_ERR_WRITE;
+            }
+            sink.inflating = 1;
+        }
+#endif
+
+        error = read_body(conn, &response, body_sink, &sink);
+        if (error == HTTP_OK && sink.inflating && !sink.finished)
+            error = HTTP_ERR_PROTOCOL;
+
+#ifdef ECEWO_ZLIB
+        if (sink.inflating)
+            inflateEnd(&sink.zs);
+#endif
+
+        if (fclose(sink.file) != 0 && error == HTTP_OK)
+            error = HTTP_ERR_WRITE;
+
+        if (error != HTTP_OK)
+        {
+            connection_close(conn);
+            if (!file_exists(meta_path))
+                remove(part_path);
+            return error;
+        }
+
+        finish_connection(client, conn, &response);
+
+        remove(job->output_path);
+        if (rename(part_path, job->output_path) != 0)
+            return HTTP_ERR_WRITE;
+        remove(meta_path);
+
+        snprintf(job->response_etag, sizeof(job->response_etag), "%s",
+                 response.etag[0] ? response.etag : validator);
+        sha256_final_hex(&sink.sha, job->sha256);
+        return HTTP_OK;
+    }
+
+    return HTTP_ERR_REDIRECT;
+}
@@ -0,0 +1,358 @@
+#include "cli.h"
+
+// Post-link code layout for `ecewo build prod --layout`. A profile of
+// the server under load says which functions are hot; those are then
+// packed together in .text, either by llvm-bolt rewriting the linked
+// binary (blocks reordered, cold parts split off) or by the linker
+// following an ordering file. The order lives in pgo/ next to the PGO
+// data, in the formats lld (symbols) and gold (sections) read.
+
+#define LAYOUT_MAX_SYMBOLS 4096
+#define LAYOUT_SYMBOL_SIZE 256
+#define LAYOUT_PAGE_SIZE 4096
+
+// Linker that can follow an ordering file, "lld" or "gold"
+const char *layout_linker(void)
+{
+    if (find_program("ld.lld"))
+        return "lld";
+    if (find_program("ld.gold"))
+        return "gold";
+    return NULL;
+}
+
+// Whether perf can record branch stacks here, which BOLT wants for block
+// reordering. VMs and older CPUs usually can't.
+int layout_perf_has_lbr(void)
+{
+    return execute_command("perf record -q -b -e cycles:u -o " NULL_DEVICE " -- true >" NULL_DEVICE " 2>&1") == 0;
+}
+
+// Size of .text in bytes, -1 if it couldn't be read
+long layout_text_size(const char *binary)
+{
+    char command[1024];
+    snprintf(command, sizeof(command), "size -A \"%s\" 2>%s", binary, NULL_DEVICE);
+
+    FILE *pipe = popen(command, POPEN_READ_MODE);
+    if (!pipe)
+        return -1;
+
+    long size = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), pipe))
+    {
+        char name[64];
+        long value;
+        if (sscanf(line, "%63s %ld", name, &value) == 2 && strcmp(name, ".text") == 0)
+            size = value;
+    }
+    pclose(pipe);
+    return size;
+}
+
+// Keep the symbol table of binary in snapshot, so it can be compared with
+// the binary that replaces it
+int layout_snapshot(const char *binary, const char *snapshot)
+{
+    char command[2048];
+    snprintf(command, sizeof(command), "nm -S --defined-only \"%s\" > \"%s\" 2>%s",
+             binary, snapshot, NULL_DEVICE);
+    return execute_command(command) == 0 ? 0 : -1;
+}
+
+static int compare_pages(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int load_order(const char *dir, char (**symbols)[LAYOUT_SYMBOL_SIZE], int limit)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s%s", dir, PATH_SEPARATOR, LAYOUT_ORDER_FILE);
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    *symbols = malloc((size_t)limit * LAYOUT_SYMBOL_SIZE);
+    if (!*symbols)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    int count = 0;
+    char line[LAYOUT_SYMBOL_SIZE];
+    while (count < limit && fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0])
+            snprintf((*symbols)[count++], LAYOUT_SYMBOL_SIZE, "%s", line);
+    }
+    fclose(file);
+    return count;
+}
+
+// Number of distinct 4 KiB pages the hottest limit functions of the
+// order in dir occupy, according to an nm snapshot. Fewer pages means
+// fewer i-cache and iTLB misses for the same work. -1 on failure.
+int layout_hot_pages(const char *snapshot, const char *dir, int limit)
+{
+    char (*hot)[LAYOUT_SYMBOL_SIZE] = NULL;
+    int hot_count = load_order(dir, &hot, limit);
+    if (hot_count <= 0)
+    {
+        free(hot);
+        return -1;
+    }
+
+    FILE *file = fopen(snapshot, "r");
+    if (!file)
+    {
+        free(hot);
+        return -1;
+    }
+
+    size_t page_count = 0, page_capacity = 256;
+    unsigned long long *pages = malloc(page_capacity * sizeof(unsigned long long));
+    char line[1024];
+
+    while (pages && fgets(line, sizeof(line), file))
+    {
+        unsigned long long address, size;
+        char type, name[LAYOUT_SYMBOL_SIZE];
+        if (sscanf(line, "%llx %llx %c %255s", &address, &size, &type, name) != 4 || size == 0)
+            continue;
+        if (type != 't' && type != 'T')
+            continue;
+
+        int is_hot = 0;
+        for (int i = 0; i < hot_count && !is_hot; i++)
+            is_hot = strcmp(hot[i], name) == 0;
+        if (!is_hot)
+            continue;
+
+        for (unsigned long long page = address / LAYOUT_PAGE_SIZE; page <= (address + size - 1) / LAYOUT_PAGE_SIZE; page++)
+        {
+            if (page_count == page_capacity)
+            {
+                page_capacity *= 2;
+                unsigned long long *grown = realloc(pages, page_capacity * sizeof(unsigned long long));
+                if (!grown)
+                    break;
+                pages = grown;
+            }
+            pages[page_count++] = page;
+        }
+    }
+    fclose(file);
+    free(hot);
+
+    if (!pages)
+        return -1;
+
+    qsort(pages, page_count, sizeof(unsigned long long), compare_pages);
+    int distinct = 0;
+    for (size_t i = 0; i < page_count; i++)
+    {
+        if (i == 0 || pages[i] != pages[i - 1])
+            distinct++;
+    }
+
+    free(pages);
+    return distinct;
+}
+
+// Write the order for both linkers. -ffunction-sections puts each
+// function in .text.<name>, or .text.hot.<name> when PGO found it hot.
+static int write_order(const char *dir, char (*symbols)[LAYOUT_SYMBOL_SIZE], int count)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s%s", dir, PATH_SEPARATOR, LAYOUT_ORDER_FILE);
+    FILE *symbol_file = fopen(path, "w");
+
+    snprintf(path, sizeof(path), "%s%s%s", dir, PATH_SEPARATOR, LAYOUT_SECTION_ORDER_FILE);
+    FILE *section_file = fopen(path, "w");
+
+    if (!symbol_file || !section_file)
+    {
+        if (symbol_file)
+            fclose(symbol_file);
+        if (section_file)
+            fclose(section_file);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(symbol_file, "%s\n", symbols[i]);
+        fprintf(section_file, ".text.hot.%s\n.text.%s\n", symbols[i], symbols[i]);
+    }
+
+    int result = fclose(symbol_file) == 0 ? 0 : -1;
+    if (fclose(section_file) != 0)
+        result = -1;
+    return result;
+}
+
+static int add_symbol(char (*symbols)[LAYOUT_SYMBOL_SIZE], int count, const char *name)
+{
+    if (count >= LAYOUT_MAX_SYMBOLS || !name[0])
+        return count;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(symbols[i], name) == 0)
+            return count;
+    }
+
+    snprintf(symbols[count], LAYOUT_SYMBOL_SIZE, "%s", name);
+    return count + 1;
+}
+
+// Order functions by their share of the samples in a perf recording.
+// Returns the number of functions, -1 on failure.
+int layout_order_from_perf(const char *dir, const char *perf_data)
+{
+    char command[2048];
+    snprintf(command, sizeof(command),
+             "perf report -i \"%s\" --stdio --no-children --sort symbol -q 2>%s", perf_data, NULL_DEVICE);
+
+    FILE *pipe = popen(command, POPEN_READ_MODE);
+    if (!pipe)
+        return -1;
+
+    char (*symbols)[LAYOUT_SYMBOL_SIZE] = malloc((size_t)LAYOUT_MAX_SYMBOLS * LAYOUT_SYMBOL_SIZE);
+    int count = 0;
+    char line[1024];
+
+    // "    12.34%  [.] route_request", [k] lines are the kernel's
+    while (symbols && fgets(line, sizeof(line), pipe))
+    {
+        char *marker = strstr(line, "[.] ");
+        if (!marker)
+            continue;
+
+        char name[LAYOUT_SYMBOL_SIZE];
+        if (sscanf(marker + 4, "%255s", name) == 1 && strncmp(name, "0x", 2) != 0)
+            count = add_symbol(symbols, count, name);
+    }
+    pclose(pipe);
+
+    if (!symbols)
+        return -1;
+
+    int result = count > 0 && write_order(dir, symbols, count) != 0 ? -1 : count;
+    free(symbols);
+    return result;
+}
+
+// Order functions from a gprof flat profile, which lists them by time
+// and then by call count. Returns the number of functions, -1 on failure.
+int layout_order_from_gprof(const char *dir, const char *binary, const char *gmon)
+{
+    char command[2048];
+    snprintf(command, sizeof(command), "gprof -b -p \"%s\" \"%s\" 2>%s", binary, gmon, NULL_DEVICE);
+
+    FILE *pipe = popen(command, POPEN_READ_MODE);
+    if (!pipe)
+        return -1;
+
+    char (*symbols)[LAYOUT_SYMBOL_SIZE] = malloc((size_t)LAYOUT_MAX_SYMBOLS * LAYOUT_SYMBOL_SIZE);
+    int count = 0;
+    char line[1024];
+
+    //  %   cumulative   self              self     total
+    // time   seconds   seconds    calls  ms/call  ms/call  name
+    // 50.00      0.01     0.01      300     0.03     0.03  route
+    //  0.00      0.01     0.00                             handler
+    while (symbols && fgets(line, sizeof(line), pipe))
+    {
+        char *fields[8];
+        int field_count = 0;
+        for (char *token = strtok(line, " \t\r\n"); token && field_count < 8; token = strtok(NULL, " \t\r\n"))
+            fields[field_count++] = token;
+
+        if (field_count < 4)
+            continue;
+
+        char *end;
+        strtod(fields[0], &end);
+        if (*end != '\0')
+            continue;
+
+        double self_seconds = strtod(fields[2], NULL);
+        long calls = field_count >= 7 ? strtol(fields[3], NULL, 10) : 0;
+        if (self_seconds > 0 || calls > 0)
+            count = add_symbol(symbols, count, fields[field_count - 1]);
+    }
+    pclose(pipe);
+
+    if (!symbols)
+        return -1;
+
+    int result = count > 0 && write_order(dir, symbols, count) != 0 ? -1 : count;
+    free(symbols);
+    return result;
+}
+
+// Rewrite binary in place with llvm-bolt from a perf recording. Without
+// branch stacks (lbr 0) BOLT works from plain samples.
+int layout_bolt(const char *binary, const char *perf_data, int lbr)
+{
+    char command[4096];
+    snprintf(command, sizeof(command), "perf2bolt%s -p \"%s\" -o \"%s.fdata\" \"%s\"",
+             lbr ? "" : " -nl", perf_data, binary, binary);
+    if (execute_command(command) != 0)
+        return -1;
+
+    snprintf(command, sizeof(command),
+             "llvm-bolt \"%s\" -o \"%s.bolt\" -data=\"%s.fdata\" -reorder-blocks=ext-tsp "
+             "-reorder-functions=hfsort -split-functions -split-all-cold -dyno-stats",
+             binary, binary, binary);
+    if (execute_command(command) != 0)
+        return -1;
+
+    char bolted[1024];
+    snprintf(bolted, sizeof(bolted), "%s.bolt", binary);
+    return rename(bolted, binary) == 0 ? 0 : -1;
+}
+
+// Instruction cache misses per 1000 instructions from the output of
+// perf stat -x, (value,unit,event,...). -1 if the counters weren't
+// available, as is common in VMs.
+double layout_icache_mpki(const char *perf_stat_output)
+{
+    FILE *file = fopen(perf_stat_output, "r");
+    if (!file)
+        return -1;
+
+    double instructions = -1, misses = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), file))
+    {
+        char *unit = strchr(line, ',');
+        char *event = unit ? strchr(unit + 1, ',') : NULL;
+        if (!event)
+            continue;
+
+        char *end;
+        double value = strtod(line, &end);
+        if (end != unit)
+            continue;
+
+        event++;
+        if (strncmp(event, "instructions", 12) == 0)
+            instructions = value;
+        else if (strncmp(event, "L1-icache-load-misses", 21) == 0)
+            misses = value;
+    }
+    fclose(file);
+
+    if (instructions <= 0 || misses < 0)
+        return -1;
+    return misses * 1000.0 / instructions;
+}
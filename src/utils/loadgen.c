@@ -0,0 +1,756 @@
+#include "cli.h"
+
+#ifdef __linux__
+#include <strings.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+// HTTP load generator behind `ecewo bench`. Every thread owns an epoll
+// instance and a share of the keep-alive connections, each with at most
+// one request in flight.
+//
+// Closed loop: a connection sends its next request as soon as the
+// response arrives, so the server sets the pace. Open loop: requests are
+// due at a constant rate whatever the server does, and latency counts
+// from when a request was due, not from when a free connection got to
+// send it. Otherwise a stalled server would hold back the requests that
+// should have measured the stall.
+//
+// Latencies go into a log-linear histogram in the style of
+// HdrHistogram: exact below 128 us, then 64 buckets per power of two,
+// which keeps every recorded value within 1.6% of the real one.
+
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_HALF (1 << (HISTOGRAM_SUB_BITS - 1))
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_HALF)
+
+#define BENCH_READ_SIZE 16384
+
+static int histogram_index(long long value)
+{
+    if (value < 2 * HISTOGRAM_HALF)
+        return value < 0 ? 0 : (int)value;
+
+    int msb = 63;
+    while (!(value >> msb))
+        msb--;
+
+    int shift = msb - (HISTOGRAM_SUB_BITS - 1);
+    int index = shift * HISTOGRAM_HALF + (int)(value >> shift);
+    return index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+// Highest value that lands in bucket index
+static long long histogram_value(int index)
+{
+    if (index < 2 * HISTOGRAM_HALF)
+        return index;
+
+    int shift = index / HISTOGRAM_HALF - 1;
+    long long sub = index - shift * HISTOGRAM_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+static long long histogram_percentile(const long long *histogram, long long total, double percentile)
+{
+    if (total == 0)
+        return 0;
+
+    double exact = total * percentile / 100.0;
+    long long wanted = (long long)exact;
+    if (wanted < exact || wanted < 1)
+        wanted++;
+
+    long long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram[i];
+        if (seen >= wanted)
+            return histogram_value(i);
+    }
+    return histogram_value(HISTOGRAM_BUCKETS - 1);
+}
+
+#ifdef __linux__
+
+typedef enum
+{
+    CONNECTION_IDLE,
+    CONNECTION_CONNECTING,
+    CONNECTION_BUSY
+} connection_state_t;
+
+typedef struct
+{
+    int fd;
+    connection_state_t state;
+    size_t sent;
+    long long started_us; // When the request in flight was due
+    char *buffer;
+    size_t length;
+    size_t capacity;
+} BenchConnection;
+
+typedef struct
+{
+    const bench_options_t *options;
+    const char *request;
+    size_t request_length;
+    int connection_count;
+    double rate; // This thread's share, 0 for closed loop
+    long long start_us;
+    long long end_us;
+
+    long long histogram[HISTOGRAM_BUCKETS];
+    long long requests;
+    long long errors;
+    long long socket_errors;
+    long long latency_sum;
+    long long latency_min;
+    long long latency_max;
+    long long backlog_max; // Most requests that were due but had no free connection
+} BenchWorker;
+
+static void record_latency(BenchWorker *worker, long long latency)
+{
+    worker->histogram[histogram_index(latency)]++;
+    worker->requests++;
+    worker->latency_sum += latency;
+    if (worker->latency_min < 0 || latency < worker->latency_min)
+        worker->latency_min = latency;
+    if (latency > worker->latency_max)
+        worker->latency_max = latency;
+}
+
+static int open_connection(BenchWorker *worker, int epoll_fd, BenchConnection *connection)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)worker->options->port);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = connection;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    connection->fd = fd;
+    connection->state = CONNECTION_CONNECTING;
+    connection->sent = 0;
+    connection->length = 0;
+    return 0;
+}
+
+static void close_connection(int epoll_fd, BenchConnection *connection)
+{
+    if (connection->fd >= 0)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+        close(connection->fd);
+    }
+    connection->fd = -1;
+    connection->state = CONNECTION_IDLE;
+}
+
+static void watch_events(int epoll_fd, BenchConnection *connection, unsigned int events)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events | EPOLLRDHUP;
+    event.data.ptr = connection;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+// Write as much of the request as the socket takes
+static int send_request(BenchWorker *worker, int epoll_fd, BenchConnection *connection)
+{
+    while (connection->sent < worker->request_length)
+    {
+        ssize_t n = send(connection->fd, worker->request + connection->sent,
+                         worker->request_length - connection->sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                watch_events(epoll_fd, connection, EPOLLIN | EPOLLOUT);
+                return 0;
+            }
+            return -1;
+        }
+        connection->sent += (size_t)n;
+    }
+
+    watch_events(epoll_fd, connection, EPOLLIN);
+    return 0;
+}
+
+static void start_request(BenchWorker *worker, int epoll_fd, BenchConnection *connection, long long due_us)
+{
+    connection->state = CONNECTION_BUSY;
+    connection->sent = 0;
+    connection->length = 0;
+    connection->started_us = due_us;
+
+    if (send_request(worker, epoll_fd, connection) != 0)
+    {
+        worker->socket_errors++;
+        close_connection(epoll_fd, connection);
+    }
+}
+
+static int header_equals(const char *line, const char *end, const char *name, const char *value)
+{
+    size_t name_len = strlen(name);
+    if ((size_t)(end - line) < name_len + 1 || strncasecmp(line, name, name_len) != 0 || line[name_len] != ':')
+        return 0;
+
+    const char *p = line + name_len + 1;
+    while (p < end && *p == ' ')
+        p++;
+
+    size_t value_len = strlen(value);
+    return (size_t)(end - p) >= value_len && strncasecmp(p, value, value_len) == 0;
+}
+
+// Length of the complete response at the start of buffer, 0 if more
+// bytes are needed and -1 if it isn't HTTP. status and keep_alive are
+// filled in once it is complete.
+static long response_length(const char *buffer, size_t length, int *status, int *keep_alive)
+{
+    const char *headers_end = NULL;
+    for (size_t i = 3; i < length; i++)
+    {
+        if (buffer[i] == '\n' && buffer[i - 1] == '\r' && buffer[i - 2] == '\n' && buffer[i - 3] == '\r')
+        {
+            headers_end = buffer + i + 1;
+            break;
+        }
+    }
+    if (!headers_end)
+        return length > 65536 ? -1 : 0;
+
+    if (length < 12 || strncmp(buffer, "HTTP/1.", 7) != 0)
+        return -1;
+
+    *status = atoi(buffer + 9);
+    *keep_alive = buffer[7] == '1';
+
+    long long content_length = -1;
+    int chunked = 0;
+
+    for (const char *line = buffer; line < headers_end;)
+    {
+        const char *end = line;
+        while (end < headers_end && *end != '\r')
+            end++;
+
+        if ((size_t)(end - line) > 15 && strncasecmp(line, "Content-Length:", 15) == 0)
+            content_length = atoll(line + 15);
+        else if (header_equals(line, end, "Transfer-Encoding", "chunked"))
+            chunked = 1;
+        else if (header_equals(line, end, "Connection", "close"))
+            *keep_alive = 0;
+        else if (header_equals(line, end, "Connection", "keep-alive"))
+            *keep_alive = 1;
+
+        line = end + 2;
+    }
+
+    size_t header_length = (size_t)(headers_end - buffer);
+
+    if (chunked)
+    {
+        size_t position = header_length;
+        while (1)
+        {
+            const char *size_end = memchr(buffer + position, '\n', length - position);
+            if (!size_end)
+                return 0;
+
+            long long chunk = strtoll(buffer + position, NULL, 16);
+            position = (size_t)(size_end - buffer) + 1;
+
+            if (chunk == 0)
+            {
+                // Trailers end with an empty line
+                while (1)
+                {
+                    const char *line_end = memchr(buffer + position, '\n', length - position);
+                    if (!line_end)
+                        return 0;
+                    int empty = line_end == buffer + position || (line_end == buffer + position + 1 && buffer[position] == '\r');
+                    position = (size_t)(line_end - buffer) + 1;
+                    if (empty)
+                        return (long)position;
+                }
+            }
+
+            position += (size_t)chunk + 2;
+            if (position > length)
+                return 0;
+        }
+    }
+
+    // Without a length only the end of the connection ends the body
+    if (content_length < 0)
+        content_length = *status == 204 || *status == 304 ? 0 : -1;
+    if (content_length < 0)
+        return -1;
+
+    size_t total = header_length + (size_t)content_length;
+    return length >= total ? (long)total : 0;
+}
+
+// Read what arrived. Returns 1 when the response is complete and the
+// connection can be reused, 0 if more is needed, -1 when it is gone.
+static int read_response(BenchWorker *worker, BenchConnection *connection, long long *finished_us)
+{
+    while (1)
+    {
+        if (connection->capacity - connection->length < BENCH_READ_SIZE)
+        {
+            size_t capacity = connection->capacity * 2 + BENCH_READ_SIZE;
+            char *grown = realloc(connection->buffer, capacity);
+            if (!grown)
+                return -1;
+            connection->buffer = grown;
+            connection->capacity = capacity;
+        }
+
+        ssize_t n = recv(connection->fd, connection->buffer + connection->length,
+                         connection->capacity - connection->length, 0);
+        if (n == 0)
+            return -1;
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        connection->length += (size_t)n;
+
+        int status = 0, keep_alive = 1;
+        long complete = response_length(connection->buffer, connection->length, &status, &keep_alive);
+        if (complete < 0)
+            return -1;
+        if (complete == 0)
+            continue;
+
+        *finished_us = monotonic_us();
+        record_latency(worker, *finished_us - connection->started_us);
+        if (status >= 400 || status < 100)
+            worker->errors++;
+
+        connection->state = CONNECTION_IDLE;
+        connection->length = 0;
+        return keep_alive ? 1 : -1;
+    }
+}
+
+static void *bench_worker(void *arg)
+{
+    BenchWorker *worker = arg;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    BenchConnection *connections = calloc(worker->connection_count, sizeof(BenchConnection));
+    struct epoll_event *events = calloc(worker->connection_count, sizeof(struct epoll_event));
+
+    if (epoll_fd < 0 || !connections || !events)
+    {
+        worker->socket_errors++;
+        free(connections);
+        free(events);
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        return NULL;
+    }
+
+    for (int i = 0; i < worker->connection_count; i++)
+    {
+        connections[i].fd = -1;
+        if (open_connection(worker, epoll_fd, &connections[i]) != 0)
+            worker->socket_errors++;
+    }
+
+    long long interval_us = worker->rate > 0 ? (long long)(1000000.0 / worker->rate) : 0;
+    long long next_due = worker->start_us;
+    long long backlog_due[1024]; // Due times of requests waiting for a connection
+    int backlog = 0;
+
+    while (1)
+    {
+        long long now = monotonic_us();
+        if (now >= worker->end_us)
+            break;
+
+        if (interval_us > 0)
+        {
+            while (next_due <= now)
+            {
+                if (backlog < (int)(sizeof(backlog_due) / sizeof(backlog_due[0])))
+                    backlog_due[backlog++] = next_due;
+                next_due += interval_us;
+            }
+            if (backlog > worker->backlog_max)
+                worker->backlog_max = backlog;
+        }
+
+        // Hand due or, in closed loop, any work to idle connections
+        for (int i = 0; i < worker->connection_count; i++)
+        {
+            BenchConnection *connection = &connections[i];
+            if (connection->fd < 0)
+            {
+                if (open_connection(worker, epoll_fd, connection) != 0)
+                    worker->socket_errors++;
+                continue;
+            }
+            if (connection->state != CONNECTION_IDLE)
+                continue;
+
+            if (interval_us == 0)
+            {
+                start_request(worker, epoll_fd, connection, now);
+            }
+            else if (backlog > 0)
+            {
+                start_request(worker, epoll_fd, connection, backlog_due[0]);
+                memmove(backlog_due, backlog_due + 1, (size_t)(--backlog) * sizeof(long long));
+            }
+        }
+
+        long long wake = worker->end_us;
+        if (interval_us > 0 && next_due < wake)
+            wake = next_due;
+        int timeout_ms = (int)((wake - monotonic_us() + 999) / 1000);
+        if (timeout_ms < 0)
+            timeout_ms = 0;
+
+        int ready = epoll_wait(epoll_fd, events, worker->connection_count, timeout_ms);
+        for (int i = 0; i < ready; i++)
+        {
+            BenchConnection *connection = events[i].data.ptr;
+            unsigned int mask = events[i].events;
+
+            if (connection->state == CONNECTION_CONNECTING)
+            {
+                int error = 0;
+                socklen_t error_len = sizeof(error);
+                getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &error_len);
+                if (error != 0 || (mask & (EPOLLERR | EPOLLHUP)))
+                {
+                    worker->socket_errors++;
+                    close_connection(epoll_fd, connection);
+                    continue;
+                }
+                connection->state = CONNECTION_IDLE;
+                watch_events(epoll_fd, connection, EPOLLIN);
+                continue;
+            }
+
+            if (connection->state != CONNECTION_BUSY)
+            {
+                // The server closed an idle keep-alive connection
+                if (mask & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    close_connection(epoll_fd, connection);
+                continue;
+            }
+
+            if ((mask & EPOLLOUT) && connection->sent < worker->request_length &&
+                send_request(worker, epoll_fd, connection) != 0)
+            {
+                worker->socket_errors++;
+                close_connection(epoll_fd, connection);
+                continue;
+            }
+
+            if (mask & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                long long finished;
+                int result = read_response(worker, connection, &finished);
+                if (result < 0)
+                {
+                    // A response that ended with the connection still counts
+                    if (connection->state == CONNECTION_BUSY)
+                        worker->socket_errors++;
+                    close_connection(epoll_fd, connection);
+                }
+                else if (result == 1 && interval_us == 0 && finished < worker->end_us)
+                {
+                    start_request(worker, epoll_fd, connection, finished);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < worker->connection_count; i++)
+    {
+        close_connection(epoll_fd, &connections[i]);
+        free(connections[i].buffer);
+    }
+
+    free(connections);
+    free(events);
+    close(epoll_fd);
+    return NULL;
+}
+
+#endif
+
+// Drive the server on options->port and fill in result. Returns 0, or -1
+// if not a single request completed.
+int bench_run(const bench_options_t *options, BenchResult *result)
+{
+    memset(result, 0, sizeof(BenchResult));
+
+#ifndef __linux__
+    (void)options;
+    printf("Error: ecewo bench needs Linux (epoll)\n");
+    return -1;
+#else
+    int threads = options->threads;
+    if (threads > options->connections)
+        threads = options->connections;
+
+    size_t request_size = strlen(options->path) + 128;
+    char *request = malloc(request_size);
+    BenchWorker *workers = calloc(threads, sizeof(BenchWorker));
+    pthread_t *handles = calloc(threads, sizeof(pthread_t));
+    if (!request || !workers || !handles)
+    {
+        free(request);
+        free(workers);
+        free(handles);
+        return -1;
+    }
+
+    int request_length = snprintf(request, request_size, "GET %s HTTP/1.1\r\nHost: 127.0.0.1:%d\r\n\r\n",
+                                  options->path, options->port);
+
+    long long start = monotonic_us() + 10000;
+    long long end = start + (long long)options->duration * 1000000LL;
+
+    for (int i = 0; i < threads; i++)
+    {
+        BenchWorker *worker = &workers[i];
+        worker->options = options;
+        worker->request = request;
+        worker->request_length = (size_t)request_length;
+        worker->connection_count = options->connections / threads + (i < options->connections % threads);
+        worker->rate = options->rate / threads;
+        worker->start_us = start;
+        worker->end_us = end;
+        worker->latency_min = -1;
+    }
+
+    int started = 0;
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&handles[started], NULL, bench_worker, &workers[started]) != 0)
+            break;
+    }
+
+    // Without threads the calling thread does the work of the first one
+    if (started == 0)
+    {
+        workers[0].connection_count = options->connections;
+        workers[0].rate = options->rate;
+        bench_worker(&workers[0]);
+        threads = 1;
+    }
+
+    for (int i = 0; i < started; i++)
+        pthread_join(handles[i], NULL);
+
+    long long *histogram = calloc(HISTOGRAM_BUCKETS, sizeof(long long));
+    long long latency_sum = 0;
+    result->latency_min = -1;
+
+    for (int i = 0; i < threads; i++)
+    {
+        BenchWorker *worker = &workers[i];
+        result->requests += worker->requests;
+        result->errors += worker->errors;
+        result->socket_errors += worker->socket_errors;
+        latency_sum += worker->latency_sum;
+        if (worker->latency_min >= 0 && (result->latency_min < 0 || worker->latency_min < result->latency_min))
+            result->latency_min = worker->latency_min;
+        if (worker->latency_max > result->latency_max)
+            result->latency_max = worker->latency_max;
+        if (worker->backlog_max > result->backlog_max)
+            result->backlog_max = worker->backlog_max;
+
+        for (int j = 0; histogram && j < HISTOGRAM_BUCKETS; j++)
+            histogram[j] += worker->histogram[j];
+    }
+
+    result->elapsed = (end - start) / 1000000.0;
+    result->throughput = result->requests / result->elapsed;
+    if (result->requests > 0)
+        result->latency_mean = (double)latency_sum / result->requests;
+
+    if (histogram)
+    {
+        result->latency_p50 = histogram_percentile(histogram, result->requests, 50.0);
+        result->latency_p90 = histogram_percentile(histogram, result->requests, 90.0);
+        result->latency_p99 = histogram_percentile(histogram, result->requests, 99.0);
+        result->latency_p999 = histogram_percentile(histogram, result->requests, 99.9);
+    }
+
+    free(histogram);
+    free(request);
+    free(workers);
+    free(handles);
+    return result->requests > 0 ? 0 : -1;
+#endif
+}
+
+static void print_latency(const char *label, double us)
+{
+    if (us >= 1000000)
+        printf("  %-8s %10.2f s\n", label, us / 1000000.0);
+    else if (us >= 1000)
+        printf("  %-8s %10.2f ms\n", label, us / 1000.0);
+    else
+        printf("  %-8s %10.0f us\n", label, us);
+}
+
+void bench_print(const BenchResult *result)
+{
+    printf("\nRequests:   %lld in %.1f s, %.1f req/s\n", result->requests, result->elapsed, result->throughput);
+    printf("Errors:     %lld 4xx/5xx, %lld connection errors\n", result->errors, result->socket_errors);
+    if (result->backlog_max > 0)
+        printf("Backlog:    up to %lld requests waited for a free connection\n", result->backlog_max);
+
+    printf("Latency:\n");
+    print_latency("min", (double)(result->latency_min > 0 ? result->latency_min : 0));
+    print_latency("mean", result->latency_mean);
+    print_latency("p50", (double)result->latency_p50);
+    print_latency("p90", (double)result->latency_p90);
+    print_latency("p99", (double)result->latency_p99);
+    print_latency("p99.9", (double)result->latency_p999);
+    print_latency("max", (double)result->latency_max);
+}
+
+int bench_save_json(const bench_options_t *options, const BenchResult *result, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"target\": \"http://127.0.0.1:%d%s\",\n", options->port, options->path);
+    fprintf(file, "  \"mode\": \"%s\",\n", options->rate > 0 ? "open" : "closed");
+    fprintf(file, "  \"rate\": %.1f,\n", options->rate);
+    fprintf(file, "  \"threads\": %d,\n", options->threads);
+    fprintf(file, "  \"connections\": %d,\n", options->connections);
+    fprintf(file, "  \"duration_s\": %.3f,\n", result->elapsed);
+    fprintf(file, "  \"requests\": %lld,\n", result->requests);
+    fprintf(file, "  \"errors\": %lld,\n", result->errors);
+    fprintf(file, "  \"socket_errors\": %lld,\n", result->socket_errors);
+    fprintf(file, "  \"throughput_rps\": %.1f,\n", result->throughput);
+    fprintf(file, "  \"latency_us\": {\n");
+    fprintf(file, "    \"min\": %lld,\n", result->latency_min > 0 ? result->latency_min : 0);
+    fprintf(file, "    \"mean\": %.1f,\n", result->latency_mean);
+    fprintf(file, "    \"p50\": %lld,\n", result->latency_p50);
+    fprintf(file, "    \"p90\": %lld,\n", result->latency_p90);
+    fprintf(file, "    \"p99\": %lld,\n", result->latency_p99);
+    fprintf(file, "    \"p99_9\": %lld,\n", result->latency_p999);
+    fprintf(file, "    \"max\": %lld\n", result->latency_max);
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+static int json_number(const char *json, const char *key, double *value)
+{
+    char quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+
+    const char *found = strstr(json, quoted);
+    if (!found)
+        return -1;
+
+    found = strchr(found + strlen(quoted), ':');
+    if (!found)
+        return -1;
+
+    char *end;
+    *value = strtod(found + 1, &end);
+    return end == found + 1 ? -1 : 0;
+}
+
+// Read the numbers --compare needs from a file written by bench_save_json
+int bench_load_json(const char *path, BenchResult *result)
+{
+    memset(result, 0, sizeof(BenchResult));
+
+    char *json = read_file(path);
+    if (!json)
+        return -1;
+
+    double throughput, p50, p99, p999, requests;
+    int ok = json_number(json, "throughput_rps", &throughput) == 0 &&
+             json_number(json, "requests", &requests) == 0 &&
+             json_number(json, "p50", &p50) == 0 &&
+             json_number(json, "p99", &p99) == 0 &&
+             json_number(json, "p99_9", &p999) == 0;
+    free(json);
+
+    if (!ok)
+        return -1;
+
+    result->throughput = throughput;
+    result->requests = (long long)requests;
+    result->latency_p50 = (long long)p50;
+    result->latency_p99 = (long long)p99;
+    result->latency_p999 = (long long)p999;
+    return 0;
+}
+
+// Print one metric of the comparison. Returns 1 if it got worse by more
+// than threshold percent and counts (gated).
+static int compare_row(const char *label, double baseline, double current, int higher_is_better,
+                       int gated, double threshold)
+{
+    double change = baseline > 0 ? (current - baseline) * 100.0 / baseline : 0;
+    int regressed = gated && (higher_is_better ? change < -threshold : change > threshold);
+
+    printf("  %-12s %14.1f %14.1f %+9.1f%%%s\n", label, baseline, current, change, regressed ? "  REGRESSION" : "");
+    return regressed;
+}
+
+// Compare against a baseline. Throughput and tail latency are gated,
+// the median is only shown. Returns the number of regressions.
+int bench_compare(const BenchResult *baseline, const BenchResult *current, double threshold)
+{
+    printf("\nCompared with the baseline (threshold %.1f%%):\n", threshold);
+    printf("  %-12s %14s %14s %10s\n", "", "baseline", "current", "change");
+
+    int regressions = 0;
+    regressions += compare_row("req/s", baseline->throughput, current->throughput, 1, 1, threshold);
+    regressions += compare_row("p50 us", (double)baseline->latency_p50, (double)current->latency_p50, 0, 0, threshold);
+    regressions += compare_row("p99 us", (double)baseline->latency_p99, (double)current->latency_p99, 0, 1, threshold);
+    regressions += compare_row("p99.9 us", (double)baseline->latency_p999, (double)current->latency_p999, 0, 1, threshold);
+    return regressions;
+}
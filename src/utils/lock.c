@@ -0,0 +1,507 @@
+#include "cli.h"
+#include <pthread.h>
+
+// ecewo.lock is a plain INI-style file, one section per vendored file or
+// git dependency:
+//
+//   [vendors/cJSON.c]
+//   url = https://raw.githubusercontent.com/DaveGamble/cJSON/master/cJSON.c
+//   revision = 12c4bf1986c288950a3d06da757109a6aa1ece38
+//   etag = "4f1c..."
+//   sha256 = 0d2b...
+//
+//   [git:ecewo]
+//   url = https://github.com/savashn/ecewo.git
+//   revision = 5d7e...
+
+static char *dup_string(const char *str)
+{
+    if (!str)
+        str = "";
+
+    size_t len = strlen(str);
+    char *copy = malloc(len + 1);
+    if (copy)
+        memcpy(copy, str, len + 1);
+    return copy;
+}
+
+static void free_entry(LockEntry *entry)
+{
+    free(entry->name);
+    free(entry->url);
+    free(entry->revision);
+    free(entry->etag);
+}
+
+static void replace_string(char **field, const char *value)
+{
+    char *copy = dup_string(value);
+    if (!copy)
+        return;
+    free(*field);
+    *field = copy;
+}
+
+static char *trim(char *str)
+{
+    while (*str == ' ' || *str == '\t')
+        str++;
+
+    char *end = str + strlen(str);
+    while (end > str && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+        end--;
+    *end = '\0';
+
+    return str;
+}
+
+LockEntry *lock_find(Lockfile *lock, const char *name)
+{
+    for (int i = 0; i < lock->count; i++)
+    {
+        if (strcmp(lock->entries[i].name, name) == 0)
+            return &lock->entries[i];
+    }
+    return NULL;
+}
+
+LockEntry *lock_set(Lockfile *lock, const char *name, const char *url,
+                    const char *revision, const char *etag, const char *sha256)
+{
+    LockEntry *entry = lock_find(lock, name);
+
+    if (!entry)
+    {
+        if (lock->count == lock->capacity)
+        {
+            int capacity = lock->capacity ? lock->capacity * 2 : 16;
+            LockEntry *grown = realloc(lock->entries, sizeof(LockEntry) * capacity);
+            if (!grown)
+                return NULL;
+            lock->entries = grown;
+            lock->capacity = capacity;
+        }
+
+        entry = &lock->entries[lock->count];
+        memset(entry, 0, sizeof(LockEntry));
+        entry->name = dup_string(name);
+        entry->url = dup_string("");
+        entry->revision = dup_string("");
+        entry->etag = dup_string("");
+        if (!entry->name || !entry->url || !entry->revision || !entry->etag)
+        {
+            free_entry(entry);
+            return NULL;
+        }
+        lock->count++;
+    }
+
+    if (url)
+        replace_string(&entry->url, url);
+    if (revision)
+        replace_string(&entry->revision, revision);
+    if (etag)
+        replace_string(&entry->etag, etag);
+    if (sha256)
+        snprintf(entry->sha256, sizeof(entry->sha256), "%s", sha256);
+
+    return entry;
+}
+
+void lock_remove(Lockfile *lock, const char *name)
+{
+    LockEntry *entry = lock_find(lock, name);
+    if (!entry)
+        return;
+
+    free_entry(entry);
+    size_t index = entry - lock->entries;
+    memmove(entry, entry + 1, sizeof(LockEntry) * (lock->count - index - 1));
+    lock->count--;
+}
+
+// Load the lockfile at path. A missing file yields an empty lock.
+int lock_load(Lockfile *lock, const char *path)
+{
+    memset(lock, 0, sizeof(Lockfile));
+
+    char *content = read_file(path);
+    if (!content)
+        return 0;
+
+    LockEntry *current = NULL;
+    char *line = content;
+    while (line && *line)
+    {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        char *text = trim(line);
+        if (*text == '[')
+        {
+            char *close = strchr(text, ']');
+            if (close)
+            {
+                *close = '\0';
+                current = lock_set(lock, text + 1, NULL, NULL, NULL, NULL);
+            }
+        }
+        else if (current && *text && *text != '#')
+        {
+            char *eq = strchr(text, '=');
+            if (eq)
+            {
+                *eq = '\0';
+                char *key = trim(text);
+                char *value = trim(eq + 1);
+
+                if (strcmp(key, "url") == 0)
+                    replace_string(&current->url, value);
+                else if (strcmp(key, "revision") == 0)
+                    replace_string(&current->revision, value);
+                else if (strcmp(key, "etag") == 0)
+                    replace_string(&current->etag, value);
+                else if (strcmp(key, "sha256") == 0)
+                    snprintf(current->sha256, sizeof(current->sha256), "%s", value);
+            }
+        }
+
+        line = next;
+    }
+
+    free(content);
+    return 0;
+}
+
+// Write the lockfile through a temporary file so it is never half written
+int lock_save(const Lockfile *lock, const char *path)
+{
+    StringBuilder *sb = sb_create();
+    if (!sb)
+        return -1;
+
+    sb_append(sb, "# Generated by ecewo-cli. Do not edit by hand.\n");
+
+    for (int i = 0; i < lock->count; i++)
+    {
+        const LockEntry *entry = &lock->entries[i];
+
+        sb_append(sb, "\n[");
+        sb_append(sb, entry->name);
+        sb_append(sb, "]\nurl = ");
+        sb_append(sb, entry->url);
+        sb_append(sb, "\n");
+
+        if (entry->revision[0])
+        {
+            sb_append(sb, "revision = ");
+            sb_append(sb, entry->revision);
+            sb_append(sb, "\n");
+        }
+
+        if (entry->etag[0])
+        {
+            sb_append(sb, "etag = ");
+            sb_append(sb, entry->etag);
+            sb_append(sb, "\n");
+        }
+
+        if (entry->sha256[0])
+        {
+            sb_append(sb, "sha256 = ");
+            sb_append(sb, entry->sha256);
+            sb_append(sb, "\n");
+        }
+    }
+
+    size_t tmp_size = strlen(path) + strlen(".tmp") + 1;
+    char *tmp_path = malloc(tmp_size);
+    if (!tmp_path)
+    {
+        sb_free(sb);
+        return -1;
+    }
+    snprintf(tmp_path, tmp_size, "%s.tmp", path);
+
+    int result = write_file(tmp_path, sb->data);
+    if (result == 0)
+    {
+        remove(path);
+        result = rename(tmp_path, path);
+    }
+    if (result != 0)
+        remove(tmp_path);
+
+    free(tmp_path);
+    sb_free(sb);
+    return result;
+}
+
+void lock_free(Lockfile *lock)
+{
+    for (int i = 0; i < lock->count; i++)
+        free_entry(&lock->entries[i]);
+    free(lock->entries);
+    memset(lock, 0, sizeof(Lockfile));
+}
+
+// Record a git dependency pinned in CMakeLists.txt
+int lock_record_git(const char *name, const char *repo_url, const char *revision)
+{
+    Lockfile lock;
+    char key[256];
+
+    lock_load(&lock, LOCK_FILE);
+    snprintf(key, sizeof(key), "git:%s", name);
+    lock_set(&lock, key, repo_url, revision, NULL, NULL);
+
+    int result = lock_save(&lock, LOCK_FILE);
+    lock_free(&lock);
+    return result;
+}
+
+int lock_forget(const char *name)
+{
+    Lockfile lock;
+
+    if (!file_exists(LOCK_FILE))
+        return 0;
+
+    lock_load(&lock, LOCK_FILE);
+    lock_remove(&lock, name);
+
+    int result = lock_save(&lock, LOCK_FILE);
+    lock_free(&lock);
+    return result;
+}
+
+// Resolve a branch or tag of a git repository to a commit hash
+int resolve_git_revision(const char *repo_url, const char *ref, char *revision, size_t revision_size)
+{
+    if (!repo_url || !ref || !revision || revision_size < REVISION_SIZE)
+        return -1;
+
+    // ls-remote matches patterns by suffix, so name the refs in full and
+    // only accept lines that match one of them exactly
+    size_t ref_len = strlen(ref);
+    size_t name_size = ref_len + sizeof("refs/heads/") + 3;
+    char *head_name = malloc(name_size);
+    char *tag_name = malloc(name_size);
+    char *peeled_name = malloc(name_size);
+    if (!head_name || !tag_name || !peeled_name)
+    {
+        free(head_name);
+        free(tag_name);
+        free(peeled_name);
+        return -1;
+    }
+    snprintf(head_name, name_size, "refs/heads/%s", ref);
+    snprintf(tag_name, name_size, "refs/tags/%s", ref);
+    snprintf(peeled_name, name_size, "refs/tags/%s^{}", ref);
+
+    size_t cmd_size = strlen("git ls-remote \"\" \"\" \"\" \"\"") + strlen(repo_url) +
+                      3 * name_size + strlen(NULL_DEVICE) + 16;
+    char *command = malloc(cmd_size);
+    if (!command)
+    {
+        free(head_name);
+        free(tag_name);
+        free(peeled_name);
+        return -1;
+    }
+
+    snprintf(command, cmd_size, "git ls-remote \"%s\" \"%s\" \"%s\" \"%s\" 2>%s",
+             repo_url, head_name, tag_name, peeled_name, NULL_DEVICE);
+
+    FILE *pipe = popen(command, POPEN_READ_MODE);
+    free(command);
+    if (!pipe)
+    {
+        free(head_name);
+        free(tag_name);
+        free(peeled_name);
+        return -1;
+    }
+
+    // An annotated tag's own hash names the tag object, the peeled line
+    // names the commit. Tags win over branches, as in git itself
+    char head_rev[REVISION_SIZE] = "";
+    char tag_rev[REVISION_SIZE] = "";
+    char peeled_rev[REVISION_SIZE] = "";
+    char line[512];
+    while (fgets(line, sizeof(line), pipe))
+    {
+        if (strlen(line) <= 40 || line[40] != '\t')
+            continue;
+
+        char *name = line + 41;
+        name[strcspn(name, "\r\n")] = '\0';
+
+        char *slot = NULL;
+        if (strcmp(name, peeled_name) == 0)
+            slot = peeled_rev;
+        else if (strcmp(name, tag_name) == 0)
+            slot = tag_rev;
+        else if (strcmp(name, head_name) == 0)
+            slot = head_rev;
+
+        if (slot)
+        {
+            memcpy(slot, line, 40);
+            slot[40] = '\0';
+        }
+    }
+
+    pclose(pipe);
+    free(head_name);
+    free(tag_name);
+    free(peeled_name);
+
+    const char *best = peeled_rev[0] ? peeled_rev : tag_rev[0] ? tag_rev : head_rev;
+    if (!best[0])
+        return -1;
+
+    memcpy(revision, best, REVISION_SIZE);
+    return 0;
+}
+
+// For raw.githubusercontent.com/<owner>/<repo>/<ref>/<path> URLs, find
+// the repository and the ref segment so the ref can be pinned
+static int split_raw_url(const char *url, char *repo, size_t repo_size,
+                         const char **ref_start, const char **ref_end)
+{
+    const char *prefix = "https://raw.githubusercontent.com/";
+    size_t prefix_len = strlen(prefix);
+
+    if (strncmp(url, prefix, prefix_len) != 0)
+        return -1;
+
+    const char *owner = url + prefix_len;
+    const char *slash = strchr(owner, '/');
+    if (!slash)
+        return -1;
+    const char *name_end = strchr(slash + 1, '/');
+    if (!name_end)
+        return -1;
+    const char *ref_stop = strchr(name_end + 1, '/');
+    if (!ref_stop)
+        return -1;
+
+    int written = snprintf(repo, repo_size, "https://github.com/%.*s", (int)(name_end - owner), owner);
+    if (written < 0 || (size_t)written >= repo_size)
+        return -1;
+
+    *ref_start = name_end + 1;
+    *ref_end = ref_stop;
+    return 0;
+}
+
+typedef struct
+{
+    char repo[512];
+    char ref[256];
+    char revision[REVISION_SIZE];
+    int result;
+} RevisionQuery;
+
+static void *resolve_worker(void *arg)
+{
+    RevisionQuery *query = arg;
+    query->result = resolve_git_revision(query->repo, query->ref, query->revision, sizeof(query->revision));
+    return NULL;
+}
+
+// Find the commit each raw file URL currently points at. Every distinct
+// repository/ref pair is queried once, all of them in parallel. URLs that
+// can't be resolved get an empty revision.
+void resolve_url_revisions(const char **urls, int count, char (*revisions)[REVISION_SIZE])
+{
+    RevisionQuery *queries = calloc(count, sizeof(RevisionQuery));
+    int *query_of = malloc(sizeof(int) * count);
+    pthread_t *threads = malloc(sizeof(pthread_t) * count);
+    int *started = calloc(count, sizeof(int));
+    int query_count = 0;
+
+    for (int i = 0; i < count; i++)
+        revisions[i][0] = '\0';
+
+    if (!queries || !query_of || !threads || !started)
+    {
+        free(queries);
+        free(query_of);
+        free(threads);
+        free(started);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        char repo[512];
+        char ref[256];
+        const char *ref_start;
+        const char *ref_end;
+
+        query_of[i] = -1;
+        if (split_raw_url(urls[i], repo, sizeof(repo), &ref_start, &ref_end) != 0)
+            continue;
+        snprintf(ref, sizeof(ref), "%.*s", (int)(ref_end - ref_start), ref_start);
+
+        for (int q = 0; q < query_count; q++)
+        {
+            if (strcmp(queries[q].repo, repo) == 0 && strcmp(queries[q].ref, ref) == 0)
+                query_of[i] = q;
+        }
+
+        if (query_of[i] < 0)
+        {
+            memcpy(queries[query_count].repo, repo, sizeof(repo));
+            memcpy(queries[query_count].ref, ref, sizeof(ref));
+            queries[query_count].result = -1;
+            query_of[i] = query_count++;
+        }
+    }
+
+    for (int q = 0; q < query_count; q++)
+    {
+        started[q] = pthread_create(&threads[q], NULL, resolve_worker, &queries[q]) == 0;
+        if (!started[q])
+            resolve_worker(&queries[q]);
+    }
+
+    for (int q = 0; q < query_count; q++)
+    {
+        if (started[q])
+            pthread_join(threads[q], NULL);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (query_of[i] >= 0 && queries[query_of[i]].result == 0)
+            memcpy(revisions[i], queries[query_of[i]].revision, REVISION_SIZE);
+    }
+
+    free(queries);
+    free(query_of);
+    free(threads);
+    free(started);
+}
+
+// Rewrite a raw file URL so that it points at a fixed revision
+int pin_url(const char *url, const char *revision, char *pinned, size_t pinned_size)
+{
+    char repo[512];
+    const char *ref_start;
+    const char *ref_end;
+
+    if (!revision || !*revision || split_raw_url(url, repo, sizeof(repo), &ref_start, &ref_end) != 0)
+    {
+        snprintf(pinned, pinned_size, "%s", url);
+        return -1;
+    }
+
+    int written = snprintf(pinned, pinned_size, "%.*s%s%s",
+                           (int)(ref_start - url), url, revision, ref_end);
+    return (written < 0 || (size_t)written >= pinned_size) ? -1 : 0;
+}
@@ -0,0 +1,389 @@
+#include "cli.h"
+#include <dirent.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+// Profile-guided optimization for `ecewo build pgo`. The profile data
+// lives in pgo/ at the project root: the raw counters of the training
+// run (.gcda for GCC, .profraw merged into default.profdata for Clang),
+// the request list for the built-in replay, and a fingerprint of src/
+// at training time so later builds can tell when the data went stale.
+
+#define PGO_SOURCES_FILE "sources"
+#define PGO_MAX_SOURCES 4096
+
+typedef struct
+{
+    char path[512];
+    char hash[SHA256_HEX_SIZE];
+} SourceHash;
+
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+static int is_profile_data(const char *name)
+{
+    return has_suffix(name, ".gcda") || has_suffix(name, ".profraw") ||
+           strcmp(name, "default.profdata") == 0;
+}
+
+// Create the data directory and drop the counters of earlier training
+// runs, which GCC would otherwise add the new ones to
+int pgo_reset(const char *dir)
+{
+    if (create_directory(dir) != 0)
+        return -1;
+
+    DIR *handle = opendir(dir);
+    if (!handle)
+        return -1;
+
+    int result = 0;
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL)
+    {
+        if (!is_profile_data(entry->d_name))
+            continue;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s%s%s", dir, PATH_SEPARATOR, entry->d_name);
+        if (remove(path) != 0)
+            result = -1;
+    }
+    closedir(handle);
+    return result;
+}
+
+static int count_profile_data(const char *dir, const char *suffix)
+{
+    DIR *handle = opendir(dir);
+    if (!handle)
+        return 0;
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL)
+    {
+        if (has_suffix(entry->d_name, suffix))
+            count++;
+    }
+    closedir(handle);
+    return count;
+}
+
+// Turn the counters of a training run into what -fprofile-use reads and
+// tell whose they are, "GNU" or "Clang". GCC reads its .gcda files
+// directly, Clang needs them merged. Returns NULL without any data.
+const char *pgo_merge(const char *dir)
+{
+    int count = count_profile_data(dir, ".gcda");
+    if (count > 0)
+    {
+        printf("Profile data: %d .gcda files\n", count);
+        return "GNU";
+    }
+
+    count = count_profile_data(dir, ".profraw");
+    if (count == 0)
+        return NULL;
+
+    const char *tool = NULL;
+    if (find_program("llvm-profdata"))
+        tool = "llvm-profdata";
+#ifdef __APPLE__
+    else
+        tool = "xcrun llvm-profdata";
+#endif
+
+    if (!tool)
+    {
+        printf("Error: llvm-profdata not found, it is needed to merge Clang profiles\n");
+        return NULL;
+    }
+
+    char command[2048];
+    snprintf(command, sizeof(command), "%s merge -output=\"%s%sdefault.profdata\" \"%s\"%s*.profraw",
+             tool, dir, PATH_SEPARATOR, dir, PATH_SEPARATOR);
+    if (execute_command(command) != 0)
+        return NULL;
+
+    printf("Profile data: %d .profraw files merged into default.profdata\n", count);
+    return "Clang";
+}
+
+static void hash_tree(const char *path, SourceHash *hashes, int *count)
+{
+    DIR *handle = opendir(path);
+    if (!handle)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL && *count < PGO_MAX_SOURCES)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char child[512];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+
+        if (directory_exists(child))
+        {
+            hash_tree(child, hashes, count);
+        }
+        else if (sha256_file_hex(child, hashes[*count].hash) == 0)
+        {
+            snprintf(hashes[*count].path, sizeof(hashes[*count].path), "%s", child);
+            (*count)++;
+        }
+    }
+    closedir(handle);
+}
+
+static SourceHash *hash_sources(int *count)
+{
+    SourceHash *hashes = malloc(PGO_MAX_SOURCES * sizeof(SourceHash));
+    *count = 0;
+    if (hashes)
+        hash_tree("src", hashes, count);
+    return hashes;
+}
+
+// Remember the state of src/ the profile data was trained on
+int pgo_record_sources(const char *dir)
+{
+    int count;
+    SourceHash *hashes = hash_sources(&count);
+    if (!hashes)
+        return -1;
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s%s", dir, PATH_SEPARATOR, PGO_SOURCES_FILE);
+
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        free(hashes);
+        return -1;
+    }
+
+    fprintf(file, "# Sources the profile data was trained on, written by ecewo build pgo\n");
+    for (int i = 0; i < count; i++)
+        fprintf(file, "%s %s\n", hashes[i].hash, hashes[i].path);
+
+    free(hashes);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Percentage of source files changed, added or removed since training,
+// relative to the trained set. -1 if nothing was recorded.
+int pgo_source_drift(const char *dir)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s%s", dir, PATH_SEPARATOR, PGO_SOURCES_FILE);
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    int count;
+    SourceHash *hashes = hash_sources(&count);
+    if (!hashes)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    char *seen = calloc(count > 0 ? count : 1, 1);
+    int recorded = 0, differing = 0;
+    char line[1024];
+
+    while (seen && fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || strlen(line) < SHA256_HEX_SIZE)
+            continue;
+
+        const char *recorded_path = line + SHA256_HEX_SIZE;
+        line[SHA256_HEX_SIZE - 1] = '\0';
+        recorded++;
+
+        int found = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (strcmp(hashes[i].path, recorded_path) != 0)
+                continue;
+
+            seen[i] = 1;
+            found = strcmp(hashes[i].hash, line) == 0;
+            break;
+        }
+        if (!found)
+            differing++;
+    }
+    fclose(file);
+
+    if (!seen)
+    {
+        free(hashes);
+        return -1;
+    }
+
+    // Files that weren't there during training
+    for (int i = 0; i < count; i++)
+    {
+        if (!seen[i])
+            differing++;
+    }
+
+    free(seen);
+    free(hashes);
+
+    if (recorded == 0)
+        return differing > 0 ? 100 : 0;
+    return differing >= recorded ? 100 : differing * 100 / recorded;
+}
+
+// Send one request to the server on port over a fresh connection and
+// read the response to the end. Returns the status code, or -1.
+int pgo_request(int port, const char *method, const char *target, const char *body)
+{
+#ifdef _WIN32
+    (void)port;
+    (void)method;
+    (void)target;
+    (void)body;
+    return -1;
+#else
+    int fd = connect_to_port(port);
+    if (fd < 0)
+        return -1;
+
+    size_t body_len = body ? strlen(body) : 0;
+    size_t size = strlen(method) + strlen(target) + body_len + 256;
+    char *request = malloc(size);
+    if (!request)
+    {
+        close(fd);
+        return -1;
+    }
+
+    int len = snprintf(request, size,
+                       "%s %s HTTP/1.1\r\nHost: 127.0.0.1:%d\r\nConnection: close\r\n"
+                       "%sContent-Length: %zu\r\n\r\n%s",
+                       method, target, port,
+                       body && (body[0] == '{' || body[0] == '[') ? "Content-Type: application/json\r\n" : "",
+                       body_len, body ? body : "");
+
+    int status = -1;
+    if (send(fd, request, len, 0) == len)
+    {
+        char response[4096];
+        size_t received = 0;
+        ssize_t n;
+        while ((n = recv(fd, response + received, sizeof(response) - 1 - received, 0)) > 0)
+        {
+            received += n;
+            // Only the status line matters, the rest is read and dropped
+            if (received == sizeof(response) - 1)
+            {
+                if (status < 0)
+                {
+                    response[received] = '\0';
+                    sscanf(response, "HTTP/%*s %d", &status);
+                }
+                received = 0;
+            }
+        }
+
+        if (status < 0 && received > 0)
+        {
+            response[received] = '\0';
+            sscanf(response, "HTTP/%*s %d", &status);
+        }
+    }
+
+    free(request);
+    close(fd);
+    return status;
+#endif
+}
+
+// Replay the requests in requests_path ("METHOD /path [body]" per line,
+// # for comments) against the server on port until total requests were
+// sent. Without a request file the server's root is requested.
+int pgo_replay(const char *requests_path, int port, int total)
+{
+#ifdef _WIN32
+    (void)requests_path;
+    (void)port;
+    (void)total;
+    return -1;
+#else
+    char *content = file_exists(requests_path) ? read_file(requests_path) : NULL;
+
+    char *lines[1024];
+    int line_count = 0;
+
+    if (content)
+    {
+        char *save = NULL;
+        for (char *line = strtok_r(content, "\n", &save); line && line_count < 1024; line = strtok_r(NULL, "\n", &save))
+        {
+            line[strcspn(line, "\r")] = '\0';
+            if (line[0] == '\0' || line[0] == '#')
+                continue;
+            lines[line_count++] = line;
+        }
+    }
+
+    char fallback[] = "GET /";
+    if (line_count == 0)
+        lines[line_count++] = fallback;
+
+    printf("Replaying %d requests (%d distinct) against port %d...\n", total, line_count, port);
+    fflush(stdout);
+
+    int ok = 0, failed = 0, refused = 0;
+    long long start = monotonic_ms();
+
+    for (int i = 0; i < total; i++)
+    {
+        char request[2048];
+        snprintf(request, sizeof(request), "%s", lines[i % line_count]);
+
+        char *target = strchr(request, ' ');
+        if (!target)
+        {
+            failed++;
+            continue;
+        }
+        *target++ = '\0';
+
+        char *body = strchr(target, ' ');
+        if (body)
+            *body++ = '\0';
+
+        int status = pgo_request(port, request, target, body);
+        if (status < 0)
+            refused++;
+        else if (status < 400)
+            ok++;
+        else
+            failed++;
+    }
+
+    long long elapsed = monotonic_ms() - start;
+    printf("Replayed in %lld ms: %d ok, %d 4xx/5xx, %d without a response\n", elapsed, ok, failed, refused);
+
+    free(content);
+
+    // Error responses still exercise the routing code, lost connections don't
+    return refused == total ? -1 : 0;
+#endif
+}
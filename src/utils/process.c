@@ -0,0 +1,412 @@
+// sched_setaffinity and cpu_set_t are GNU extensions
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "cli.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+// Child processes that ecewo keeps running alongside itself, such as the
+// server in `run --watch`. Exit codes follow the shell convention: a
+// process killed by signal N reports 128 + N, and signaled tells that
+// apart from a process that called exit(128 + N) itself.
+//
+// For restarts without downtime ecewo can own the server's listening
+// socket and pass it on the way systemd socket activation does: as fd 3,
+// announced through LISTEN_FDS=1 and LISTEN_PID. The socket stays open
+// across restarts, so connections queue up instead of being refused while
+// the old process drains and the new one starts accepting.
+
+#define LISTEN_FDS_START 3
+
+#ifndef _WIN32
+static int decode_status(int status, int *signaled)
+{
+    if (signaled)
+        *signaled = WIFSIGNALED(status);
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return -1;
+}
+#endif
+
+// Open a TCP socket listening on every interface at port, for handing
+// to servers. With reuseport several such sockets can share the port and
+// the kernel spreads new connections over them. Returns the fd or -1.
+int open_listen_socket(int port, int reuseport)
+{
+#ifdef _WIN32
+    (void)port;
+    (void)reuseport;
+    return -1;
+#else
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+#ifdef SO_REUSEPORT
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+#else
+    if (reuseport)
+    {
+        close(fd);
+        return -1;
+    }
+#endif
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((unsigned short)port);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // Only the servers get it, not the compilers started in between
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+#endif
+}
+
+// Whether a connection is waiting to be accepted on a listening socket
+int listen_socket_pending(int fd)
+{
+#ifdef _WIN32
+    (void)fd;
+    return 0;
+#else
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+#endif
+}
+
+// Stop listening on fd and close it. Unlike a plain close this also takes
+// the socket away from a server that inherited it, and off the port.
+void close_listen_socket(int fd)
+{
+#ifdef _WIN32
+    (void)fd;
+#else
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+#endif
+}
+
+// Connect to port on the loopback interface. Returns the fd or -1.
+int connect_to_port(int port)
+{
+#ifdef _WIN32
+    (void)port;
+    return -1;
+#else
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+// Wait until something accepts connections on port. Gives up early when
+// the process pid exits. Returns 0 once the port is open.
+int process_wait_port(int pid, int port, int timeout_ms)
+{
+#ifdef _WIN32
+    (void)pid;
+    (void)port;
+    (void)timeout_ms;
+    return -1;
+#else
+    long long deadline = monotonic_ms() + timeout_ms;
+    while (monotonic_ms() < deadline)
+    {
+        int fd = connect_to_port(port);
+        if (fd >= 0)
+        {
+            close(fd);
+            return 0;
+        }
+
+        if (process_poll(pid, NULL, NULL) != 0)
+            return -1;
+        sleep_ms(50);
+    }
+    return -1;
+#endif
+}
+
+// Start argv[0] with the arguments in argv (NULL terminated) inside
+// work_dir. A program without a slash is looked up in PATH. With
+// listen_fd >= 0 the socket is passed on as fd 3 with LISTEN_FDS and
+// LISTEN_PID set. Returns the pid, or -1 if it couldn't be started.
+int process_spawn(const char *work_dir, char *const argv[], int listen_fd)
+{
+    return process_spawn_pinned(work_dir, argv, listen_fd, -1);
+}
+
+// process_spawn on a single CPU, which the process and all its threads
+// stay on. cpu -1 leaves the scheduler free, as does any system without
+// sched_setaffinity.
+int process_spawn_pinned(const char *work_dir, char *const argv[], int listen_fd, int cpu)
+{
+#ifdef _WIN32
+    (void)work_dir;
+    (void)argv;
+    (void)listen_fd;
+    (void)cpu;
+    return -1;
+#else
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+
+    if (pid == 0)
+    {
+        if (work_dir && chdir(work_dir) != 0)
+            _exit(127);
+
+#ifdef __linux__
+        if (cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+#else
+        (void)cpu;
+#endif
+
+        if (listen_fd >= 0)
+        {
+            if (listen_fd != LISTEN_FDS_START && dup2(listen_fd, LISTEN_FDS_START) < 0)
+                _exit(127);
+            fcntl(LISTEN_FDS_START, F_SETFD, 0);
+
+            char pid_value[32];
+            snprintf(pid_value, sizeof(pid_value), "%ld", (long)getpid());
+            setenv("LISTEN_FDS", "1", 1);
+            setenv("LISTEN_PID", pid_value, 1);
+            setenv("LISTEN_FDNAMES", "http", 1);
+        }
+
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    return (int)pid;
+#endif
+}
+
+// Start program (relative to work_dir) inside work_dir, see process_spawn
+int process_start(const char *work_dir, const char *program, int listen_fd)
+{
+    char *argv[] = {(char *)program, NULL};
+    return process_spawn(work_dir, argv, listen_fd);
+}
+
+// Check without blocking whether pid has exited. Returns 1 and its exit
+// code if it has, 0 if it is still running and -1 on error. Either out
+// parameter may be NULL.
+int process_poll(int pid, int *exit_code, int *signaled)
+{
+#ifdef _WIN32
+    (void)pid;
+    (void)exit_code;
+    (void)signaled;
+    return -1;
+#else
+    int status;
+    pid_t result = waitpid((pid_t)pid, &status, WNOHANG);
+    if (result < 0)
+        return -1;
+    if (result == 0)
+        return 0;
+
+    int code = decode_status(status, signaled);
+    if (exit_code)
+        *exit_code = code;
+    return 1;
+#endif
+}
+
+// Check without blocking whether pid has exited, leaving it to be reaped
+// by process_poll or process_stop. Returns 1 if it has, 0 if not.
+int process_exited(int pid)
+{
+#ifdef _WIN32
+    (void)pid;
+    return 0;
+#else
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0)
+        return 0;
+    return info.si_pid == (pid_t)pid;
+#endif
+}
+
+// CPUs ecewo may run on, in order, for pinning processes to distinct
+// ones. Returns how many were written to cpus, 0 if that can't be told.
+int process_cpu_list(int *cpus, int max)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return 0;
+
+    int count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++)
+    {
+        if (CPU_ISSET(cpu, &set))
+            cpus[count++] = cpu;
+    }
+    return count;
+#else
+    (void)cpus;
+    (void)max;
+    return 0;
+#endif
+}
+
+// CPU time and memory of a running process from /proc. Returns -1 where
+// there is no /proc or the process is gone.
+int process_usage(int pid, ProcessUsage *usage)
+{
+#ifdef __linux__
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    char line[1024];
+    int ok = fgets(line, sizeof(line), file) != NULL;
+    fclose(file);
+
+    // The command name in parentheses may hold spaces, fields count from
+    // after it: state is field 3, utime and stime are 14 and 15
+    char *fields = ok ? strrchr(line, ')') : NULL;
+    unsigned long utime, stime;
+    if (!fields || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+        return -1;
+
+    long ticks = sysconf(_SC_CLK_TCK);
+    usage->cpu_ms = (long long)(utime + stime) * 1000 / (ticks > 0 ? ticks : 100);
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    usage->rss_kb = 0;
+    usage->peak_rss_kb = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "VmRSS:", 6) == 0)
+            usage->rss_kb = strtoll(line + 6, NULL, 10);
+        else if (strncmp(line, "VmHWM:", 6) == 0)
+            usage->peak_rss_kb = strtoll(line + 6, NULL, 10);
+    }
+    fclose(file);
+    return 0;
+#else
+    (void)pid;
+    (void)usage;
+    return -1;
+#endif
+}
+
+// Describe an exit code from process_poll or process_stop, telling a
+// crash apart from a normal exit
+void process_describe_exit(int exit_code, int signaled, char *buffer, size_t buffer_size)
+{
+#ifndef _WIN32
+    if (signaled && exit_code > 128)
+    {
+        const char *name = strsignal(exit_code - 128);
+        snprintf(buffer, buffer_size, "killed by signal %d: %s", exit_code - 128, name ? name : "unknown");
+        return;
+    }
+#else
+    (void)signaled;
+#endif
+    snprintf(buffer, buffer_size, "exit code %d", exit_code);
+}
+
+// Ask pid to stop with SIGTERM and wait up to timeout_ms for it to exit,
+// then kill it. Returns its exit code, signaled may be NULL.
+int process_stop(int pid, int timeout_ms, int *signaled)
+{
+#ifdef _WIN32
+    (void)pid;
+    (void)timeout_ms;
+    (void)signaled;
+    return -1;
+#else
+    int exit_code = -1;
+
+    if (signaled)
+        *signaled = 0;
+    if (process_poll(pid, &exit_code, signaled) != 0)
+        return exit_code;
+
+    kill((pid_t)pid, SIGTERM);
+
+    for (int waited = 0; waited < timeout_ms; waited += 10)
+    {
+        if (process_poll(pid, &exit_code, signaled) != 0)
+            return exit_code;
+        sleep_ms(10);
+    }
+
+    kill((pid_t)pid, SIGKILL);
+
+    int status;
+    if (waitpid((pid_t)pid, &status, 0) == (pid_t)pid)
+        exit_code = decode_status(status, signaled);
+    return exit_code;
+#endif
+}
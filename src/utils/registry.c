@@ -0,0 +1,409 @@
+#include "cli.h"
+
+// The plugin registry: every library ecewo install can add, read from
+// the INI-style registry compiled in from src/lib/plugins.ini, then from
+// the file named by ECEWO_REGISTRY and the project's ecewo.plugins. A
+// section in a later file replaces the library of the same name, so a
+// project can pin a version or add a library without a new CLI.
+
+static const char embedded_registry[] =
+#include "lib/plugins_ini.h"
+    ;
+
+Plugin *plugins = NULL;
+int plugin_count = 0;
+static int plugin_capacity = 0;
+
+static char *dup_string(const char *str)
+{
+    size_t len = strlen(str);
+    char *copy = malloc(len + 1);
+    if (copy)
+        memcpy(copy, str, len + 1);
+    return copy;
+}
+
+static char *trim(char *str)
+{
+    while (*str == ' ' || *str == '\t')
+        str++;
+
+    char *end = str + strlen(str);
+    while (end > str && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+        end--;
+    *end = '\0';
+
+    return str;
+}
+
+// Copy of text with every token replaced by value
+static char *replace_all(const char *text, const char *token, const char *value)
+{
+    StringBuilder *sb = sb_create();
+    if (!sb)
+        return NULL;
+
+    size_t token_len = strlen(token);
+    const char *p = text;
+    const char *found;
+    while ((found = strstr(p, token)) != NULL)
+    {
+        char *part = malloc(found - p + 1);
+        if (!part)
+        {
+            sb_free(sb);
+            return NULL;
+        }
+        memcpy(part, p, found - p);
+        part[found - p] = '\0';
+        sb_append(sb, part);
+        sb_append(sb, value);
+        free(part);
+        p = found + token_len;
+    }
+    sb_append(sb, p);
+
+    char *result = dup_string(sb->data);
+    sb_free(sb);
+    return result;
+}
+
+static void clear_plugin(Plugin *plugin)
+{
+    free(plugin->name);
+    free(plugin->description);
+    free(plugin->version);
+    free(plugin->c_url);
+    free(plugin->h_url);
+    free(plugin->git_url);
+    free(plugin->cmake);
+    for (int i = 0; i < plugin->require_count; i++)
+        free(plugin->requires[i]);
+
+    char *id = plugin->id;
+    memset(plugin, 0, sizeof(Plugin));
+    plugin->id = id;
+}
+
+Plugin *registry_find(const char *id)
+{
+    for (int i = 0; i < plugin_count; i++)
+    {
+        if (strcmp(plugins[i].id, id) == 0 || (plugins[i].name && strcmp(plugins[i].name, id) == 0))
+            return &plugins[i];
+    }
+    return NULL;
+}
+
+// The library a section describes, emptied for the section to fill in
+static Plugin *start_section(const char *id)
+{
+    for (int i = 0; i < plugin_count; i++)
+    {
+        if (strcmp(plugins[i].id, id) == 0)
+        {
+            clear_plugin(&plugins[i]);
+            return &plugins[i];
+        }
+    }
+
+    if (plugin_count == plugin_capacity)
+    {
+        int capacity = plugin_capacity ? plugin_capacity * 2 : 16;
+        Plugin *grown = realloc(plugins, sizeof(Plugin) * capacity);
+        if (!grown)
+            return NULL;
+        plugins = grown;
+        plugin_capacity = capacity;
+    }
+
+    Plugin *plugin = &plugins[plugin_count];
+    memset(plugin, 0, sizeof(Plugin));
+    plugin->id = dup_string(id);
+    if (!plugin->id)
+        return NULL;
+
+    plugin_count++;
+    return plugin;
+}
+
+static void set_string(char **field, const char *value)
+{
+    free(*field);
+    *field = dup_string(value);
+}
+
+static void append_line(char **field, const char *line)
+{
+    size_t len = *field ? strlen(*field) : 0;
+    char *grown = realloc(*field, len + strlen(line) + 2);
+    if (!grown)
+        return;
+
+    memcpy(grown + len, line, strlen(line));
+    len += strlen(line);
+    grown[len++] = '\n';
+    grown[len] = '\0';
+    *field = grown;
+}
+
+static int set_requires(Plugin *plugin, char *value, const char *source)
+{
+    char *save = NULL;
+    for (char *id = strtok_r(value, ",", &save); id; id = strtok_r(NULL, ",", &save))
+    {
+        id = trim(id);
+        if (!*id)
+            continue;
+
+        if (plugin->require_count == PLUGIN_MAX_REQUIRES)
+        {
+            printf("Error: %s in %s requires more than %d libraries\n", plugin->id, source, PLUGIN_MAX_REQUIRES);
+            return -1;
+        }
+        plugin->requires[plugin->require_count++] = dup_string(id);
+    }
+    return 0;
+}
+
+static int parse_registry(char *content, const char *source)
+{
+    Plugin *current = NULL;
+    int line_number = 0;
+    char *line = content;
+
+    while (line && *line)
+    {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        line_number++;
+
+        char *text = trim(line);
+        if (*text == '[')
+        {
+            char *close = strchr(text, ']');
+            if (!close)
+            {
+                printf("Error: %s:%d: section name without ]\n", source, line_number);
+                return -1;
+            }
+            *close = '\0';
+            current = start_section(trim(text + 1));
+            if (!current)
+                return -1;
+        }
+        else if (*text && *text != '#')
+        {
+            char *eq = strchr(text, '=');
+            if (!current || !eq)
+            {
+                printf("Error: %s:%d: expected [library] or key = value\n", source, line_number);
+                return -1;
+            }
+
+            // CMake lines keep their indentation past the first space
+            char *line_value = eq[1] == ' ' ? eq + 2 : eq + 1;
+
+            *eq = '\0';
+            char *key = trim(text);
+            char *value = trim(eq + 1);
+
+            if (strcmp(key, "name") == 0)
+                set_string(&current->name, value);
+            else if (strcmp(key, "description") == 0)
+                set_string(&current->description, value);
+            else if (strcmp(key, "version") == 0)
+                set_string(&current->version, value);
+            else if (strcmp(key, "c") == 0)
+                set_string(&current->c_url, value);
+            else if (strcmp(key, "h") == 0)
+                set_string(&current->h_url, value);
+            else if (strcmp(key, "c_sha256") == 0)
+                snprintf(current->c_sha256, sizeof(current->c_sha256), "%s", value);
+            else if (strcmp(key, "h_sha256") == 0)
+                snprintf(current->h_sha256, sizeof(current->h_sha256), "%s", value);
+            else if (strcmp(key, "c_size") == 0)
+                current->c_size = strtoul(value, NULL, 10);
+            else if (strcmp(key, "h_size") == 0)
+                current->h_size = strtoul(value, NULL, 10);
+            else if (strcmp(key, "git") == 0)
+                set_string(&current->git_url, value);
+            else if (strcmp(key, "cmake") == 0)
+                append_line(&current->cmake, value[0] ? line_value : value);
+            else if (strcmp(key, "requires") == 0)
+            {
+                if (set_requires(current, value, source) != 0)
+                    return -1;
+            }
+            else
+                printf("Warning: %s:%d: unknown key %s\n", source, line_number, key);
+        }
+
+        line = next;
+    }
+
+    return 0;
+}
+
+static int load_registry_file(const char *path)
+{
+    char *content = read_file(path);
+    if (!content)
+    {
+        printf("Error: Could not read %s\n", path);
+        return -1;
+    }
+
+    int result = parse_registry(content, path);
+    free(content);
+    return result;
+}
+
+// Fill in what a library's entry leaves implied and reject the ones
+// that can't be installed
+static int finish_plugin(Plugin *plugin)
+{
+    if (!plugin->name)
+        plugin->name = dup_string(plugin->id);
+    if (!plugin->description)
+        plugin->description = dup_string(plugin->name);
+    if (!plugin->version)
+        plugin->version = dup_string("main");
+
+    if (!plugin->c_url != !plugin->h_url)
+    {
+        printf("Error: %s needs both a source (c) and a header (h)\n", plugin->id);
+        return -1;
+    }
+
+    if (!plugin->c_url && !plugin->cmake)
+    {
+        printf("Error: %s has neither files to vendor nor CMake lines\n", plugin->id);
+        return -1;
+    }
+
+    if (plugin->git_url && (!plugin->cmake || !strstr(plugin->cmake, "@REVISION@")))
+    {
+        printf("Error: %s has a git repository but no @REVISION@ to pin\n", plugin->id);
+        return -1;
+    }
+
+    if (plugin->c_url)
+    {
+        char *c_url = replace_all(plugin->c_url, "@VERSION@", plugin->version);
+        char *h_url = replace_all(plugin->h_url, "@VERSION@", plugin->version);
+        if (!c_url || !h_url)
+        {
+            free(c_url);
+            free(h_url);
+            return -1;
+        }
+        free(plugin->c_url);
+        free(plugin->h_url);
+        plugin->c_url = c_url;
+        plugin->h_url = h_url;
+    }
+
+    return 0;
+}
+
+// Load the compiled-in registry and the local files on top of it
+int registry_load(void)
+{
+    char *embedded = dup_string(embedded_registry);
+    if (!embedded)
+        return -1;
+
+    int result = parse_registry(embedded, "built-in registry");
+    free(embedded);
+
+    const char *user_registry = getenv("ECEWO_REGISTRY");
+    if (result == 0 && user_registry && *user_registry)
+        result = load_registry_file(user_registry);
+
+    if (result == 0 && file_exists(PLUGINS_FILE))
+        result = load_registry_file(PLUGINS_FILE);
+
+    for (int i = 0; result == 0 && i < plugin_count; i++)
+        result = finish_plugin(&plugins[i]);
+
+    for (int i = 0; result == 0 && i < plugin_count; i++)
+    {
+        for (int r = 0; r < plugins[i].require_count; r++)
+        {
+            if (!registry_find(plugins[i].requires[r]))
+            {
+                printf("Error: %s requires %s, which is not in the registry\n", plugins[i].id, plugins[i].requires[r]);
+                result = -1;
+            }
+        }
+    }
+
+    return result;
+}
+
+// Depth-first, so a library lands in the plan after its requirements
+static int visit(Plugin *plugin, char *state, Plugin **plan, int *count)
+{
+    int index = (int)(plugin - plugins);
+    if (state[index] == 2)
+        return 0;
+    if (state[index] == 1)
+    {
+        printf("Error: %s requires itself through its dependencies\n", plugin->id);
+        return -1;
+    }
+
+    state[index] = 1;
+    for (int r = 0; r < plugin->require_count; r++)
+    {
+        Plugin *required = registry_find(plugin->requires[r]);
+        if (!required->selected && state[required - plugins] == 0)
+            printf("%s requires %s, adding it\n", plugin->name, required->name);
+        if (visit(required, state, plan, count) != 0)
+            return -1;
+    }
+    state[index] = 2;
+
+    plan[(*count)++] = plugin;
+    return 0;
+}
+
+// Put every selected library and everything it requires into plan
+// (room for plugin_count), each once and after its requirements.
+// Returns how many, or -1 for a dependency cycle.
+int registry_plan(Plugin **plan)
+{
+    char *state = calloc(plugin_count > 0 ? plugin_count : 1, 1);
+    if (!state)
+        return -1;
+
+    int count = 0;
+    for (int i = 0; i < plugin_count; i++)
+    {
+        if (plugins[i].selected && visit(&plugins[i], state, plan, &count) != 0)
+        {
+            free(state);
+            return -1;
+        }
+    }
+
+    free(state);
+    return count;
+}
+
+// Append the CMake lines of plugin with @EXEC@ and @REVISION@ filled in
+void registry_cmake_lines(const Plugin *plugin, const char *exec_name, const char *revision, StringBuilder *sb)
+{
+    if (!plugin->cmake)
+        return;
+
+    char *with_exec = replace_all(plugin->cmake, "@EXEC@", exec_name);
+    char *lines = with_exec ? replace_all(with_exec, "@REVISION@", revision) : NULL;
+    if (lines)
+        sb_append(sb, lines);
+
+    free(with_exec);
+    free(lines);
+}
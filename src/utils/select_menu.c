@@ -56,15 +56,17 @@ int read_key(void)
     }
     return ch;
 #else
-    char c;
-    if (read(STDIN_FILENO, &c, 1) != 1)
+    // Through stdio, which may already hold input read along with the
+    // project name
+    int c = getchar();
+    if (c == EOF)
         return -1;
     if (c == '\x1b')
     { // ESC
-        char seq[2];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1)
+        int seq[2];
+        if ((seq[0] = getchar()) == EOF)
             return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1)
+        if ((seq[1] = getchar()) == EOF)
             return '\x1b';
 
         if (seq[0] == '[')
@@ -102,7 +104,7 @@ void interactive_select(void)
         {
             plugins[current].selected = !plugins[current].selected;
         }
-        else if (c == '\r' || c == '\n')
+        else if (c == '\r' || c == '\n' || c == -1)
         {
             break;
         }
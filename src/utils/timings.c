@@ -0,0 +1,498 @@
+#include "cli.h"
+
+// Build timings for `ecewo build --timings`. Configure is timed per
+// top-level CMake command from the trace CMake writes with --profiling-
+// output, which shows what FetchContent and compiler detection cost. The
+// build is broken down per step from .ninja_log, the only generator that
+// records when each compile and link ran. Every timed build is appended
+// to a history in the build tree, so a slower one stands out.
+
+#define TIMINGS_MAX_STEPS 8192
+#define TIMINGS_MAX_COMMANDS 1024
+#define TIMINGS_MAX_HISTORY 200
+#define TIMINGS_COMPARED_BUILDS 5
+#define TIMINGS_SLOWER_PERCENT 25
+#define TIMINGS_SLOWER_MIN_MS 1000
+
+typedef struct
+{
+    char label[160];
+    long long duration_us;
+} ConfigureCommand;
+
+typedef struct
+{
+    char unit[256];
+    char target[128];
+    long long start_ms;
+    long long end_ms;
+} BuildStep;
+
+typedef struct
+{
+    char target[128];
+    long long total_ms;
+    int steps;
+} TargetTime;
+
+// Whether cmake can write a configure trace, added in CMake 3.18
+int timings_trace_supported(void)
+{
+    FILE *pipe = popen("cmake --version 2>" NULL_DEVICE, POPEN_READ_MODE);
+    if (!pipe)
+        return 0;
+
+    int major = 0, minor = 0;
+    char line[256];
+    if (fgets(line, sizeof(line), pipe))
+        sscanf(line, "cmake version %d.%d", &major, &minor);
+    pclose(pipe);
+
+    return major > 3 || (major == 3 && minor >= 18);
+}
+
+static void format_duration(long long ms, char *buffer, size_t buffer_size)
+{
+    if (ms >= 60000)
+        snprintf(buffer, buffer_size, "%lldm %02llds", ms / 60000, (ms % 60000) / 1000);
+    else if (ms >= 1000)
+        snprintf(buffer, buffer_size, "%.1f s", ms / 1000.0);
+    else
+        snprintf(buffer, buffer_size, "%lld ms", ms);
+}
+
+// Copy the string value of key in one trace event, without its escapes
+static int event_string(const char *event, const char *key, char *value, size_t value_size)
+{
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\" : \"", key);
+
+    const char *start = strstr(event, pattern);
+    if (!start || value_size == 0)
+        return -1;
+    start += strlen(pattern);
+
+    size_t len = 0;
+    for (const char *c = start; *c && *c != '"' && len + 1 < value_size; c++)
+    {
+        if (*c == '\\' && c[1])
+            c++;
+        value[len++] = *c == '\n' || *c == '\t' ? ' ' : *c;
+    }
+    value[len] = '\0';
+    return 0;
+}
+
+static int compare_commands(const void *a, const void *b)
+{
+    long long x = ((const ConfigureCommand *)a)->duration_us;
+    long long y = ((const ConfigureCommand *)b)->duration_us;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Print the limit slowest top-level commands of a configure trace, the
+// Chrome trace format CMake writes: nested "B"/"E" events with the
+// timestamp in microseconds.
+void timings_configure_report(const char *trace_path, int limit)
+{
+    char *content = read_file(trace_path);
+    if (!content)
+        return;
+
+    ConfigureCommand *commands = malloc(TIMINGS_MAX_COMMANDS * sizeof(ConfigureCommand));
+    int count = 0, depth = 0;
+    ConfigureCommand open;
+    long long open_ts = 0;
+
+    // Events are objects of the top-level array, written one "},{" apart
+    char *event = content;
+    while (commands && event)
+    {
+        char *next = strstr(event, "\n},{");
+        if (next)
+            *next = '\0';
+
+        char phase[8], ts[32];
+        if (event_string(event, "ph", phase, sizeof(phase)) == 0)
+        {
+            const char *ts_start = strstr(event, "\"ts\" : ");
+            snprintf(ts, sizeof(ts), "%s", ts_start ? ts_start + 7 : "0");
+
+            if (strcmp(phase, "B") == 0)
+            {
+                if (depth++ == 0)
+                {
+                    char name[64], args[256];
+                    if (event_string(event, "name", name, sizeof(name)) != 0)
+                        snprintf(name, sizeof(name), "?");
+                    if (event_string(event, "functionArgs", args, sizeof(args)) != 0)
+                        args[0] = '\0';
+
+                    snprintf(open.label, sizeof(open.label), "%s(%.*s%s)", name, 60, args,
+                             strlen(args) > 60 ? "..." : "");
+                    open_ts = strtoll(ts, NULL, 10);
+                }
+            }
+            else if (strcmp(phase, "E") == 0 && depth > 0 && --depth == 0 && count < TIMINGS_MAX_COMMANDS)
+            {
+                open.duration_us = strtoll(ts, NULL, 10) - open_ts;
+                commands[count++] = open;
+            }
+        }
+
+        event = next ? next + 4 : NULL;
+    }
+    free(content);
+
+    if (!commands)
+        return;
+
+    qsort(commands, count, sizeof(ConfigureCommand), compare_commands);
+
+    if (count > 0)
+        printf("\nSlowest configure commands:\n");
+    for (int i = 0; i < count && i < limit; i++)
+    {
+        char duration[32];
+        format_duration(commands[i].duration_us / 1000, duration, sizeof(duration));
+        printf("  %10s  %s\n", duration, commands[i].label);
+    }
+
+    free(commands);
+}
+
+// Size of the Ninja log in the build directory, so the steps of the next
+// build can be told from the ones logged before. 0 without a log.
+long long timings_log_mark(void)
+{
+    struct stat st;
+    return stat(".ninja_log", &st) == 0 ? (long long)st.st_size : 0;
+}
+
+// Split a Ninja output like CMakeFiles/app.dir/src/main.c.o into the
+// source and the target it belongs to. Links and custom commands keep
+// their output as the name.
+static void describe_output(const char *output, BuildStep *step)
+{
+    const char *dir = strstr(output, ".dir/");
+    if (!dir)
+    {
+        const char *base = strrchr(output, '/');
+        base = base ? base + 1 : output;
+        snprintf(step->unit, sizeof(step->unit), "%s", output);
+
+        // libsqlite3.a is the link of target sqlite3
+        const char *extension = strrchr(base, '.');
+        int is_library = strncmp(base, "lib", 3) == 0 && extension &&
+                         (strcmp(extension, ".a") == 0 || strcmp(extension, ".so") == 0 || strcmp(extension, ".dylib") == 0);
+        if (is_library)
+            snprintf(step->target, sizeof(step->target), "%.*s", (int)(extension - base - 3), base + 3);
+        else
+            snprintf(step->target, sizeof(step->target), "%s", base);
+        return;
+    }
+
+    const char *target = dir;
+    while (target > output && target[-1] != '/')
+        target--;
+    snprintf(step->target, sizeof(step->target), "%.*s", (int)(dir - target), target);
+
+    snprintf(step->unit, sizeof(step->unit), "%s", dir + 5);
+    size_t len = strlen(step->unit);
+    if (len > 2 && strcmp(step->unit + len - 2, ".o") == 0)
+        step->unit[len - 2] = '\0';
+    else if (len > 4 && strcmp(step->unit + len - 4, ".obj") == 0)
+        step->unit[len - 4] = '\0';
+}
+
+// Steps of the last build from .ninja_log, whose lines are
+// "start<TAB>end<TAB>mtime<TAB>output<TAB>command hash" in milliseconds
+// since that build started
+static int load_steps(long long mark, BuildStep *steps)
+{
+    FILE *file = fopen(".ninja_log", "r");
+    if (!file)
+        return -1;
+
+    // Ninja appends to the log. It only shrinks when Ninja compacts it,
+    // and then the whole log has to be read.
+    if (mark > 0 && timings_log_mark() >= mark)
+        fseek(file, (long)mark, SEEK_SET);
+
+    int count = 0;
+    long long last_end = -1, last_start = -1;
+    char last_hash[32] = "";
+    char line[2048];
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#')
+            continue;
+
+        char *fields[5];
+        int field_count = 0;
+        char *save = NULL;
+        for (char *token = strtok_r(line, "\t\r\n", &save); token && field_count < 5; token = strtok_r(NULL, "\t\r\n", &save))
+            fields[field_count++] = token;
+        if (field_count < 5)
+            continue;
+
+        long long start = strtoll(fields[0], NULL, 10);
+        long long end = strtoll(fields[1], NULL, 10);
+
+        // An edge with several outputs is logged once per output
+        if (start == last_start && end == last_end && strcmp(fields[4], last_hash) == 0)
+            continue;
+
+        // Times restart at 0 with every build, keep only the last one
+        if (end < last_end)
+            count = 0;
+
+        last_start = start;
+        last_end = end;
+        snprintf(last_hash, sizeof(last_hash), "%s", fields[4]);
+
+        if (count < TIMINGS_MAX_STEPS)
+        {
+            steps[count].start_ms = start;
+            steps[count].end_ms = end;
+            describe_output(fields[3], &steps[count]);
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static int compare_step_duration(const void *a, const void *b)
+{
+    const BuildStep *x = a, *y = b;
+    long long dx = x->end_ms - x->start_ms, dy = y->end_ms - y->start_ms;
+    return dx < dy ? 1 : dx > dy ? -1 : 0;
+}
+
+static int compare_target_time(const void *a, const void *b)
+{
+    long long x = ((const TargetTime *)a)->total_ms;
+    long long y = ((const TargetTime *)b)->total_ms;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Ninja doesn't log dependencies, so the critical path is read off the
+// schedule: from the step that finished last, go back to whichever step
+// finished last before it started, and so on. Those are the steps the
+// build was waiting for.
+static void print_critical_path(const BuildStep *steps, int count)
+{
+    int *path = malloc((size_t)count * sizeof(int));
+    if (!path || count == 0)
+    {
+        free(path);
+        return;
+    }
+
+    int current = 0;
+    for (int i = 1; i < count; i++)
+    {
+        if (steps[i].end_ms > steps[current].end_ms)
+            current = i;
+    }
+
+    int length = 0;
+    while (current >= 0 && length < count)
+    {
+        path[length++] = current;
+
+        int previous = -1;
+        for (int i = 0; i < count; i++)
+        {
+            if (i == current || steps[i].end_ms > steps[current].start_ms)
+                continue;
+            if (previous < 0 || steps[i].end_ms > steps[previous].end_ms)
+                previous = i;
+        }
+        current = previous;
+    }
+
+    long long busy = 0;
+    for (int i = 0; i < length; i++)
+        busy += steps[path[i]].end_ms - steps[path[i]].start_ms;
+
+    char duration[32];
+    format_duration(busy, duration, sizeof(duration));
+    printf("\nCritical path (%d steps, %s):\n", length, duration);
+
+    for (int i = length - 1; i >= 0; i--)
+    {
+        const BuildStep *step = &steps[path[i]];
+        format_duration(step->end_ms - step->start_ms, duration, sizeof(duration));
+        printf("  %10s  %s [%s]\n", duration, step->unit, step->target);
+    }
+
+    free(path);
+}
+
+// Print the slowest steps and targets of the build that grew the Ninja
+// log past mark, and its critical path. Fills in the step count and the
+// total work of timings. Returns -1 without a Ninja log.
+int timings_build_report(long long mark, int limit, BuildTimings *timings)
+{
+    BuildStep *steps = malloc(TIMINGS_MAX_STEPS * sizeof(BuildStep));
+    if (!steps)
+        return -1;
+
+    int count = timings_log_mark() == mark && mark > 0 ? 0 : load_steps(mark, steps);
+    if (count < 0)
+    {
+        free(steps);
+        return -1;
+    }
+
+    timings->steps = count;
+    timings->work_ms = 0;
+    for (int i = 0; i < count; i++)
+        timings->work_ms += steps[i].end_ms - steps[i].start_ms;
+
+    if (count == 0)
+    {
+        printf("\nNothing was rebuilt\n");
+        free(steps);
+        return 0;
+    }
+
+    // Before sorting, the critical path reads the schedule in log order
+    print_critical_path(steps, count);
+
+    TargetTime *targets = malloc((size_t)count * sizeof(TargetTime));
+    int target_count = 0;
+    for (int i = 0; targets && i < count; i++)
+    {
+        int found = -1;
+        for (int j = 0; j < target_count && found < 0; j++)
+        {
+            if (strcmp(targets[j].target, steps[i].target) == 0)
+                found = j;
+        }
+        if (found < 0)
+        {
+            found = target_count++;
+            snprintf(targets[found].target, sizeof(targets[found].target), "%s", steps[i].target);
+            targets[found].total_ms = 0;
+            targets[found].steps = 0;
+        }
+        targets[found].total_ms += steps[i].end_ms - steps[i].start_ms;
+        targets[found].steps++;
+    }
+
+    char duration[32];
+    qsort(steps, count, sizeof(BuildStep), compare_step_duration);
+    printf("\nSlowest steps:\n");
+    for (int i = 0; i < count && i < limit; i++)
+    {
+        format_duration(steps[i].end_ms - steps[i].start_ms, duration, sizeof(duration));
+        printf("  %10s  %s [%s]\n", duration, steps[i].unit, steps[i].target);
+    }
+
+    if (targets)
+    {
+        qsort(targets, target_count, sizeof(TargetTime), compare_target_time);
+        printf("\nTime per target:\n");
+        for (int i = 0; i < target_count && i < limit; i++)
+        {
+            format_duration(targets[i].total_ms, duration, sizeof(duration));
+            printf("  %10s  %s (%d step%s)\n", duration, targets[i].target,
+                   targets[i].steps, targets[i].steps == 1 ? "" : "s");
+        }
+    }
+
+    free(targets);
+    free(steps);
+    return 0;
+}
+
+static int compare_long_long(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Compare timings with the last builds that did the same amount of work
+// on as many jobs, then append them to the history at path. Returns 1 if
+// this build was meaningfully slower than those.
+int timings_record(const char *path, const BuildTimings *timings)
+{
+    char *content = file_exists(path) ? read_file(path) : NULL;
+
+    char *lines[TIMINGS_MAX_HISTORY];
+    int line_count = 0;
+    long long similar[TIMINGS_COMPARED_BUILDS];
+    int similar_count = 0;
+
+    if (content)
+    {
+        char *save = NULL;
+        for (char *line = strtok_r(content, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+        {
+            if (line[0] == '#')
+                continue;
+            if (line_count == TIMINGS_MAX_HISTORY)
+            {
+                memmove(lines, lines + 1, (TIMINGS_MAX_HISTORY - 1) * sizeof(char *));
+                line_count--;
+            }
+            lines[line_count++] = line;
+        }
+    }
+
+    // Newest first, so the comparison is with the recent past
+    for (int i = line_count - 1; i >= 0 && similar_count < TIMINGS_COMPARED_BUILDS; i--)
+    {
+        long long when, configure_ms, build_ms, work_ms;
+        int steps, jobs;
+        if (sscanf(lines[i], "%lld %lld %lld %lld %d %d", &when, &configure_ms, &build_ms,
+                   &work_ms, &steps, &jobs) != 6)
+            continue;
+        if (steps == timings->steps && jobs == timings->jobs)
+            similar[similar_count++] = build_ms;
+    }
+
+    int slower = 0;
+    if (timings->steps > 0 && similar_count > 0)
+    {
+        qsort(similar, similar_count, sizeof(long long), compare_long_long);
+        long long median = similar[similar_count / 2];
+        long long percent = median > 0 ? (timings->build_ms - median) * 100 / median : 0;
+
+        char now[32], before[32];
+        format_duration(timings->build_ms, now, sizeof(now));
+        format_duration(median, before, sizeof(before));
+
+        slower = percent > TIMINGS_SLOWER_PERCENT && timings->build_ms - median >= TIMINGS_SLOWER_MIN_MS;
+        if (slower)
+            printf("\nWarning: This build took %s, %lld%% longer than the median of the last %d like it (%s)\n",
+                   now, percent, similar_count, before);
+        else
+            printf("\nCompared with the last %d builds like it: %s now, %s median\n",
+                   similar_count, now, before);
+    }
+
+    FILE *file = fopen(path, "w");
+    if (file)
+    {
+        fprintf(file, "# time configure_ms build_ms work_ms steps jobs, written by ecewo build --timings\n");
+        for (int i = (line_count == TIMINGS_MAX_HISTORY ? 1 : 0); i < line_count; i++)
+            fprintf(file, "%s\n", lines[i]);
+        fprintf(file, "%lld %lld %lld %lld %d %d\n", (long long)time(NULL), timings->configure_ms,
+                timings->build_ms, timings->work_ms, timings->steps, timings->jobs);
+        if (fclose(file) != 0)
+            printf("Warning: Could not record the build timings\n");
+    }
+    else
+    {
+        printf("Warning: Could not record the build timings\n");
+    }
+
+    free(content);
+    return slower;
+}
@@ -0,0 +1,562 @@
+#include "cli.h"
+
+// Memory budget per compile job. A vendored SQLite amalgamation is a
+// single 9 MB translation unit and gets a much larger budget of its own.
+#define BUILD_JOB_MEMORY_MB 512
+#define BUILD_HEAVY_JOB_MEMORY_MB 2048
+
+// Look for an executable called name in PATH
+int find_program(const char *name)
+{
+    const char *path_env = getenv("PATH");
+    if (!name || !path_env)
+        return 0;
+
+#ifdef _WIN32
+    const char list_separator = ';';
+    const char *suffix = ".exe";
+#else
+    const char list_separator = ':';
+    const char *suffix = "";
+#endif
+
+    const char *dir = path_env;
+    while (*dir)
+    {
+        const char *dir_end = strchr(dir, list_separator);
+        size_t dir_len = dir_end ? (size_t)(dir_end - dir) : strlen(dir);
+
+        if (dir_len > 0)
+        {
+            char candidate[1024];
+            int written = snprintf(candidate, sizeof(candidate), "%.*s%s%s%s",
+                                   (int)dir_len, dir, PATH_SEPARATOR, name, suffix);
+#ifdef _WIN32
+            if (written > 0 && (size_t)written < sizeof(candidate) && file_exists(candidate))
+                return 1;
+#else
+            if (written > 0 && (size_t)written < sizeof(candidate) && access(candidate, X_OK) == 0)
+                return 1;
+#endif
+        }
+
+        if (!dir_end)
+            break;
+        dir = dir_end + 1;
+    }
+
+    return 0;
+}
+
+// Generator to pass with -G for a fresh build tree, NULL for CMake's
+// default. A CMAKE_GENERATOR set by the user always wins.
+const char *detect_generator(void)
+{
+    if (getenv("CMAKE_GENERATOR"))
+        return NULL;
+
+    if (find_program("ninja") || find_program("ninja-build"))
+        return "Ninja";
+
+    return NULL;
+}
+
+#ifdef __linux__
+// Read the first line of a cgroup v2 control file
+static int read_cgroup_value(const char *name, char *value, size_t value_size)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "/sys/fs/cgroup/%s", name);
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    int ok = fgets(value, (int)value_size, file) != NULL;
+    fclose(file);
+    return ok ? 0 : -1;
+}
+#endif
+
+// CPUs this process may use, honoring a container CPU quota
+int detect_cpu_count(void)
+{
+    int cpus = 1;
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    cpus = (int)info.dwNumberOfProcessors;
+#else
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0)
+        cpus = (int)online;
+#endif
+
+#ifdef __linux__
+    // "max 100000" means no quota, "200000 100000" means two CPUs
+    char value[64];
+    if (read_cgroup_value("cpu.max", value, sizeof(value)) == 0 && strncmp(value, "max", 3) != 0)
+    {
+        long quota = 0, period = 0;
+        if (sscanf(value, "%ld %ld", &quota, &period) == 2 && quota > 0 && period > 0)
+        {
+            int limit = (int)((quota + period - 1) / period);
+            if (limit < cpus)
+                cpus = limit;
+        }
+    }
+#endif
+
+    return cpus > 0 ? cpus : 1;
+}
+
+// Memory available for new processes in MB, -1 if unknown
+long long detect_available_memory_mb(void)
+{
+    long long available = -1;
+
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status))
+        available = (long long)(status.ullAvailPhys / (1024 * 1024));
+#elif defined(__linux__)
+    FILE *file = fopen("/proc/meminfo", "r");
+    if (file)
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), file))
+        {
+            long long kb;
+            if (sscanf(line, "MemAvailable: %lld kB", &kb) == 1)
+            {
+                available = kb / 1024;
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    // A container memory limit can be far below what the host has free
+    char max_value[64], current_value[64];
+    if (read_cgroup_value("memory.max", max_value, sizeof(max_value)) == 0 &&
+        strncmp(max_value, "max", 3) != 0 &&
+        read_cgroup_value("memory.current", current_value, sizeof(current_value)) == 0)
+    {
+        long long limit = atoll(max_value) / (1024 * 1024);
+        long long used = atoll(current_value) / (1024 * 1024);
+        if (limit > 0 && (available < 0 || limit - used < available))
+            available = limit > used ? limit - used : 0;
+    }
+#elif defined(_SC_AVPHYS_PAGES)
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0)
+        available = (long long)pages * page_size / (1024 * 1024);
+#endif
+
+    return available;
+}
+
+// Parallel compile jobs for this machine: one per CPU, as long as the
+// available memory covers the per-job budget. heavy reserves room for one
+// SQLite-sized translation unit.
+int choose_build_jobs(int cpus, long long memory_mb, int heavy)
+{
+    int jobs = cpus > 0 ? cpus : 1;
+
+    if (memory_mb >= 0)
+    {
+        long long memory_jobs;
+        if (heavy)
+        {
+            long long rest = memory_mb - BUILD_HEAVY_JOB_MEMORY_MB;
+            memory_jobs = 1 + (rest > 0 ? rest / BUILD_JOB_MEMORY_MB : 0);
+        }
+        else
+        {
+            memory_jobs = memory_mb / BUILD_JOB_MEMORY_MB;
+        }
+
+        if (memory_jobs < jobs)
+            jobs = (int)memory_jobs;
+    }
+
+    return jobs > 0 ? jobs : 1;
+}
+
+// Value of key in a CMakeCache.txt ("KEY:TYPE=value"), NULL if unset
+char *cmake_cache_value(const char *cache_path, const char *key)
+{
+    FILE *file = fopen(cache_path, "r");
+    if (!file)
+        return NULL;
+
+    char line[1024];
+    char *value = NULL;
+    size_t key_len = strlen(key);
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, key, key_len) != 0 || line[key_len] != ':')
+            continue;
+
+        char *start = strchr(line + key_len, '=');
+        if (!start)
+            continue;
+
+        start++;
+        start[strcspn(start, "\r\n")] = '\0';
+        if (*start)
+        {
+            value = malloc(strlen(start) + 1);
+            if (value)
+                strcpy(value, start);
+        }
+        break;
+    }
+
+    fclose(file);
+    return value;
+}
+
+// Compiler cache to use as CMAKE_C_COMPILER_LAUNCHER, NULL if none is
+// installed or the user picked a launcher through the environment
+const char *detect_compiler_launcher(void)
+{
+    if (getenv("CMAKE_C_COMPILER_LAUNCHER"))
+        return NULL;
+
+    if (find_program("ccache"))
+        return "ccache";
+
+    if (find_program("sccache"))
+        return "sccache";
+
+    return NULL;
+}
+
+static void set_default_env(const char *name, const char *value)
+{
+    const char *current = getenv(name);
+    if (current && *current)
+        return;
+
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// Point the compiler cache at a directory shared by every project, unless
+// the user configured one. Compiles inherit the environment of ecewo.
+// Returns 0 and the directory in use, -1 if it couldn't be set up.
+int prepare_compiler_cache(const char *launcher, char *dir, size_t dir_size)
+{
+    const char *dir_env = strcmp(launcher, "sccache") == 0 ? "SCCACHE_DIR" : "CCACHE_DIR";
+    const char *current = getenv(dir_env);
+
+    if (current && *current)
+    {
+        snprintf(dir, dir_size, "%s", current);
+        return 0;
+    }
+
+    if (cache_dir(dir, dir_size, launcher) != 0 || create_directory(dir) != 0)
+        return -1;
+
+    set_default_env(dir_env, dir);
+
+    // Hash paths relative to the project so hits carry over between
+    // checkouts in different directories
+    if (strcmp(launcher, "ccache") == 0)
+    {
+        char project_dir[1024];
+        if (getcwd(project_dir, sizeof(project_dir)))
+            set_default_env("CCACHE_BASEDIR", project_dir);
+    }
+
+    return 0;
+}
+
+// Parse "<label> <number>" where label must be followed by whitespace or
+// a tab, so "Cache hits rate" doesn't count as "Cache hits"
+static int read_counter(const char *line, const char *label, long *value)
+{
+    size_t label_len = strlen(label);
+    if (strncmp(line, label, label_len) != 0)
+        return 0;
+
+    const char *rest = line + label_len;
+    if (*rest != ' ' && *rest != '\t')
+        return 0;
+
+    char *end;
+    long parsed = strtol(rest, &end, 10);
+    if (end == rest)
+        return 0;
+
+    *value += parsed;
+    return 1;
+}
+
+// Cumulative hit and miss counters of the compiler cache. ccache 4 has a
+// machine readable --print-stats, ccache 3 and sccache only print a table.
+int compiler_cache_counts(const char *launcher, long *hits, long *misses)
+{
+    char command[128];
+    char line[512];
+    int found = 0;
+
+    *hits = 0;
+    *misses = 0;
+
+    if (strcmp(launcher, "sccache") == 0)
+        snprintf(command, sizeof(command), "sccache --show-stats 2>%s", NULL_DEVICE);
+    else
+        snprintf(command, sizeof(command), "ccache --print-stats 2>%s", NULL_DEVICE);
+
+    FILE *pipe = popen(command, POPEN_READ_MODE);
+    if (pipe)
+    {
+        while (fgets(line, sizeof(line), pipe))
+        {
+            found |= read_counter(line, "direct_cache_hit", hits);
+            found |= read_counter(line, "preprocessed_cache_hit", hits);
+            found |= read_counter(line, "cache_miss", misses);
+            found |= read_counter(line, "Cache hits", hits);
+            found |= read_counter(line, "Cache misses", misses);
+        }
+        pclose(pipe);
+    }
+
+    if (found || strcmp(launcher, "ccache") != 0)
+        return found ? 0 : -1;
+
+    // ccache 3.x
+    snprintf(command, sizeof(command), "ccache -s 2>%s", NULL_DEVICE);
+    pipe = popen(command, POPEN_READ_MODE);
+    if (!pipe)
+        return -1;
+
+    while (fgets(line, sizeof(line), pipe))
+    {
+        // Labels are padded with spaces up to the value
+        const char *labels[] = {"cache hit (direct)", "cache hit (preprocessed)", "cache miss"};
+        for (int i = 0; i < 3; i++)
+            found |= read_counter(line, labels[i], i < 2 ? hits : misses);
+    }
+    pclose(pipe);
+
+    return found ? 0 : -1;
+}
+
+// Read a profile recorded by profile_save. A missing file is the empty
+// profile.
+int profile_load(BuildProfile *profile, const char *path)
+{
+    memset(profile, 0, sizeof(BuildProfile));
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *value = strchr(line, '=');
+        if (line[0] == '#' || !value)
+            continue;
+        *value++ = '\0';
+
+        if (strcmp(line, "lto") == 0)
+            profile->lto = strcmp(value, "on") == 0;
+        else if (strcmp(line, "no_plt") == 0)
+            profile->no_plt = strcmp(value, "on") == 0;
+        else if (strcmp(line, "gc_sections") == 0)
+            profile->gc_sections = strcmp(value, "on") == 0;
+        else if (strcmp(line, "march") == 0)
+            snprintf(profile->march, sizeof(profile->march), "%s", value);
+        else if (strcmp(line, "pgo") == 0)
+            snprintf(profile->pgo, sizeof(profile->pgo), "%s", value);
+        else if (strcmp(line, "layout") == 0)
+            snprintf(profile->layout, sizeof(profile->layout), "%s", value);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int profile_save(const BuildProfile *profile, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    fprintf(file, "# Optimizations of this build tree, written by ecewo build prod\n");
+    fprintf(file, "lto=%s\n", profile->lto ? "on" : "off");
+    fprintf(file, "no_plt=%s\n", profile->no_plt ? "on" : "off");
+    fprintf(file, "gc_sections=%s\n", profile->gc_sections ? "on" : "off");
+    fprintf(file, "march=%s\n", profile->march);
+    fprintf(file, "pgo=%s\n", profile->pgo);
+    fprintf(file, "layout=%s\n", profile->layout);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+int profile_equal(const BuildProfile *a, const BuildProfile *b)
+{
+    return a->lto == b->lto && a->no_plt == b->no_plt &&
+           a->gc_sections == b->gc_sections && strcmp(a->march, b->march) == 0 &&
+           strcmp(a->pgo, b->pgo) == 0 && strcmp(a->layout, b->layout) == 0;
+}
+
+void profile_describe(const BuildProfile *profile, char *buffer, size_t buffer_size)
+{
+    const char *pgo = "";
+    if (strcmp(profile->pgo, PGO_GENERATE) == 0)
+        pgo = "PGO-instrumented ";
+    else if (profile->pgo[0])
+        pgo = "PGO ";
+
+    const char *layout = "";
+    if (strcmp(profile->layout, LAYOUT_GPROF) == 0)
+        layout = "gprof-instrumented ";
+    else if (strcmp(profile->layout, LAYOUT_BOLT) == 0)
+        layout = "BOLT-ready ";
+    else if (profile->layout[0])
+        layout = "ordered-functions ";
+
+    snprintf(buffer, buffer_size, "%s%s%s%s%s%s%s%s",
+             pgo,
+             layout,
+             profile->lto ? "LTO " : "",
+             profile->march[0] ? "-march=" : "",
+             profile->march,
+             profile->march[0] ? " " : "",
+             profile->no_plt ? "no-PLT " : "",
+             profile->gc_sections ? "gc-sections " : "");
+
+    size_t len = strlen(buffer);
+    if (len == 0)
+        snprintf(buffer, buffer_size, "plain Release");
+    else
+        buffer[len - 1] = '\0';
+}
+
+// CMake cache options for a profile. Flags are always passed, even when
+// empty, so turning an option off on a configured tree takes effect.
+// CMAKE_C_FLAGS and the linker flags reach ecewo and every vendor and
+// FetchContent target, not just the application. pgo_dir is the absolute
+// path of the profile data.
+void profile_cmake_args(const BuildProfile *profile, const char *pgo_dir, StringBuilder *sb)
+{
+    if (profile->lto)
+    {
+        // Older minimum versions in dependencies would ignore IPO otherwise.
+        // Projects that don't need the policy default would warn about it.
+        sb_append(sb, " -DCMAKE_INTERPROCEDURAL_OPTIMIZATION=ON -DCMAKE_POLICY_DEFAULT_CMP0069=NEW --no-warn-unused-cli");
+    }
+    else
+    {
+        sb_append(sb, " -DCMAKE_INTERPROCEDURAL_OPTIMIZATION=OFF");
+    }
+
+    StringBuilder *c_flags = sb_create();
+    StringBuilder *link_flags = sb_create();
+    if (!c_flags || !link_flags)
+    {
+        sb_free(c_flags);
+        sb_free(link_flags);
+        return;
+    }
+
+    // Keep the user's CFLAGS, which CMake would only read on its own for
+    // a tree configured without CMAKE_C_FLAGS
+    const char *env_flags = getenv("CFLAGS");
+    if (env_flags && *env_flags)
+        sb_append(c_flags, env_flags);
+
+    if (profile->march[0])
+    {
+        sb_append(c_flags, " -march=");
+        sb_append(c_flags, profile->march);
+    }
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+    // Only meaningful for ELF targets
+    if (profile->no_plt)
+        sb_append(c_flags, " -fno-plt -fno-semantic-interposition");
+#endif
+
+    // Both GCC and Clang take a directory: GCC finds its .gcda files
+    // there, Clang reads default.profdata from it
+    if (strcmp(profile->pgo, PGO_GENERATE) == 0)
+    {
+        sb_append(c_flags, " -fprofile-update=atomic -fprofile-generate=");
+        sb_append(c_flags, pgo_dir);
+    }
+    else if (profile->pgo[0])
+    {
+        sb_append(c_flags, " -fprofile-use=");
+        sb_append(c_flags, pgo_dir);
+
+        // Functions changed since training just go unoptimized
+        if (strcmp(profile->pgo, "GNU") == 0)
+            sb_append(c_flags, " -Wno-missing-profile -Wno-coverage-mismatch");
+        else
+            sb_append(c_flags, " -Wno-profile-instr-out-of-date -Wno-profile-instr-unprofiled");
+    }
+
+    // Function order: BOLT needs the relocations kept in the binary, the
+    // linkers need every function in a section of its own
+    if (strcmp(profile->layout, LAYOUT_GPROF) == 0)
+    {
+        sb_append(c_flags, " -pg");
+        sb_append(link_flags, " -pg");
+    }
+    else if (strcmp(profile->layout, LAYOUT_BOLT) == 0)
+    {
+        sb_append(link_flags, " -Wl,--emit-relocs");
+    }
+    else if (profile->layout[0])
+    {
+        if (!profile->gc_sections)
+            sb_append(c_flags, " -ffunction-sections");
+
+        sb_append(link_flags, " -fuse-ld=");
+        sb_append(link_flags, profile->layout);
+        if (strcmp(profile->layout, "gold") == 0)
+            sb_append(link_flags, " -Wl,--section-ordering-file=");
+        else
+            sb_append(link_flags, " -Wl,--no-warn-symbol-ordering -Wl,--symbol-ordering-file=");
+        sb_append(link_flags, pgo_dir);
+        sb_append(link_flags, PATH_SEPARATOR);
+        sb_append(link_flags, strcmp(profile->layout, "gold") == 0 ? LAYOUT_SECTION_ORDER_FILE : LAYOUT_ORDER_FILE);
+    }
+
+    if (profile->gc_sections)
+    {
+        sb_append(c_flags, " -ffunction-sections -fdata-sections");
+#ifdef __APPLE__
+        sb_append(link_flags, " -Wl,-dead_strip");
+#else
+        sb_append(link_flags, " -Wl,--gc-sections");
+#endif
+    }
+
+    const char *c_value = c_flags->data[0] == ' ' ? c_flags->data + 1 : c_flags->data;
+    const char *link_value = link_flags->data[0] == ' ' ? link_flags->data + 1 : link_flags->data;
+    sb_append(sb, " \"-DCMAKE_C_FLAGS=");
+    sb_append(sb, c_value);
+    sb_append(sb, "\" \"-DCMAKE_EXE_LINKER_FLAGS=");
+    sb_append(sb, link_value);
+    sb_append(sb, "\"");
+
+    sb_free(c_flags);
+    sb_free(link_flags);
+}
@@ -0,0 +1,551 @@
+#include "cli.h"
+#include <dirent.h>
+
+// Unity builds for `ecewo build --unity`. CMake compiles batches of a
+// target's sources as one translation unit, so ecewo's headers are parsed
+// once per batch instead of once per file. What C allows in separate
+// files breaks in one: two static functions or variables of the same
+// name, a struct or typedef defined twice, a macro defined differently.
+// Before every unity build the sources are scanned for those and the
+// ones that would clash are listed in ecewo.unity, next to the project's
+// own exclusions, to be compiled on their own.
+
+#define UNITY_MAX_SOURCES 4096
+#define UNITY_LARGE_SOURCE (1024 * 1024) // Amalgamations, a batch of their own anyway
+#define UNITY_STATEMENT_MAX 1024
+#define UNITY_SYMBOL_MAX 128
+#define UNITY_BUCKETS 4096
+#define UNITY_MARKER "# Found by ecewo"
+
+typedef struct
+{
+    char name[UNITY_SYMBOL_MAX];  // "struct x" for tags, "#X" for macros
+    char value[UNITY_SYMBOL_MAX]; // Replacement text of a macro
+} UnitySymbol;
+
+typedef struct
+{
+    char path[512];
+    UnitySymbol *symbols;
+    int count;
+    int capacity;
+} UnitySource;
+
+typedef struct UnityKept
+{
+    const UnitySymbol *symbol;
+    const char *path;
+    struct UnityKept *next;
+} UnityKept;
+
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+static int is_identifier_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void list_sources(const char *path, char (*paths)[512], int *count)
+{
+    DIR *handle = opendir(path);
+    if (!handle)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL && *count < UNITY_MAX_SOURCES)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char child[512];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+
+        if (directory_exists(child))
+            list_sources(child, paths, count);
+        else if (has_suffix(entry->d_name, ".c"))
+            snprintf(paths[(*count)++], 512, "%s", child);
+    }
+    closedir(handle);
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+static void add_symbol(UnitySource *source, const char *prefix, const char *name, size_t len, const char *value)
+{
+    char full[UNITY_SYMBOL_MAX];
+    snprintf(full, sizeof(full), "%s%.*s", prefix, (int)len, name);
+
+    for (int i = 0; i < source->count; i++)
+    {
+        if (strcmp(source->symbols[i].name, full) == 0)
+            return;
+    }
+
+    if (source->count == source->capacity)
+    {
+        int capacity = source->capacity ? source->capacity * 2 : 32;
+        UnitySymbol *grown = realloc(source->symbols, sizeof(UnitySymbol) * capacity);
+        if (!grown)
+            return;
+        source->symbols = grown;
+        source->capacity = capacity;
+    }
+
+    UnitySymbol *symbol = &source->symbols[source->count++];
+    snprintf(symbol->name, sizeof(symbol->name), "%s", full);
+    snprintf(symbol->value, sizeof(symbol->value), "%s", value ? value : "");
+}
+
+static void remove_symbol(UnitySource *source, const char *name)
+{
+    for (int i = 0; i < source->count; i++)
+    {
+        if (strcmp(source->symbols[i].name, name) == 0)
+        {
+            source->symbols[i] = source->symbols[--source->count];
+            return;
+        }
+    }
+}
+
+// The identifier that ends right before end, NULL if there is none
+static const char *identifier_before(const char *start, const char *end, size_t *len)
+{
+    while (end > start && !is_identifier_char(end[-1]))
+        end--;
+
+    const char *begin = end;
+    while (begin > start && is_identifier_char(begin[-1]))
+        begin--;
+
+    *len = (size_t)(end - begin);
+    return *len > 0 && !(*begin >= '0' && *begin <= '9') ? begin : NULL;
+}
+
+static int starts_with_word(const char *text, const char *word)
+{
+    size_t len = strlen(word);
+    return strncmp(text, word, len) == 0 && !is_identifier_char(text[len]);
+}
+
+// The struct, union or enum tag whose body the declaration opens, as in
+// "struct point {" but not "static struct point origin = {"
+static void add_tag(UnitySource *source, const char *statement)
+{
+    const char *end = statement + strlen(statement);
+    size_t len;
+    const char *name = identifier_before(statement, end, &len);
+    if (!name)
+        return;
+
+    const char *kinds[] = {"struct ", "union ", "enum "};
+    for (int i = 0; i < 3; i++)
+    {
+        size_t kind_len = strlen(kinds[i]);
+        const char *kind = name - kind_len;
+        if (kind >= statement && strncmp(kind, kinds[i], kind_len) == 0 &&
+            (kind == statement || !is_identifier_char(kind[-1])))
+        {
+            add_symbol(source, kinds[i], name, len, NULL);
+            return;
+        }
+    }
+}
+
+// A file-scope declaration, from its start to the ; that ends it with
+// any braced body left out
+static void add_declaration(UnitySource *source, const char *statement)
+{
+    size_t len;
+    const char *name;
+
+    if (starts_with_word(statement, "typedef"))
+    {
+        // The declared name is the last one, unless it's a function
+        // pointer type: typedef void (*name)(void);
+        const char *paren = strstr(statement, "(*");
+        const char *end = paren ? strchr(paren, ')') : statement + strlen(statement);
+        if ((name = identifier_before(statement, end ? end : statement + strlen(statement), &len)) != NULL)
+            add_symbol(source, "", name, len, NULL);
+        return;
+    }
+
+    if (!starts_with_word(statement, "static"))
+        return;
+
+    // static int name(...), static char name[...], static int name = ...
+    const char *end = statement + strcspn(statement, "([=;,");
+    if (*end == '(' && end[1] == '*')
+        end = strchr(end, ')') ? strchr(end, ')') : end;
+    if ((name = identifier_before(statement, end, &len)) != NULL)
+        add_symbol(source, "", name, len, NULL);
+}
+
+static void add_directive(UnitySource *source, const char *line)
+{
+    while (*line == ' ' || *line == '\t' || *line == '#')
+        line++;
+
+    int define = starts_with_word(line, "define");
+    if (!define && !starts_with_word(line, "undef"))
+        return;
+
+    const char *name = line + (define ? strlen("define") : strlen("undef"));
+    while (*name == ' ' || *name == '\t')
+        name++;
+
+    size_t len = 0;
+    while (is_identifier_char(name[len]))
+        len++;
+    if (len == 0)
+        return;
+
+    char key[UNITY_SYMBOL_MAX];
+    snprintf(key, sizeof(key), "#%.*s", (int)len, name);
+
+    // A macro undefined again doesn't reach the next file
+    remove_symbol(source, key);
+    if (define)
+    {
+        const char *value = name + len;
+        while (*value == ' ' || *value == '\t')
+            value++;
+        add_symbol(source, "#", name, len, value);
+    }
+}
+
+// Collect what a source defines at file scope. Not a C parser: comments,
+// strings and preprocessor lines are skipped, braces counted, and what is
+// left at depth 0 split into declarations.
+static int scan_source(UnitySource *source)
+{
+    char *content = read_file(source->path);
+    if (!content)
+        return -1;
+
+    char statement[UNITY_STATEMENT_MAX];
+    size_t used = 0;
+    int depth = 0;
+    int line_start = 1;
+
+    for (char *p = content; *p; p++)
+    {
+        if (line_start && (*p == ' ' || *p == '\t'))
+            continue;
+
+        if (line_start && *p == '#')
+        {
+            // Join continued lines, the directive ends at the first plain newline
+            char directive[UNITY_STATEMENT_MAX];
+            size_t len = 0;
+            while (*p && *p != '\n')
+            {
+                if (*p == '\\' && (p[1] == '\n' || (p[1] == '\r' && p[2] == '\n')))
+                    p += p[1] == '\r' ? 2 : 1;
+                else if (*p != '\r' && len + 1 < sizeof(directive))
+                    directive[len++] = *p;
+                p++;
+            }
+            directive[len] = '\0';
+            add_directive(source, directive);
+            if (!*p)
+                break;
+            continue;
+        }
+        line_start = *p == '\n';
+
+        if (p[0] == '/' && p[1] == '/')
+        {
+            while (p[1] && p[1] != '\n')
+                p++;
+            continue;
+        }
+        if (p[0] == '/' && p[1] == '*')
+        {
+            char *close = strstr(p + 2, "*/");
+            if (!close)
+                break;
+            p = close + 1;
+            continue;
+        }
+        if (*p == '"' || *p == '\'')
+        {
+            char quote = *p;
+            while (p[1] && p[1] != quote && p[1] != '\n')
+                p += p[1] == '\\' && p[2] ? 2 : 1;
+            if (p[1])
+                p++;
+            if (depth == 0 && used + 3 < sizeof(statement))
+            {
+                statement[used++] = quote;
+                statement[used++] = quote;
+            }
+            continue;
+        }
+
+        if (*p == '{')
+        {
+            if (depth++ == 0)
+            {
+                statement[used] = '\0';
+                if (strchr(statement, '('))
+                {
+                    // A function body, nothing declared after it
+                    add_declaration(source, statement);
+                    used = 0;
+                }
+                else
+                {
+                    add_tag(source, statement);
+                }
+            }
+            continue;
+        }
+        if (*p == '}')
+        {
+            if (depth > 0)
+                depth--;
+            continue;
+        }
+        if (depth > 0)
+            continue;
+
+        if (*p == ';')
+        {
+            statement[used] = '\0';
+            add_declaration(source, statement);
+            used = 0;
+            continue;
+        }
+
+        // Whitespace collapsed to single spaces, none at the start
+        char c = (*p == '\n' || *p == '\r' || *p == '\t') ? ' ' : *p;
+        if ((c == ' ' && (used == 0 || statement[used - 1] == ' ')) || used + 1 >= sizeof(statement))
+            continue;
+        statement[used++] = c;
+    }
+
+    free(content);
+    return 0;
+}
+
+static unsigned hash_name(const char *name)
+{
+    unsigned hash = 5381;
+    while (*name)
+        hash = hash * 33 + (unsigned char)*name++;
+    return hash % UNITY_BUCKETS;
+}
+
+// What of source clashes with the sources kept so far, NULL if nothing.
+// The same macro with the same replacement twice is fine.
+static const UnityKept *find_clash(UnityKept **kept, const UnitySource *source, const UnitySymbol **symbol)
+{
+    for (int i = 0; i < source->count; i++)
+    {
+        const UnitySymbol *own = &source->symbols[i];
+        for (const UnityKept *other = kept[hash_name(own->name)]; other; other = other->next)
+        {
+            if (strcmp(other->symbol->name, own->name) != 0)
+                continue;
+            if (own->name[0] == '#' && strcmp(other->symbol->value, own->value) == 0)
+                continue;
+
+            *symbol = own;
+            return other;
+        }
+    }
+    return NULL;
+}
+
+// Decide which sources of one target go into batches. The first of two
+// clashing sources stays in, the later one is listed with the reason.
+static int plan_target(const char *dir, StringBuilder *found)
+{
+    char (*paths)[512] = malloc(UNITY_MAX_SOURCES * sizeof(*paths));
+    UnitySource *sources = calloc(UNITY_MAX_SOURCES, sizeof(UnitySource));
+    UnityKept **kept = calloc(UNITY_BUCKETS, sizeof(UnityKept *));
+    int count = 0;
+
+    if (!paths || !sources || !kept)
+    {
+        free(paths);
+        free(sources);
+        free(kept);
+        return -1;
+    }
+
+    list_sources(dir, paths, &count);
+    qsort(paths, count, sizeof(*paths), compare_paths);
+
+    char (*reasons)[512] = calloc(count > 0 ? count : 1, sizeof(*reasons));
+    int total = 0;
+    for (int i = 0; reasons && i < count; i++)
+    {
+        snprintf(sources[i].path, sizeof(sources[i].path), "%s", paths[i]);
+
+        struct stat st;
+        if (stat(sources[i].path, &st) == 0 && st.st_size > UNITY_LARGE_SOURCE)
+            snprintf(reasons[i], sizeof(reasons[i]), "over %d KB", UNITY_LARGE_SOURCE / 1024);
+        else if (scan_source(&sources[i]) != 0)
+            snprintf(reasons[i], sizeof(reasons[i]), "could not be read");
+        total += sources[i].count;
+    }
+
+    UnityKept *entries = reasons ? malloc((total > 0 ? total : 1) * sizeof(UnityKept)) : NULL;
+    int used = 0, excluded = entries ? 0 : -1;
+
+    for (int i = 0; entries && i < count; i++)
+    {
+        const UnitySymbol *symbol = NULL;
+        const UnityKept *clash = reasons[i][0] ? NULL : find_clash(kept, &sources[i], &symbol);
+        if (clash)
+        {
+            int macro = symbol->name[0] == '#';
+            snprintf(reasons[i], sizeof(reasons[i]), "%s%s also in %s",
+                     macro ? "macro " : "", symbol->name + macro, clash->path);
+        }
+
+        if (reasons[i][0])
+        {
+            sb_append(found, "# ");
+            sb_append(found, reasons[i]);
+            sb_append(found, "\n");
+            sb_append(found, sources[i].path);
+            sb_append(found, "\n");
+            excluded++;
+            continue;
+        }
+
+        for (int s = 0; s < sources[i].count; s++)
+        {
+            UnityKept *entry = &entries[used++];
+            unsigned bucket = hash_name(sources[i].symbols[s].name);
+            entry->symbol = &sources[i].symbols[s];
+            entry->path = sources[i].path;
+            entry->next = kept[bucket];
+            kept[bucket] = entry;
+        }
+    }
+
+    free(entries);
+    free(reasons);
+    free(kept);
+    for (int i = 0; i < count; i++)
+        free(sources[i].symbols);
+    free(sources);
+    free(paths);
+    return excluded;
+}
+
+// Rewrite the part of ecewo.unity below the marker with what the scan
+// found, keeping the project's own lines above it. The file is only
+// written when it changes, CMake reconfigures when it does.
+int unity_update_exclusions(void)
+{
+    StringBuilder *found = sb_create();
+    StringBuilder *content = sb_create();
+    if (!found || !content)
+    {
+        sb_free(found);
+        sb_free(content);
+        return -1;
+    }
+
+    // Application and vendors are separate targets, never in one batch
+    int app = plan_target("src", found);
+    int vendors = directory_exists("vendors") ? plan_target("vendors", found) : 0;
+
+    char *existing = read_file(UNITY_EXCLUDE_FILE);
+    if (existing)
+    {
+        char *marker = strstr(existing, UNITY_MARKER);
+        if (marker)
+            *marker = '\0';
+        sb_append(content, existing);
+        if (marker)
+            *marker = UNITY_MARKER[0];
+    }
+    else
+    {
+        sb_append(content,
+                  "# Sources compiled on their own in unity builds (ecewo build --unity),\n"
+                  "# one path per line. Add yours here; everything below the line ecewo\n"
+                  "# writes is replaced on every unity build.\n"
+                  "\n");
+    }
+
+    sb_append(content, UNITY_MARKER " (static names, types or macros that clash)\n");
+    sb_append(content, found->data);
+
+    int result = app < 0 || vendors < 0 ? -1 : app + vendors;
+    if (result >= 0 && (!existing || strcmp(existing, content->data) != 0) &&
+        write_file(UNITY_EXCLUDE_FILE, content->data) != 0)
+    {
+        printf("Error: Could not write %s\n", UNITY_EXCLUDE_FILE);
+        result = -1;
+    }
+
+    free(existing);
+    sb_free(found);
+    sb_free(content);
+    return result;
+}
+
+// Batch size for the application built with jobs in parallel:
+// enough batches to keep every job busy, none so large that one edit
+// recompiles half the application
+int unity_batch_size(int jobs)
+{
+    char (*paths)[512] = malloc(UNITY_MAX_SOURCES * sizeof(*paths));
+    int count = 0;
+    if (paths)
+        list_sources("src", paths, &count);
+    free(paths);
+
+    int batch = jobs > 0 ? (count + jobs - 1) / jobs : count;
+    if (batch < UNITY_MIN_BATCH_SIZE)
+        batch = UNITY_MIN_BATCH_SIZE;
+    if (batch > UNITY_DEFAULT_MAX_BATCH_SIZE)
+        batch = UNITY_DEFAULT_MAX_BATCH_SIZE;
+    return batch;
+}
+
+// Batch size recorded in a build tree, 0 if unity builds are off
+int unity_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+
+    int batch = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "batch=", 6) == 0)
+            batch = atoi(line + 6);
+    }
+
+    fclose(file);
+    return batch > 0 ? batch : 0;
+}
+
+int unity_save(const char *path, int batch)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    fprintf(file, "# Unity build of this build tree, written by ecewo build --unity\n");
+    fprintf(file, "batch=%d\n", batch);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
@@ -1,4 +1,5 @@
 #include "cli.h"
+#include <dirent.h>
 
 StringBuilder *sb_create(void)
 {
@@ -24,15 +25,21 @@ void sb_append(StringBuilder *sb, const char *str)
         return;
 
     size_t len = strlen(str);
-    while (sb->size + len + 1 > sb->capacity)
+    size_t capacity = sb->capacity;
+    while (sb->size + len + 1 > capacity)
+        capacity *= 2;
+
+    if (capacity != sb->capacity)
     {
-        sb->capacity *= 2;
-        char *new_data = realloc(sb->data, sb->capacity);
+        char *new_data = realloc(sb->data, capacity);
         if (!new_data)
             return; // Handle realloc failure
         sb->data = new_data;
+        sb->capacity = capacity;
     }
-    strcat(sb->data, str);
+
+    // Copy at the known end instead of strcat, which rescans the whole buffer
+    memcpy(sb->data + sb->size, str, len + 1);
     sb->size += len;
 }
 
@@ -127,30 +134,102 @@ int remove_directory(const char *path)
     return result;
 }
 
+// Remove everything inside path except the entries named in keep
+int clean_directory(const char *path, const char **keep, int keep_count)
+{
+    if (!path)
+        return -1;
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+
+    int result = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        int kept = 0;
+        for (int i = 0; i < keep_count && !kept; i++)
+            kept = strcmp(entry->d_name, keep[i]) == 0;
+        if (kept)
+            continue;
+
+        size_t entry_size = strlen(path) + strlen(PATH_SEPARATOR) + strlen(entry->d_name) + 1;
+        char *entry_path = malloc(entry_size);
+        if (!entry_path)
+        {
+            result = -1;
+            break;
+        }
+        snprintf(entry_path, entry_size, "%s%s%s", path, PATH_SEPARATOR, entry->d_name);
+
+        if (directory_exists(entry_path))
+        {
+            if (remove_directory(entry_path) != 0)
+                result = -1;
+        }
+        else if (remove(entry_path) != 0)
+        {
+            result = -1;
+        }
+
+        free(entry_path);
+    }
+
+    closedir(dir);
+    return result;
+}
+
 int execute_command(const char *command)
 {
     if (!command)
         return -1;
 
     printf("Executing: %s\n", command);
+    fflush(stdout);
     return system_command(command);
 }
 
-int download_file(const char *url, const char *output_path)
+void sleep_ms(int milliseconds)
 {
-    if (!url || !output_path)
-        return -1;
+#ifdef _WIN32
+    Sleep(milliseconds);
+#else
+    struct timespec ts;
+    ts.tv_sec = milliseconds / 1000;
+    ts.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
 
-    // Calculate needed size
-    size_t cmd_size = strlen("curl -o \"\" \"\"") + strlen(output_path) + strlen(url) + 1;
-    char *command = malloc(cmd_size);
-    if (!command)
-        return -1;
+// Milliseconds from an arbitrary fixed point, for measuring durations
+long long monotonic_ms(void)
+{
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
 
-    snprintf(command, cmd_size, "curl -o \"%s\" \"%s\"", output_path, url);
-    int result = execute_command(command);
-    free(command);
-    return result;
+// Microsecond counterpart of monotonic_ms, for short intervals
+long long monotonic_us(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (long long)(counter.QuadPart * 1000000 / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
 }
 
 // Check if string contains substring
@@ -227,36 +306,7 @@ char *get_exec_name(void)
         return NULL;
     }
 
-    // Find add_executable line
-    char *exec_line = strstr(cmake_content, "add_executable(");
-    if (!exec_line)
-    {
-        free(cmake_content);
-        return NULL;
-    }
-
-    // Move to after "add_executable("
-    exec_line += strlen("add_executable(");
-
-    // Find the executable name (until space or newline)
-    char *name_end = exec_line;
-    while (*name_end && *name_end != ' ' && *name_end != '\n' && *name_end != '\t')
-    {
-        name_end++;
-    }
-
-    // Copy the name
-    size_t name_len = name_end - exec_line;
-    char *exec_name = malloc(name_len + 1);
-    if (!exec_name)
-    {
-        free(cmake_content);
-        return NULL;
-    }
-
-    strncpy(exec_name, exec_line, name_len);
-    exec_name[name_len] = '\0';
-
+    char *exec_name = cmake_find_exec_name(cmake_content);
     free(cmake_content);
     return exec_name;
 }
@@ -0,0 +1,356 @@
+#include "cli.h"
+#include <dirent.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// Change notification for `ecewo run --watch`. Directories are watched
+// recursively, single files through their parent directory. On Linux
+// every directory gets an inotify watch; elsewhere the watched paths are
+// polled and compared by name, size and modification time.
+
+#define WATCH_POLL_MS 250
+#define WATCH_MAX_DEPTH 16
+
+struct Watcher
+{
+    char **paths; // Directories first, then files
+    int dir_count;
+    int count;
+#ifdef __linux__
+    int fd;
+    int *file_wds; // Watch on each file's parent, -1 if the parent is a watched tree
+#else
+    unsigned long long signature;
+#endif
+};
+
+// Editor swap and backup files shouldn't trigger a rebuild
+static int ignored_name(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0 || name[0] == '.' || name[0] == '#')
+        return 1;
+    if (name[len - 1] == '~')
+        return 1;
+    if (len > 4 && (strcmp(name + len - 4, ".swp") == 0 || strcmp(name + len - 4, ".tmp") == 0))
+        return 1;
+    return 0;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    size_t size = strlen(dir) + strlen(PATH_SEPARATOR) + strlen(name) + 1;
+    char *path = malloc(size);
+    if (path)
+        snprintf(path, size, "%s%s%s", dir, PATH_SEPARATOR, name);
+    return path;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *name = path;
+    for (const char *p = path; *p; p++)
+    {
+        if (*p == '/' || *p == '\\')
+            name = p + 1;
+    }
+    return name;
+}
+
+#ifdef __linux__
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+
+static void add_watch_tree(Watcher *watcher, const char *path, int depth)
+{
+    int wd = inotify_add_watch(watcher->fd, path, WATCH_EVENTS | IN_ONLYDIR);
+    if (wd < 0)
+        return;
+
+    // inotify hands out one wd per directory, so a file whose parent is
+    // part of a tree no longer needs filtering by name
+    for (int i = watcher->dir_count; i < watcher->count; i++)
+    {
+        if (watcher->file_wds[i] == wd)
+            watcher->file_wds[i] = -1;
+    }
+
+    if (depth >= WATCH_MAX_DEPTH)
+        return;
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (ignored_name(entry->d_name))
+            continue;
+
+        char *child = join_path(path, entry->d_name);
+        if (child && directory_exists(child))
+            add_watch_tree(watcher, child, depth + 1);
+        free(child);
+    }
+    closedir(dir);
+}
+
+// Whether an event is about something we watch
+static int relevant_event(const Watcher *watcher, const struct inotify_event *event)
+{
+    if (event->len > 0 && ignored_name(event->name))
+        return 0;
+
+    int file_parent = 0;
+    for (int i = watcher->dir_count; i < watcher->count; i++)
+    {
+        if (watcher->file_wds[i] != event->wd)
+            continue;
+
+        if (event->len > 0 && strcmp(event->name, base_name(watcher->paths[i])) == 0)
+            return 1;
+        file_parent = 1;
+    }
+
+    // Anything else in a file's parent directory is someone else's business
+    return !file_parent;
+}
+
+// Drain pending events. Returns 1 if any of them is a relevant change.
+static int read_events(Watcher *watcher)
+{
+    char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    int new_directory = 0;
+
+    while (1)
+    {
+        ssize_t len = read(watcher->fd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+
+        for (char *p = buffer; p < buffer + len;)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (!relevant_event(watcher, event))
+                continue;
+
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                new_directory = 1;
+
+            changed = 1;
+        }
+    }
+
+    // New subdirectories need watches of their own. Re-adding the trees
+    // is cheap, inotify returns the existing wd for known directories.
+    if (new_directory)
+    {
+        for (int i = 0; i < watcher->dir_count; i++)
+            add_watch_tree(watcher, watcher->paths[i], 0);
+    }
+
+    return changed;
+}
+
+#else
+
+static unsigned long long mix(unsigned long long hash, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static unsigned long long tree_signature(const char *path, unsigned long long hash, int depth)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return mix(hash, path, strlen(path));
+
+    long long mtime = (long long)st.st_mtime;
+    long long size = (long long)st.st_size;
+    hash = mix(hash, path, strlen(path));
+    hash = mix(hash, &mtime, sizeof(mtime));
+    hash = mix(hash, &size, sizeof(size));
+
+    if (!S_ISDIR(st.st_mode) || depth >= WATCH_MAX_DEPTH)
+        return hash;
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return hash;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (ignored_name(entry->d_name))
+            continue;
+
+        char *child = join_path(path, entry->d_name);
+        if (child)
+            hash = tree_signature(child, hash, depth + 1);
+        free(child);
+    }
+    closedir(dir);
+    return hash;
+}
+
+static unsigned long long watcher_signature(const Watcher *watcher)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < watcher->count; i++)
+        hash = tree_signature(watcher->paths[i], hash, 0);
+    return hash;
+}
+
+#endif
+
+static int add_path(Watcher *watcher, const char *path)
+{
+    watcher->paths[watcher->count] = malloc(strlen(path) + 1);
+    if (!watcher->paths[watcher->count])
+        return -1;
+
+    strcpy(watcher->paths[watcher->count++], path);
+    return 0;
+}
+
+// Watch the directories in dirs recursively and the single files in
+// files. Directories that don't exist are skipped.
+Watcher *watcher_create(const char **dirs, int dir_count, const char **files, int file_count)
+{
+    Watcher *watcher = calloc(1, sizeof(Watcher));
+    if (!watcher)
+        return NULL;
+
+#ifdef __linux__
+    watcher->fd = -1;
+    watcher->file_wds = calloc(dir_count + file_count, sizeof(int));
+#endif
+    watcher->paths = calloc(dir_count + file_count, sizeof(char *));
+    if (!watcher->paths)
+    {
+        watcher_free(watcher);
+        return NULL;
+    }
+
+    for (int i = 0; i < dir_count; i++)
+    {
+        if (directory_exists(dirs[i]) && add_path(watcher, dirs[i]) != 0)
+        {
+            watcher_free(watcher);
+            return NULL;
+        }
+    }
+    watcher->dir_count = watcher->count;
+
+    for (int i = 0; i < file_count; i++)
+    {
+        if (add_path(watcher, files[i]) != 0)
+        {
+            watcher_free(watcher);
+            return NULL;
+        }
+    }
+
+#ifdef __linux__
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0 || !watcher->file_wds)
+    {
+        watcher_free(watcher);
+        return NULL;
+    }
+
+    // Files first, so trees that contain their parent can take them over
+    for (int i = watcher->dir_count; i < watcher->count; i++)
+    {
+        const char *name = base_name(watcher->paths[i]);
+        char parent[1024];
+        if (name == watcher->paths[i])
+            snprintf(parent, sizeof(parent), ".");
+        else
+            snprintf(parent, sizeof(parent), "%.*s", (int)(name - watcher->paths[i]), watcher->paths[i]);
+
+        watcher->file_wds[i] = inotify_add_watch(watcher->fd, parent, WATCH_EVENTS | IN_ONLYDIR);
+    }
+
+    for (int i = 0; i < watcher->dir_count; i++)
+        add_watch_tree(watcher, watcher->paths[i], 0);
+#else
+    watcher->signature = watcher_signature(watcher);
+#endif
+
+    return watcher;
+}
+
+// Wait up to timeout_ms (-1 for no limit) for a change. Returns 1 on a
+// change, 0 on timeout and -1 on error or interruption.
+int watcher_wait(Watcher *watcher, int timeout_ms)
+{
+    long long deadline = timeout_ms >= 0 ? monotonic_ms() + timeout_ms : -1;
+
+    while (1)
+    {
+#ifdef __linux__
+        int wait_ms = -1;
+        if (deadline >= 0)
+        {
+            long long left = deadline - monotonic_ms();
+            wait_ms = left > 0 ? (int)left : 0;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = watcher->fd;
+        pfd.events = POLLIN;
+
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready < 0)
+            return -1;
+        if (ready == 0)
+            return 0;
+
+        if (read_events(watcher))
+            return 1;
+#else
+        unsigned long long signature = watcher_signature(watcher);
+        if (signature != watcher->signature)
+        {
+            watcher->signature = signature;
+            return 1;
+        }
+
+        if (deadline >= 0 && monotonic_ms() >= deadline)
+            return 0;
+
+        sleep_ms(WATCH_POLL_MS);
+#endif
+    }
+}
+
+void watcher_free(Watcher *watcher)
+{
+    if (!watcher)
+        return;
+
+#ifdef __linux__
+    if (watcher->fd >= 0)
+        close(watcher->fd);
+    free(watcher->file_wds);
+#endif
+
+    for (int i = 0; i < watcher->count; i++)
+        free(watcher->paths[i]);
+    free(watcher->paths);
+    free(watcher);
+}